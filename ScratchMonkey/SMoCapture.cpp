@@ -0,0 +1,134 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoCapture.cpp     - Sample protocol pins while a command runs
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#include "SMoCapture.h"
+#include "SMoCommand.h"
+#include "SMoHWIF.h"
+
+#ifdef SMO_CAPTURE
+
+#if SMO_LAYOUT==SMO_LAYOUT_MEGA
+const uint16_t  kBufferSize     = 2048;
+#else
+const uint16_t  kBufferSize     = 384;
+#endif
+const uint8_t   kMaxPorts       = 3;
+const uint8_t   kMinInterval    = 8;    // The interrupt takes about 60 cycles
+const uint8_t   kMaxProbe       = 16;
+
+static uint8_t              sBuffer[kBufferSize];
+static uint8_t * volatile   sNext;
+static uint8_t *            sEnd;
+static volatile uint8_t *   sPort[kMaxPorts];
+static uint8_t              sNumPorts;
+static uint16_t             sSamples;
+
+void
+SMoCapture::Sample()
+{
+    uint8_t * next = sNext;
+    if (next >= sEnd) {
+        SMoHWIF::Sampler::Stop();
+        return;
+    }
+    *next++ = *sPort[0];
+    if (sNumPorts > 1) {
+        *next++ = *sPort[1];
+        if (sNumPorts > 2)
+            *next++ = *sPort[2];
+    }
+    sNext = next;
+    SMoHWIF::Sampler::Next();
+}
+
+static void
+Run()
+{
+    const uint8_t   interval    = SMoCommand::gBody[2];
+    const uint8_t   numPorts    = SMoCommand::gBody[3];
+    const uint8_t   len         = SMoCommand::gBody[7];
+    uint8_t         probe[kMaxProbe];
+
+    //
+    // The probe must be a plain STK command, none of our own
+    //
+    if (interval < kMinInterval || !numPorts || numPorts > kMaxPorts 
+     || !len || len > kMaxProbe || SMoCommand::gSize < 8+len 
+     || (SMoCommand::gBody[8] & 0xF0) == 0xA0
+    ) {
+        SMoCommand::SendResponse(STATUS_CMD_FAILED);
+        return;
+    }
+    for (uint8_t i=0; i<numPorts; ++i)
+        sPort[i] = &_SFR_IO8(SMoCommand::gBody[4+i]);
+    sNumPorts   = numPorts;
+    sSamples    = kBufferSize / numPorts;
+    sEnd        = sBuffer + sSamples*numPorts;
+    sNext       = sBuffer;
+    memcpy(probe, &SMoCommand::gBody[8], len);
+
+    if (!SMoHWIF::Sampler::Start(interval)) {
+        SMoCommand::SendResponse(STATUS_CMD_FAILED);
+        return;
+    }
+    memcpy(&SMoCommand::gBody[0], probe, len);
+    SMoCommand::gSize = len;
+    SMoCommand::DeferResponses(true);
+    SMoCommand::Dispatch(SMoCommand::gBody[0]);
+    uint8_t status = SMoCommand::DeferredStatus();
+    SMoCommand::DeferResponses(false);
+    SMoHWIF::Sampler::Stop();
+    sSamples    = (sNext-sBuffer) / numPorts;
+
+    SMoCommand::gBody[0] = CMD_SCRATCHMONKEY_CAPTURE;
+    SMoCommand::gBody[2] = status;
+    SMoCommand::gBody[3] = SMO_LAYOUT;
+    SMoCommand::gBody[4] = NUM_ANALOG_INPUTS;
+    SMoCommand::gBody[5] = SMoHWIF::Sampler::kTickNs >> 8;
+    SMoCommand::gBody[6] = SMoHWIF::Sampler::kTickNs & 0xFF;
+    SMoCommand::gBody[7] = sSamples >> 8;
+    SMoCommand::gBody[8] = sSamples & 0xFF;
+    SMoCommand::SendResponse(STATUS_CMD_OK, 9);
+}
+
+static void
+Read()
+{
+    if (!sNumPorts) {
+        SMoCommand::SendResponse(STATUS_CMD_FAILED);
+        return;
+    }
+    uint16_t    first   = (SMoCommand::gBody[2] << 8) | SMoCommand::gBody[3];
+    uint16_t    room    = (SMoCommand::kMaxBodySize-4) / sNumPorts;
+    uint16_t    count   = first < sSamples ? sSamples-first : 0;
+
+    if (count > room)
+        count = room;
+    memcpy(&SMoCommand::gBody[4], sBuffer+first*sNumPorts, count*sNumPorts);
+    SMoCommand::SendResponse(STATUS_CMD_OK, 4+count*sNumPorts);
+}
+
+void
+SMoCapture::Command()
+{
+    switch (SMoCommand::gBody[1]) {
+    case SCRATCHMONKEY_CAPTURE_RUN:
+        Run();
+        break;
+    case SCRATCHMONKEY_CAPTURE_READ:
+        Read();
+        break;
+    default:
+        SMoCommand::SendResponse(STATUS_CMD_FAILED);
+        break;
+    }
+}
+
+#endif /* SMO_CAPTURE */
@@ -0,0 +1,50 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoCapture.h       - Sample protocol pins while a command runs
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// A poor man's logic analyzer: With SMO_CAPTURE defined (see SMoConfig.h),
+// a timer interrupt (SMoHWIF_Sampler, see SMoHWIF_Timer.h) reads up to 3
+// ports into SRAM at a fixed interval while a single STK command runs. The
+// host fetches the samples afterwards and turns them into a VCD file
+// (Tools/smocapture).
+//
+// Sampling takes the CPU away from the protocol, so the protocol runs slower
+// while captured, and edges closer together than the interval are lost.
+// This is useful for the waits and handshakes around a protocol operation,
+// and for protocols slowed down with the SMoTiming knobs, not for checking
+// the fastest settings at full speed.
+//
+// CMD_SCRATCHMONKEY_CAPTURE
+//   [1]      SCRATCHMONKEY_CAPTURE_RUN: [2] interval in ticks [3] number of
+//              ports (1-3) [4..6] ports (PIN register, as in SMoHWIF_PORT_x)
+//              [7] len [8..] body[len]
+//              Runs the STK command in body, sampling until it finishes or
+//              the buffer is full. Response: status, status of the command,
+//              layout (SMO_LAYOUT_x), analog inputs, tick length in ns(2),
+//              number of samples(2). Fails if the layout has no sampler.
+//            SCRATCHMONKEY_CAPTURE_READ: [2..3] first sample
+//              Response: status, first sample(2), samples, one byte per port,
+//              as many as fit
+//   All values are big endian.
+//
+
+#ifndef _SMO_CAPTURE_
+#define _SMO_CAPTURE_
+
+#include <inttypes.h>
+
+#include "SMoConfig.h"
+
+namespace SMoCapture {
+#ifdef SMO_CAPTURE
+    void    Sample();
+    void    Command();
+#endif
+} // namespace SMoCapture
+
+#endif /* _SMO_CAPTURE_ */
@@ -21,13 +21,15 @@
 
 
 const uint16_t  kHeaderSize         = 5;
-const uint16_t  kMaxBodySize        = 275;  // STK500 hardware limit
 
 static uint8_t  sSequenceNumber;
 static uint16_t sNumBytesRead       = 0;
 static uint16_t sNumBytesWanted     = 1;
 static uint8_t  sCheckSum           = 0;
 static bool     sSerialInUse        = false;
+static uint8_t  sDeferResponses     = 0;
+static uint8_t  sDeferredStatus;
+static uint16_t sDeferredSize;
 #ifdef SMO_SHARE_SERIAL_PINS
 static bool     sShareSerialPins    = false;
 #else
@@ -53,6 +55,28 @@ ResetToIdle()
     sCheckSum       = 0;
 }
 
+//
+// Pull up to maxBytes of the current frame section into buf. The UART
+// layouts hand over one byte per call. Native USB reads straight from the
+// CDC endpoint, so a whole 64 byte packet lands in the frame buffer at once.
+//
+static uint16_t
+ReceiveBytes(uint8_t * buf, uint16_t maxBytes)
+{
+#ifdef SMO_USB_CDC
+    int avail = USB_Available(CDC_RX);
+    if (avail <= 0)
+        return 0;
+    int numRead = USB_Recv(CDC_RX, buf, min(uint16_t(avail), maxBytes));
+    return numRead > 0 ? numRead : 0;
+#else
+    if (!Serial.available())
+        return 0;
+    *buf = Serial.read();
+    return 1;
+#endif
+}
+
 //
 // For HVPP, we're short enough on pins in some models that we need to re-use the
 // serial port. Based on an idea by João Paulo Barraca <jpbarraca@ua.pt>
@@ -94,9 +118,13 @@ int
 SMoCommand::GetNextCommand()
 {
     NeedSerial(true);
-    if (!Serial.available() || sState == kCompleteState)
+    if (sState == kCompleteState)
+        return kIncomplete;
+    uint16_t numRead = ReceiveBytes(&gBody[sNumBytesRead], sNumBytesWanted-sNumBytesRead);
+    if (!numRead)
         return kIncomplete;
-    sCheckSum ^= (gBody[sNumBytesRead++] = Serial.read());
+    while (numRead--)
+        sCheckSum ^= gBody[sNumBytesRead++];
 #ifdef DEBUG_COMM
     SMoDebug.print("Has "); SMoDebug.print(sNumBytesRead);
     SMoDebug.print(" Want "); SMoDebug.println(sNumBytesWanted);
@@ -126,6 +154,7 @@ SMoCommand::GetNextCommand()
 #ifdef DEBUG_COMM
             SMoDebug.print("Command "); if (gBody[0] < 16) SMoDebug.print("0"); SMoDebug.println(gBody[0], HEX);
 #endif
+            SMoTrace::Log(SMoTrace::kCommand, gBody[0], gSize);
             NeedSerial(false);
             return gBody[0];   // Success!
         }
@@ -146,9 +175,50 @@ SMoCommand::GetNextCommand()
     }
 }
 
+bool
+SMoCommand::Busy()
+{
+    return sState != kIdleState || Serial.available();
+}
+
+void
+SMoCommand::DeferResponses(bool defer)
+{
+    if (defer)
+        ++sDeferResponses;
+    else
+        --sDeferResponses;
+    sDeferredStatus = STATUS_CMD_OK;
+    sDeferredSize   = 0;
+}
+
+uint8_t
+SMoCommand::DeferredStatus()
+{
+    return sDeferredStatus;
+}
+
+uint16_t
+SMoCommand::DeferredSize()
+{
+    return sDeferredSize;
+}
+
+bool
+SMoCommand::Deferring()
+{
+    return sDeferResponses != 0;
+}
+
 void
 SMoCommand::SendResponse(uint8_t status, uint16_t bodySize, bool xprog)
 {
+    SMoTrace::Log(SMoTrace::kResponse, status, bodySize, sDeferResponses);
+    if (sDeferResponses) {
+        sDeferredStatus = status;
+        sDeferredSize   = bodySize;
+        return;
+    }
     NeedSerial(true);
 
 #ifdef DEBUG_COMM
@@ -157,19 +227,41 @@ SMoCommand::SendResponse(uint8_t status, uint16_t bodySize, bool xprog)
     gBody[xprog?2:1] = status;
 
     sCheckSum  = MESSAGE_START ^ TOKEN ^ sSequenceNumber;
-    Serial.write(MESSAGE_START);
-    Serial.write(sSequenceNumber);
     sCheckSum  ^= bodySize >> 8;
-    Serial.write(bodySize >> 8);
     sCheckSum  ^= bodySize & 0xFF;
-    Serial.write(bodySize & 0xFF);
-    Serial.write(TOKEN);
-
     for (uint16_t i=0; i<bodySize; ++i)
         sCheckSum   ^= gBody[i];
 
+#ifdef SMO_USB_CDC
+    //
+    // Every write to the CDC endpoint may go out as a packet of its own, so
+    // we assemble the header and the start of the body into one full packet
+    // and hand over the rest, checksum included, in a single write, which
+    // the USB core splits into full packets.
+    //
+    const uint16_t kPacketSize = 64;
+    uint8_t  packet[kPacketSize];
+    uint16_t headSize = min(uint16_t(bodySize+1), uint16_t(kPacketSize-kHeaderSize));
+
+    gBody[bodySize] = sCheckSum;
+    packet[0]  = MESSAGE_START;
+    packet[1]  = sSequenceNumber;
+    packet[2]  = bodySize >> 8;
+    packet[3]  = bodySize & 0xFF;
+    packet[4]  = TOKEN;
+    memcpy(&packet[kHeaderSize], &gBody[0], headSize);
+    Serial.write(packet, kHeaderSize+headSize);
+    if (bodySize+1 > headSize)
+        Serial.write(&gBody[headSize], bodySize+1-headSize);
+#else
+    Serial.write(MESSAGE_START);
+    Serial.write(sSequenceNumber);
+    Serial.write(bodySize >> 8);
+    Serial.write(bodySize & 0xFF);
+    Serial.write(TOKEN);
     Serial.write(&gBody[0], bodySize);
     Serial.write(sCheckSum);
+#endif
 
     ResetToIdle();
 }
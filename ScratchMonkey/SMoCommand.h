@@ -24,6 +24,8 @@ namespace SMoCommand {
         kChecksumError  = -2,
         kIncomplete     = 0
     };
+    const uint16_t  kMaxBodySize    = SMoHWIF_MaxBodySize;
+
     extern uint8_t  gBody[];
     extern uint16_t gSize;
 
@@ -39,8 +41,24 @@ namespace SMoCommand {
     // autonomously.
     //
     int         GetNextCommand();
+    //
+    // Returns true if a command is partially received or bytes are waiting
+    //
+    bool        Busy();
     void        SendResponse(uint8_t status = STATUS_CMD_OK, uint16_t bodySize=2, bool xprog=false);
     void        SendXPROGResponse(uint8_t status = STATUS_CMD_OK, uint16_t bodySize=3);
+    //
+    // To run command handlers internally, we can hold back their responses 
+    // and just record the status and body size instead. Calls may be nested.
+    //
+    void        DeferResponses(bool defer);
+    uint8_t     DeferredStatus();
+    uint16_t    DeferredSize();
+    bool        Deferring();
+    //
+    // Run the handler for a command in gBody (defined in ScratchMonkey.ino)
+    //
+    void        Dispatch(int command);
 } // namespace SMoCommand
 
 #endif /* _SMO_COMMAND_ */
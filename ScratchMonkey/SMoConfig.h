@@ -22,8 +22,104 @@
 #undef DEBUG_TPI
 #undef DEBUG_COMM
 
+//
+// Define to read the next flash/EEPROM block while waiting for the host.
+// The buffer takes 256 bytes of SRAM, which the 2K of the Uno and 2.5K of
+// the Leonardo can't spare next to a 275 byte command body, so it's only on
+// by default for the Mega and the host build.
+//
+#if defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__) || defined(SMO_HOST)
+#define SMO_READ_AHEAD
+#endif
+
+//
+// Define to merge per device patches (serial numbers etc.) into written data
+//
+#define SMO_PATCH
+
+//
+// Define to count commands, handler times, polls and data moved (see SMoStats.h).
+// The table takes about 500 bytes of SRAM (16 commands of 29 bytes) on the
+// Uno and Leonardo, and about 970 bytes (32 commands) on the Mega. With the
+// 275 byte command body, SMO_READ_AHEAD (256 bytes) and SMO_TRACE (320 bytes
+// there), that's well over half of the Uno's 2K, so leave those off there.
+//
+#undef SMO_STATS
+
+//
+// Define to log protocol events into a ring buffer (see SMoTrace.h). Unlike
+// the DEBUG_ options, this barely disturbs the timing.
+//
+#undef SMO_TRACE
+
+//
+// Define to accept link throughput self test commands (see SMoLink.h)
+//
+#define SMO_LINK_TEST
+
+//
+// Define to sweep HVSP, HVPP and TPI timing and keep the results in EEPROM
+// (see SMoTiming.h)
+//
+#define SMO_TIMING
+
+//
+// Define to sample protocol pins into SRAM while a command runs, for a VCD
+// view of the signals (see SMoCapture.h). Costs up to 2K of SRAM.
+//
+#undef SMO_CAPTURE
+
+//
+// Define if the target VCC is wired to a sense input (see SMoHWIF_HV.h), so
+// HVSP, HVPP and TPI power sequencing can wait out the rail, not the clock
+//
+#undef SMO_VCC_SENSE
+
+//
+// Define to hold the target in programming mode after the host leaves it, so
+// the next session with the same parameters skips the power and reset dance
+// (see SMoSession.h). SMO_STICKY_TIMEOUT is the default for how many idle
+// seconds a held target waits; PARAM_SCRATCHMONKEY_STICKY changes it, and 0
+// turns holding off.
+//
+#undef SMO_STICKY_SESSION
+#define SMO_STICKY_TIMEOUT  10
+
+//
+// Define to let the host have every flash and EEPROM page read back and
+// compared right after it is written, instead of in a separate pass (see
+// SMoVerify.h)
+//
+#define SMO_VERIFY
+
+//
+// Define to look the target up in a table of parts generated from
+// avrdude.conf (see SMoDevice.h). Every part costs 17 bytes of flash.
+//
+#define SMO_DEVICES
+
+//
+// Define to let the host stream flash to a helper it loaded into the
+// target's boot section, instead of programming it over ISP (see
+// SMoHelper.h). Needs the target's /SS tied low.
+//
+#undef SMO_HELPER
+
+//
+// Builds needing another configuration (like the variants in Simulator/)
+// name a header with -DSMO_CONFIG_OVERRIDE, which can #define or #undef
+// any of the options above
+//
+#ifdef SMO_CONFIG_OVERRIDE
+#include SMO_CONFIG_OVERRIDE
+#endif
+
 #if defined(DEBUG_ISP) || defined(DEBUG_HVSP) || defined(DEBUG_HVPP) || defined(DEBUG_COMM) || defined(DEBUG_TPI)
 #define SMO_WANT_DEBUG
 #endif
 
+#if defined(SMO_STATS) || defined(SMO_TRACE)
+#define SMO_WANT_TIMER
+#endif
+
 #endif /* _SMO_CONFIG_ */
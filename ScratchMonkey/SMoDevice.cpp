@@ -0,0 +1,103 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoDevice.cpp      - What the programmer knows about the target
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#include "SMoDevice.h"
+#include "SMoCommand.h"
+#include "SMoSession.h"
+
+#include <avr/pgmspace.h>
+#include <string.h>
+
+#ifdef SMO_DEVICES
+
+#include "SMoDeviceTable.h"
+
+static SMoDevice::Info  sDevice;
+static bool             sKnown;
+
+void
+SMoDevice::Identify(uint8_t protocol)
+{
+    uint8_t sig[3];
+
+    SMoSession::Signature(protocol, sig);
+    sKnown = false;
+    for (uint8_t i = 0; i < sizeof(kDevices)/sizeof(kDevices[0]); ++i) {
+        memcpy_P(&sDevice, &kDevices[i], sizeof(Info));
+        if (!memcmp(sDevice.fSignature, sig, 3)) {
+            sKnown = true;
+            break;
+        }
+    }
+}
+
+uint16_t
+SMoDevice::PageSize(uint8_t command)
+{
+    if (!sKnown)
+        return 0;
+    switch (command) {
+    case CMD_PROGRAM_FLASH_ISP:
+    case CMD_PROGRAM_FLASH_HVSP:
+    case CMD_PROGRAM_FLASH_PP:
+        return sDevice.fFlashPage;
+    case CMD_PROGRAM_EEPROM_ISP:
+    case CMD_PROGRAM_EEPROM_HVSP:
+    case CMD_PROGRAM_EEPROM_PP:
+        return sDevice.fEEPROMPage;
+    default:
+        return 0;
+    }
+}
+
+void
+SMoDevice::Command()
+{
+    uint8_t * response = &SMoCommand::gBody[2];
+
+    if (!sKnown) {
+        SMoCommand::SendResponse(STATUS_CMD_FAILED);
+        return;
+    }
+    switch (SMoCommand::gBody[1]) {
+    case SCRATCHMONKEY_DEVICE_INFO:
+        memcpy(response, sDevice.fSignature, 3);
+        response   += 3;
+        *response++ = sDevice.fModes;
+        *response++ = sDevice.fFlashSize >> 24;
+        *response++ = sDevice.fFlashSize >> 16;
+        *response++ = sDevice.fFlashSize >> 8;
+        *response++ = sDevice.fFlashSize;
+        *response++ = sDevice.fFlashPage >> 8;
+        *response++ = sDevice.fFlashPage;
+        *response++ = sDevice.fEEPROMSize >> 8;
+        *response++ = sDevice.fEEPROMSize;
+        *response++ = sDevice.fEEPROMPage;
+        *response++ = sDevice.fFlashWrite;
+        *response++ = sDevice.fEEPROMWrite;
+        *response++ = sDevice.fErase;
+        *response++ = sDevice.fControlStack != 0;
+        SMoCommand::SendResponse(STATUS_CMD_OK, response-&SMoCommand::gBody[0]);
+        break;
+    case SCRATCHMONKEY_DEVICE_CONTROL_STACK:
+        if (!sDevice.fControlStack) {
+            SMoCommand::SendResponse(STATUS_CMD_FAILED);
+            break;
+        }
+        memcpy_P(response, kControlStacks[sDevice.fControlStack-1], 32);
+        SMoCommand::SendResponse(STATUS_CMD_OK, 34);
+        break;
+    default:
+        SMoCommand::SendResponse(STATUS_CMD_FAILED);
+        break;
+    }
+}
+
+#endif /* SMO_DEVICES */
@@ -0,0 +1,68 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoDevice.h        - What the programmer knows about the target
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// Page sizes, delays and instructions all come from the host with every
+// command, so by itself, the programmer knows nothing about the chip. With
+// SMO_DEVICES defined (see SMoConfig.h), it looks up the signature in a
+// table generated from avrdude.conf by Tools/smodevices (SMoDeviceTable.h)
+// every time it enters programming mode. If the part is there,
+//
+//  - Program commands larger than a page are split into pages (see
+//    SMoRegion.h) even if the host never set PARAM2_SCRATCHMONKEY_PAGE_SIZE
+//  - Host tools can ask for sizes and page sizes instead of being told
+//
+// CMD_SCRATCHMONKEY_DEVICE
+//   [1]      SCRATCHMONKEY_DEVICE_INFO
+//              Response: status (STATUS_CMD_FAILED if the part is not in
+//              the table), signature(3), modes (1 ISP, 2 HVSP, 4 HVPP,
+//              8 TPI), flash size(4), flash page(2), EEPROM size(2), EEPROM
+//              page, flash write, EEPROM write and chip erase time in ms,
+//              1 if the HVPP control stack is known
+//            SCRATCHMONKEY_DEVICE_CONTROL_STACK
+//              Response: status, control stack(32) for CMD_SET_CONTROL_STACK
+//
+
+#ifndef _SMO_DEVICE_
+#define _SMO_DEVICE_
+
+#include <inttypes.h>
+
+#include "SMoConfig.h"
+
+namespace SMoDevice {
+    struct Info {
+        uint8_t     fSignature[3];
+        uint8_t     fModes;
+        uint32_t    fFlashSize;
+        uint16_t    fFlashPage;     // Bytes
+        uint16_t    fEEPROMSize;
+        uint8_t     fEEPROMPage;
+        uint8_t     fFlashWrite;    // Worst case, in ms
+        uint8_t     fEEPROMWrite;
+        uint8_t     fErase;
+        uint8_t     fControlStack;  // 1 based, 0 if none known
+    };
+#ifdef SMO_DEVICES
+    //
+    // Called by EnterProgmode() once the target is in programming mode, with
+    // the protocol as in SMoSession.h
+    //
+    void        Identify(uint8_t protocol);
+    //
+    // Page size for an STK program command, 0 if the part is unknown
+    //
+    uint16_t    PageSize(uint8_t command);
+    void        Command();
+#else
+    inline void     Identify(uint8_t) {}
+    inline uint16_t PageSize(uint8_t) { return 0; }
+#endif
+} // namespace SMoDevice
+
+#endif /* _SMO_DEVICE_ */
@@ -0,0 +1,34 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoDeviceTable.h   - Device table, generated by Tools/smodevices
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// As shipped, this lists the parts the simulator models (see
+// Simulator/SimTarget.cpp), with its data sheet worst case timings.
+// Regenerate it from your avrdude.conf for others. Included by
+// SMoDevice.cpp only.
+//
+
+static const uint8_t kControlStacks[][32] PROGMEM = {
+    {0x0E, 0x1E, 0x0F, 0x1F, 0x2E, 0x3E, 0x2F, 0x3F,
+     0x4E, 0x5E, 0x4F, 0x5F, 0x6E, 0x7E, 0x6F, 0x7F,
+     0x66, 0x76, 0x67, 0x77, 0x6A, 0x7A, 0x6B, 0x7B,
+     0xBE, 0xFD, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00},
+};
+
+static const SMoDevice::Info kDevices[] PROGMEM = {
+    // Signature          Modes Flash    Page EEPROM Page  Flash EEPROM Erase Stack
+    {{0x1E, 0x93, 0x0B}, 0x3,    8192,   64,   512,   4,     5,     4,    9,    0}, // ATtiny85
+    {{0x1E, 0x93, 0x0C}, 0x3,    8192,   64,   512,   4,     5,     4,    9,    0}, // ATtiny84
+    {{0x1E, 0x92, 0x0D}, 0x5,    4096,   64,   256,   4,     5,     4,    9,    0}, // ATtiny4313
+    {{0x1E, 0x93, 0x0D}, 0x5,    8192,   64,   512,   4,     5,     4,    9,    0}, // ATtiny861
+    {{0x1E, 0x94, 0x12}, 0x5,   16384,   32,   256,   4,     5,     4,    9,    0}, // ATtiny1634
+    {{0x1E, 0x95, 0x14}, 0x5,   32768,  128,  1024,   4,     5,     4,    9,    1}, // ATmega328
+    {{0x1E, 0x95, 0x0F}, 0x5,   32768,  128,  1024,   4,     5,     4,    9,    1}, // ATmega328P
+    {{0x1E, 0x97, 0x05}, 0x5,  131072,  256,  4096,   8,     5,     4,    9,    1}, // ATmega1284P
+    {{0x1E, 0x90, 0x03}, 0x8,    1024,   16,     0,   0,     3,     0,    9,    0}, // ATtiny10
+};
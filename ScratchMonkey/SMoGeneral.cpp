@@ -11,6 +11,11 @@
 #include "SMoGeneral.h"
 #include "SMoCommand.h"
 #include "SMoHWIF.h"
+#include "SMoPatch.h"
+#include "SMoReadAhead.h"
+#include "SMoSession.h"
+#include "SMoVerify.h"
+#include "SMoHelper.h"
 
 #include <string.h>
 
@@ -27,10 +32,18 @@ static uint8_t          gPrescale           = 0;    // Settable
 static uint8_t          gClockMatch         = 0;    //  ... but ignored
 uint8_t     SMoGeneral::gControlStack[32];
 uint8_t     SMoGeneral::gXPROGMode;
+uint16_t    SMoGeneral::gPageSize;
 
 void    
 SMoGeneral::SignOn()
 {
+#ifdef SMO_VERIFY
+    SMoVerify::gEnabled = false;
+#endif
+#ifdef SMO_PATCH
+    SMoPatch::Clear();
+#endif
+    gPageSize = 0;
 #if 0
     memcpy(&SMoCommand::gBody[2], "\010STK500_2", 9);
     SMoCommand::SendResponse(STATUS_CMD_OK, 11);
@@ -57,6 +70,11 @@ SMoGeneral::SetParam()
         break;
     case PARAM_SCK_DURATION:
     case PARAM2_SCK_DURATION:
+        //
+        // A held ISP session runs at the old clock, perhaps in limp mode
+        //
+        if (value != gSCKDuration)
+            SMoSession::Drop();
         gSCKDuration    = value;
         break;
     case PARAM_RESET_POLARITY:
@@ -77,6 +95,27 @@ SMoGeneral::SetParam()
     case PARAM_SCRATCHMONKEY_STATUS_LEDS:
         SMoHWIF::Status::Set(value);
         break;
+#ifdef SMO_STICKY_SESSION
+    case PARAM_SCRATCHMONKEY_STICKY:
+        SMoSession::gTimeout = value;
+        if (!value)
+            SMoSession::Drop();
+        break;
+#endif
+#ifdef SMO_VERIFY
+    case PARAM_SCRATCHMONKEY_VERIFY:
+#ifdef SMO_HELPER
+        if (value && SMoHelper::gActive) {
+            SMoCommand::SendResponse(STATUS_CMD_FAILED);
+            return;
+        }
+#endif
+        SMoVerify::gEnabled = value;
+        break;
+#endif
+    case PARAM2_SCRATCHMONKEY_PAGE_SIZE:
+        gPageSize = value;
+        break;
     default:
         SMoCommand::SendResponse(STATUS_CMD_FAILED);
         return;
@@ -126,6 +165,26 @@ SMoGeneral::GetParam()
     case PARAM_TOPCARD_DETECT:
         result = 0;
         break;
+#ifdef SMO_STICKY_SESSION
+    case PARAM_SCRATCHMONKEY_STICKY:
+        result = SMoSession::gTimeout;
+        break;
+#endif
+#ifdef SMO_VERIFY
+    case PARAM_SCRATCHMONKEY_VERIFY:
+        result = SMoVerify::gEnabled;
+        break;
+#endif
+    case PARAM2_SCRATCHMONKEY_MAX_BODY:
+        result                  = SMoCommand::kMaxBodySize >> 8;
+        SMoCommand::gBody[3]    = SMoCommand::kMaxBodySize & 0xFF;
+        SMoCommand::SendResponse(STATUS_CMD_OK, 4);
+        return;
+    case PARAM2_SCRATCHMONKEY_PAGE_SIZE:
+        result                  = gPageSize >> 8;
+        SMoCommand::gBody[3]    = gPageSize & 0xFF;
+        SMoCommand::SendResponse(STATUS_CMD_OK, 4);
+        return;
     default:
         SMoCommand::SendResponse(STATUS_CMD_FAILED);
         return;
@@ -137,17 +196,27 @@ SMoGeneral::GetParam()
 void    
 SMoGeneral::LoadAddress()
 {
-    SMoGeneral::gAddress = 
+    uint32_t address =
                (uint32_t(SMoCommand::gBody[1]) << 24UL) 
              | (uint32_t(SMoCommand::gBody[2]) << 16UL)
              | (uint32_t(SMoCommand::gBody[3]) <<  8UL)
              |  SMoCommand::gBody[4];
+#ifdef SMO_READ_AHEAD
+    if (address != SMoGeneral::gAddress)
+        SMoReadAhead::Invalidate();
+#endif
+    SMoGeneral::gAddress = address;
     SMoCommand::SendResponse();
 }
 
 void 
 SMoGeneral::SetControlStack()
 {
+    //
+    // A held session was entered with the old control stack
+    //
+    if (memcmp(&SMoGeneral::gControlStack[0], &SMoCommand::gBody[1], 32))
+        SMoSession::Drop();
     memcpy(&SMoGeneral::gControlStack[0], &SMoCommand::gBody[1], 32);
     SMoCommand::SendResponse();
 }
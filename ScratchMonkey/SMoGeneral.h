@@ -18,6 +18,7 @@ namespace SMoGeneral {
     extern uint32_t gAddress;
     extern uint8_t  gControlStack[];
     extern uint8_t  gXPROGMode;
+    extern uint16_t gPageSize;
 
     void    SignOn();
     void    SetParam();
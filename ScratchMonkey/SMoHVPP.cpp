@@ -14,6 +14,12 @@
 #include "SMoGeneral.h"
 #include "SMoConfig.h"
 #include "SMoHWIF.h"
+#include "SMoReadAhead.h"
+#include "SMoPatch.h"
+#include "SMoStats.h"
+#include "SMoSession.h"
+#include "SMoVerify.h"
+#include "SMoDevice.h"
 
 #ifdef DEBUG_HVPP
 #include "SMoDebug.h"
@@ -57,8 +63,9 @@ HVPPSetControls(uint8_t controlIx)
     SMoDebug.print(SMoGeneral::gControlStack[controlIx], BIN);
     SMoDebug.println();
 #endif
+    SMoTrace::Log(SMoTrace::kHVPPCtrl, controlIx, SMoGeneral::gControlStack[controlIx]);
     SMoHWIF::HVPP::SetControlSignals(SMoGeneral::gControlStack[controlIx]);
-    delayMicroseconds(1);
+    SMoDelayKnob<SMoTiming::kHVPPMinNs>(SMoTiming::kHVPP);
 }
 
 inline void
@@ -83,6 +90,7 @@ HVPPSetDataRaw(uint8_t dataOut)
    SMoDebug.print("Data<");
    SMoDebug.println(dataOut, HEX);
 #endif
+   SMoTrace::Log(SMoTrace::kHVPPOut, dataOut);
    SMoHWIF::HVPP::SetData(dataOut);
 }
 
@@ -95,6 +103,7 @@ HVPPGetDataRaw()
     SMoDebug.print("Data>");
     SMoDebug.println(dataIn, HEX);
 #endif
+    SMoTrace::Log(SMoTrace::kHVPPIn, dataIn);
 
     return dataIn;
 }
@@ -164,9 +173,16 @@ static bool
 HVPPPollWait(uint8_t pollTimeout)
 {
     uint32_t target = millis()+pollTimeout+10;
-    while (millis() != target)
-        if (SMoHWIF::HVPP::GetReady()) 
+    uint32_t start  = SMoStats::Now();
+    uint16_t polls  = 0;
+    while (millis() != target) {
+        ++polls;
+        if (SMoHWIF::HVPP::GetReady()) {
+            SMoStats::Polled(start, polls);
             return true;
+        }
+    }
+    SMoStats::Polled(start, polls);
     SMoCommand::SendResponse(STATUS_RDY_BSY_TOUT);
     return false;
 }
@@ -186,13 +202,18 @@ SMoHVPP::EnterProgmode()
     const uint8_t   resetDelay1 = SMoCommand::gBody[6];
     const uint8_t   resetDelay2 = SMoCommand::gBody[7];
    
+    if (SMoSession::Resume(SMoSession::kHVPP)) {
+        SMoCommand::SendResponse();
+        return;
+    }
     SMoHWIF::HVPP::Setup(SMoGeneral::gControlStack[kInit], powOffDelay, latchCycles); 
     delay(resetDelay1);
     delayMicroseconds(resetDelay2);
+    SMoSession::Entered(SMoSession::kHVPP);
+    HVPPSetControls(kDone);
+    SMoDevice::Identify(SMoSession::kHVPP);
     
     SMoCommand::SendResponse();
-    
-    HVPPSetControls(kDone);
 }
 
 void
@@ -201,13 +222,21 @@ SMoHVPP::LeaveProgmode()
     // const uint8_t   stabDelay   = SMoCommand::gBody[1];
     const uint8_t   resetDelay = SMoCommand::gBody[2];
 
-    SMoHWIF::HVPP::Stop();
+    if (!SMoSession::Hold(SMoSession::kHVPP)) {
+        Stop();
 
-    delay(resetDelay);
+        delay(resetDelay);
+    }
 
     SMoCommand::SendResponse();
 }
 
+void
+SMoHVPP::Stop()
+{
+    SMoHWIF::HVPP::Stop();
+}
+
 void
 SMoHVPP::ChipErase()
 {
@@ -233,14 +262,19 @@ SMoHVPP::ProgramFlash()
     const uint8_t   pollTimeout =   SMoCommand::gBody[4];
     const uint8_t * data        =  &SMoCommand::gBody[5];
 
+#ifdef SMO_PATCH
+    SMoPatch::Apply(true, SMoGeneral::gAddress, &SMoCommand::gBody[5], numBytes);
+#endif
+    SMoStats::Moved(SMoStats::kHVPP, numBytes);
+
     //
     // Enter Flash Programming Mode
     //
     HVPPLoadCommand(0x10);
 
     bool timeout = false;
+    const uint32_t address = SMoGeneral::gAddress;
     if (mode & 1) { // Paged mode
-        uint32_t address = SMoGeneral::gAddress;
         for (; numBytes > 0; numBytes -= 2) {
             //
             // Load Flash Page Buffer
@@ -277,15 +311,13 @@ SMoHVPP::ProgramFlash()
     //
     HVPPLoadCommand(0x00);
     if (!timeout)
-        SMoCommand::SendResponse();
+        SMoVerify::Respond(address, 5, true);
 }
 
 void
-SMoHVPP::ReadFlash()
+SMoHVPP::ReadFlashBlock(uint8_t * outData, int16_t numBytes)
 {
-    int16_t     numBytes    =  (SMoCommand::gBody[1] << 8) | SMoCommand::gBody[2];
-    uint8_t *   outData     =  &SMoCommand::gBody[2];
-    
+    SMoStats::Moved(SMoStats::kHVPP, numBytes);
     //
     // Flash Read
     //
@@ -310,6 +342,33 @@ SMoHVPP::ReadFlash()
         HVPPDataMode(OUTPUT);
         ++SMoGeneral::gAddress;
     }
+}
+
+//
+// On boards where HVPP shares the serial pins, we can't talk to the target
+// while waiting for the next command, so there's no reading ahead.
+//
+#if defined(SMO_READ_AHEAD) && !defined(SMO_SHARE_SERIAL_PINS)
+#define HVPP_READ_AHEAD
+#endif
+
+void
+SMoHVPP::ReadFlash()
+{
+    int16_t     numBytes    =  (SMoCommand::gBody[1] << 8) | SMoCommand::gBody[2];
+    uint8_t *   outData     =  &SMoCommand::gBody[2];
+    
+#ifdef HVPP_READ_AHEAD
+    uint16_t cached = SMoReadAhead::Fetch(outData, numBytes);
+    outData  += cached;
+    numBytes -= cached;
+#endif
+    ReadFlashBlock(outData, numBytes);
+    if (numBytes > 0)
+        outData += numBytes;
+#ifdef HVPP_READ_AHEAD
+    SMoReadAhead::Arm(CMD_READ_FLASH_PP, outData-&SMoCommand::gBody[2], true);
+#endif
     *outData++ = STATUS_CMD_OK;
     SMoCommand::SendResponse(STATUS_CMD_OK, outData-&SMoCommand::gBody[0]);
 }
@@ -322,11 +381,17 @@ SMoHVPP::ProgramEEPROM()
     const uint8_t   pollTimeout =   SMoCommand::gBody[4];
     const uint8_t * data        =  &SMoCommand::gBody[5];
 
+#ifdef SMO_PATCH
+    SMoPatch::Apply(false, SMoGeneral::gAddress, &SMoCommand::gBody[5], numBytes);
+#endif
+    SMoStats::Moved(SMoStats::kHVPP, numBytes);
+
     //
     // Enter EEPROM Programming Mode
     //
     HVPPLoadCommand(0x11);
     bool timeout = false;
+    const uint32_t address = SMoGeneral::gAddress;
     if (mode & 1) { // Paged mode
         HVPPLoadAddress(kHighByte, (SMoGeneral::gAddress >> 8) & 0xFF);
         for (; numBytes > 0; --numBytes) {
@@ -360,15 +425,13 @@ SMoHVPP::ProgramEEPROM()
     //
     HVPPLoadCommand(0x00);
     if (!timeout)
-        SMoCommand::SendResponse();    
+        SMoVerify::Respond(address, 5, false);
 }
 
 void
-SMoHVPP::ReadEEPROM()
+SMoHVPP::ReadEEPROMBlock(uint8_t * outData, int16_t numBytes)
 {
-    int16_t     numBytes    =  (SMoCommand::gBody[1] << 8) | SMoCommand::gBody[2];
-    uint8_t *   outData     =  &SMoCommand::gBody[2];
-    
+    SMoStats::Moved(SMoStats::kHVPP, numBytes);
     //
     // EEPROM Read
     //
@@ -390,6 +453,25 @@ SMoHVPP::ReadEEPROM()
         HVPPDataMode(OUTPUT);
         ++SMoGeneral::gAddress;
     }
+}
+
+void
+SMoHVPP::ReadEEPROM()
+{
+    int16_t     numBytes    =  (SMoCommand::gBody[1] << 8) | SMoCommand::gBody[2];
+    uint8_t *   outData     =  &SMoCommand::gBody[2];
+    
+#ifdef HVPP_READ_AHEAD
+    uint16_t cached = SMoReadAhead::Fetch(outData, numBytes);
+    outData  += cached;
+    numBytes -= cached;
+#endif
+    ReadEEPROMBlock(outData, numBytes);
+    if (numBytes > 0)
+        outData += numBytes;
+#ifdef HVPP_READ_AHEAD
+    SMoReadAhead::Arm(CMD_READ_EEPROM_PP, outData-&SMoCommand::gBody[2], false);
+#endif
     *outData = STATUS_CMD_OK;
     SMoCommand::SendResponse(STATUS_CMD_OK, outData-&SMoCommand::gBody[0]);
 }
@@ -404,6 +486,7 @@ ProgramFuseLock(uint8_t command, uint8_t byteSel)
     HVPPLoadCommand(command);
     HVPPLoadData(kLowByte, value);
     HVPPCommitDataWithPulseWidth(pulseWidth, byteSel);
+    SMoSession::Drop();
 
     if (HVPPPollWait(pollTimeout))
         SMoCommand::SendResponse();
@@ -451,18 +534,24 @@ SMoHVPP::ReadLock()
     ReadFuseLock(kHighByte);
 }
 
-static void
-ReadSignatureCal(uint8_t addr, uint8_t byteSel)
+static uint8_t
+ReadSignatureCalByte(uint8_t addr, uint8_t byteSel)
 {
-    uint8_t * dataOut   = &SMoCommand::gBody[2];
-
     HVPPLoadCommand(0x08);
     HVPPLoadAddress(kLowByte, addr);
     HVPPDataMode(INPUT);
-    *dataOut = HVPPReadData(byteSel);
+    uint8_t data = HVPPReadData(byteSel);
     HVPPSetControls(kDone);
     HVPPDataMode(OUTPUT);
 
+    return data;
+}
+
+static void
+ReadSignatureCal(uint8_t addr, uint8_t byteSel)
+{
+    SMoCommand::gBody[2] = ReadSignatureCalByte(addr, byteSel);
+
     SMoCommand::SendResponse(STATUS_CMD_OK, 3);
 }
 
@@ -479,3 +568,45 @@ SMoHVPP::ReadOscCal()
 {
     ReadSignatureCal(0x00, kHighByte);
 }
+
+void
+SMoHVPP::Signature(uint8_t * sig)
+{
+    for (uint8_t i=0; i<3; ++i)
+        sig[i] = ReadSignatureCalByte(i, kLowByte);
+}
+
+void
+SMoHVPP::LoadCommand(uint8_t command)
+{
+    HVPPLoadCommand(command);
+}
+
+void
+SMoHVPP::LoadAddress(uint8_t byteSel, uint8_t addr)
+{
+    HVPPLoadAddress(byteSel, addr);
+}
+
+void
+SMoHVPP::LoadData(uint8_t byteSel, uint8_t data)
+{
+    HVPPLoadData(byteSel, data);
+}
+
+void
+SMoHVPP::CommitData(uint8_t byteSel)
+{
+    HVPPCommitData(byteSel);
+}
+
+uint8_t
+SMoHVPP::ReadData(uint8_t byteSel)
+{
+    HVPPDataMode(INPUT);
+    uint8_t data = HVPPReadData(byteSel);
+    HVPPSetControls(kDone);
+    HVPPDataMode(OUTPUT);
+
+    return data;
+}
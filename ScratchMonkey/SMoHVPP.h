@@ -15,6 +15,8 @@
 #ifndef _SMO_HVPP_
 #define _SMO_HVPP_
 
+#include <inttypes.h>
+
 namespace SMoHVPP {
     void EnterProgmode();
     void LeaveProgmode();
@@ -29,6 +31,25 @@ namespace SMoHVPP {
     void ReadLock();
     void ReadSignature();
     void ReadOscCal();
+    //
+    // Read from SMoGeneral::gAddress without sending a response
+    //
+    void ReadFlashBlock(uint8_t * outData, int16_t numBytes);
+    void ReadEEPROMBlock(uint8_t * outData, int16_t numBytes);
+    //
+    // Individual steps, with byteSel 0..3 selecting low, high, extended byte
+    //
+    void    LoadCommand(uint8_t command);
+    void    LoadAddress(uint8_t byteSel, uint8_t addr);
+    void    LoadData(uint8_t byteSel, uint8_t data);
+    void    CommitData(uint8_t byteSel);
+    uint8_t ReadData(uint8_t byteSel);
+    //
+    // For SMoSession: End programming mode without a response, read the
+    // three signature bytes
+    //
+    void    Stop();
+    void    Signature(uint8_t * sig);
 } // namespace SMoHVPP
 
 #endif /* _SMO_HVPP_ */
@@ -14,6 +14,12 @@
 #include "SMoGeneral.h"
 #include "SMoConfig.h"
 #include "SMoHWIF.h"
+#include "SMoReadAhead.h"
+#include "SMoPatch.h"
+#include "SMoStats.h"
+#include "SMoSession.h"
+#include "SMoVerify.h"
+#include "SMoDevice.h"
 
 #ifdef DEBUG_HVSP
 #include "SMoDebug.h"
@@ -25,9 +31,16 @@ static bool
 HVSPPollWait(uint8_t pollTimeout)
 {
     uint32_t target = millis()+pollTimeout+10;
-    while (millis() != target)
-        if (SMoHWIF::HVSP::GetReady()) 
+    uint32_t start  = SMoStats::Now();
+    uint16_t polls  = 0;
+    while (millis() != target) {
+        ++polls;
+        if (SMoHWIF::HVSP::GetReady()) {
+            SMoStats::Polled(start, polls);
             return true;
+        }
+    }
+    SMoStats::Polled(start, polls);
     SMoCommand::SendResponse(STATUS_RDY_BSY_TOUT);
     return false;
 }
@@ -45,10 +58,14 @@ SMoHVSP::EnterProgmode()
     // const uint8_t   latchCycles = SMoCommand::gBody[4];
     // const uint8_t   toggleVtg   = SMoCommand::gBody[5];
     const uint8_t   powOffDelay = SMoCommand::gBody[6];
-    const uint8_t   resetDelay1 = SMoCommand::gBody[7];
-    const uint8_t   resetDelay2 = SMoCommand::gBody[8];
+    // const uint8_t   resetDelay1 = SMoCommand::gBody[7];
+    // const uint8_t   resetDelay2 = SMoCommand::gBody[8];
     
-    SMoHWIF::HVSP::Setup(powOffDelay, syncCycles);
+    if (!SMoSession::Resume(SMoSession::kHVSP)) {
+        SMoHWIF::HVSP::Setup(powOffDelay, syncCycles);
+        SMoSession::Entered(SMoSession::kHVSP);
+        SMoDevice::Identify(SMoSession::kHVSP);
+    }
 
     SMoCommand::SendResponse();
 }
@@ -56,11 +73,18 @@ SMoHVSP::EnterProgmode()
 void
 SMoHVSP::LeaveProgmode()
 {
-    SMoHWIF::HVSP::Stop();
+    if (!SMoSession::Hold(SMoSession::kHVSP))
+        Stop();
 
     SMoCommand::SendResponse();
 }
 
+void
+SMoHVSP::Stop()
+{
+    SMoHWIF::HVSP::Stop();
+}
+
 void
 SMoHVSP::ChipErase()
 {
@@ -88,13 +112,18 @@ SMoHVSP::ProgramFlash()
     const uint8_t   pollTimeout =   SMoCommand::gBody[4];
     const uint8_t * data        =  &SMoCommand::gBody[5];
 
+#ifdef SMO_PATCH
+    SMoPatch::Apply(true, SMoGeneral::gAddress, &SMoCommand::gBody[5], numBytes);
+#endif
+    SMoStats::Moved(SMoStats::kHVSP, numBytes);
+
     //
     // Enter Flash Programming Mode
     //
     SMoHWIF::HVSP::Transfer(0x4C, 0x10);
     bool timeout = false;
+    const uint32_t address = SMoGeneral::gAddress;
     if (mode & 1) { // Paged mode
-        uint32_t address = SMoGeneral::gAddress;
         for (; numBytes > 0; numBytes -= 2) {
             //
             // Load Flash Page Buffer
@@ -118,7 +147,6 @@ SMoHVSP::ProgramFlash()
             timeout = !HVSPPollWait(pollTimeout);
         }
     } else { // Word mode, ATtiny11/12
-        uint32_t address = SMoGeneral::gAddress;
         SMoHWIF::HVSP::Transfer(0x1C, address >> 8);
         for (; numBytes > 0; numBytes -= 2) {
             //
@@ -141,15 +169,13 @@ SMoHVSP::ProgramFlash()
     //
     SMoHWIF::HVSP::Transfer(0x4C, 0x00);
     if (!timeout)
-        SMoCommand::SendResponse();
+        SMoVerify::Respond(address, 5, true);
 }
 
 void
-SMoHVSP::ReadFlash()
+SMoHVSP::ReadFlashBlock(uint8_t * outData, int16_t numBytes)
 {
-    int16_t     numBytes    =  (SMoCommand::gBody[1] << 8) | SMoCommand::gBody[2];
-    uint8_t *   outData     =  &SMoCommand::gBody[2];
-    
+    SMoStats::Moved(SMoStats::kHVSP, numBytes);
     //
     // Flash Read
     //
@@ -171,6 +197,25 @@ SMoHVSP::ReadFlash()
         *outData++ = SMoHWIF::HVSP::Transfer(0x7C, 0x00);
         ++SMoGeneral::gAddress;
     }
+}
+
+void
+SMoHVSP::ReadFlash()
+{
+    int16_t     numBytes    =  (SMoCommand::gBody[1] << 8) | SMoCommand::gBody[2];
+    uint8_t *   outData     =  &SMoCommand::gBody[2];
+    
+#ifdef SMO_READ_AHEAD
+    uint16_t cached = SMoReadAhead::Fetch(outData, numBytes);
+    outData  += cached;
+    numBytes -= cached;
+#endif
+    ReadFlashBlock(outData, numBytes);
+    if (numBytes > 0)
+        outData += numBytes;
+#ifdef SMO_READ_AHEAD
+    SMoReadAhead::Arm(CMD_READ_FLASH_HVSP, outData-&SMoCommand::gBody[2], true);
+#endif
     *outData = STATUS_CMD_OK;
     SMoCommand::SendResponse(STATUS_CMD_OK, outData-&SMoCommand::gBody[0]);
 }
@@ -183,11 +228,17 @@ SMoHVSP::ProgramEEPROM()
     const uint8_t   pollTimeout =   SMoCommand::gBody[4];
     const uint8_t * data        =  &SMoCommand::gBody[5];
 
+#ifdef SMO_PATCH
+    SMoPatch::Apply(false, SMoGeneral::gAddress, &SMoCommand::gBody[5], numBytes);
+#endif
+    SMoStats::Moved(SMoStats::kHVSP, numBytes);
+
     //
     // Enter EEPROM Programming Mode
     //
     SMoHWIF::HVSP::Transfer(0x4C, 0x11);
     bool timeout = false;
+    const uint32_t address = SMoGeneral::gAddress;
     if (mode & 1) { // Paged mode
         for (; numBytes > 0; --numBytes) {
             //
@@ -227,15 +278,13 @@ SMoHVSP::ProgramEEPROM()
     //
     SMoHWIF::HVSP::Transfer(0x4C, 0x00);
     if (!timeout)
-        SMoCommand::SendResponse();    
+        SMoVerify::Respond(address, 5, false);
 }
 
 void
-SMoHVSP::ReadEEPROM()
+SMoHVSP::ReadEEPROMBlock(uint8_t * outData, int16_t numBytes)
 {
-    int16_t     numBytes    =  (SMoCommand::gBody[1] << 8) | SMoCommand::gBody[2];
-    uint8_t *   outData     =  &SMoCommand::gBody[2];
-    
+    SMoStats::Moved(SMoStats::kHVSP, numBytes);
     //
     // EEPROM Read
     //
@@ -250,6 +299,25 @@ SMoHVSP::ReadEEPROM()
         *outData++ = SMoHWIF::HVSP::Transfer(0x6C, 0x00);
         ++SMoGeneral::gAddress;
     }
+}
+
+void
+SMoHVSP::ReadEEPROM()
+{
+    int16_t     numBytes    =  (SMoCommand::gBody[1] << 8) | SMoCommand::gBody[2];
+    uint8_t *   outData     =  &SMoCommand::gBody[2];
+    
+#ifdef SMO_READ_AHEAD
+    uint16_t cached = SMoReadAhead::Fetch(outData, numBytes);
+    outData  += cached;
+    numBytes -= cached;
+#endif
+    ReadEEPROMBlock(outData, numBytes);
+    if (numBytes > 0)
+        outData += numBytes;
+#ifdef SMO_READ_AHEAD
+    SMoReadAhead::Arm(CMD_READ_EEPROM_HVSP, outData-&SMoCommand::gBody[2], false);
+#endif
     *outData = STATUS_CMD_OK;
     SMoCommand::SendResponse(STATUS_CMD_OK, outData-&SMoCommand::gBody[0]);
 }
@@ -264,6 +332,7 @@ ProgramFuseLock(uint8_t d0, uint8_t i2, uint8_t i3)
     SMoHWIF::HVSP::Transfer(0x2C, value);
     SMoHWIF::HVSP::Transfer(i2, 0x00);
     SMoHWIF::HVSP::Transfer(i3, 0x00);
+    SMoSession::Drop();
 
     if (HVSPPollWait(pollTimeout))
         SMoCommand::SendResponse();
@@ -313,15 +382,19 @@ SMoHVSP::ReadLock()
     ReadFuseLock(0x78, 0x6C);
 }
 
-static void
-ReadSignatureCal(uint8_t d1, uint8_t i2, uint8_t i3)
+static uint8_t
+ReadSignatureCalByte(uint8_t d1, uint8_t i2, uint8_t i3)
 {
-    uint8_t * dataOut   = &SMoCommand::gBody[2];
-
     SMoHWIF::HVSP::Transfer(0x4C, 0x08);
     SMoHWIF::HVSP::Transfer(0x0C, d1);
     SMoHWIF::HVSP::Transfer(i2, 0x00);
-    *dataOut = SMoHWIF::HVSP::Transfer(i3, 0x00);
+    return SMoHWIF::HVSP::Transfer(i3, 0x00);
+}
+
+static void
+ReadSignatureCal(uint8_t d1, uint8_t i2, uint8_t i3)
+{
+    SMoCommand::gBody[2] = ReadSignatureCalByte(d1, i2, i3);
 
     SMoCommand::SendResponse(STATUS_CMD_OK, 3);
 }
@@ -339,3 +412,16 @@ SMoHVSP::ReadOscCal()
 {
     ReadSignatureCal(0x00, 0x78, 0x7C);
 }
+
+void
+SMoHVSP::Signature(uint8_t * sig)
+{
+    for (uint8_t i=0; i<3; ++i)
+        sig[i] = ReadSignatureCalByte(i, 0x68, 0x6C);
+}
+
+uint8_t
+SMoHVSP::Transfer(uint8_t instr, uint8_t data)
+{
+    return SMoHWIF::HVSP::Transfer(instr, data);
+}
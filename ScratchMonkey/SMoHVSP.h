@@ -15,6 +15,8 @@
 #ifndef _SMO_HVSP_
 #define _SMO_HVSP_
 
+#include <inttypes.h>
+
 namespace SMoHVSP {
     void EnterProgmode();
     void LeaveProgmode();
@@ -29,6 +31,21 @@ namespace SMoHVSP {
     void ReadLock();
     void ReadSignature();
     void ReadOscCal();
+    //
+    // Read from SMoGeneral::gAddress without sending a response
+    //
+    void ReadFlashBlock(uint8_t * outData, int16_t numBytes);
+    void ReadEEPROMBlock(uint8_t * outData, int16_t numBytes);
+    //
+    // Single instruction / data transfer, returning the data output
+    //
+    uint8_t Transfer(uint8_t instr, uint8_t data);
+    //
+    // For SMoSession: End programming mode without a response, read the
+    // three signature bytes
+    //
+    void    Stop();
+    void    Signature(uint8_t * sig);
 } // namespace SMoHVSP
 
 #endif /* _SMO_HVSP_ */
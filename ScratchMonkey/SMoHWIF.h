@@ -15,12 +15,62 @@
 
 #include "Arduino.h"
 #include "stk_proto.h"
+#include <util/delay_basic.h>
 
-inline void SMoDelay50ns() {
-    __asm__ __volatile__("nop");
+#include "SMoTiming.h"
+
+//
+// Bit banged protocols wait for minimum times given in the datasheets.
+// SMoCycles() rounds such a time up to whole cycles of F_CPU, and
+// SMoDelayNs<ns>() burns exactly that many, so every protocol runs as fast
+// as it legally can on 8, 16 and 20MHz boards alike. Anything longer than
+// a few microseconds belongs in delayMicroseconds().
+//
+constexpr uint32_t
+SMoCycles(uint32_t ns)
+{
+    return (uint64_t(ns)*(F_CPU/1000L)+999999L)/1000000L;
+}
+
+template <uint32_t ns> inline void
+SMoDelayNs()
+{
+    static_assert(F_CPU % 1000L == 0, "F_CPU must be a whole number of kHz");
+    static_assert(SMoCycles(ns) < 256, "Delay too long for a cycle count, use delayMicroseconds()");
+    __builtin_avr_delay_cycles(SMoCycles(ns));
+}
+
+//
+// Delays adjustable at runtime (see SMoTiming.h) count steps of 3 cycles,
+// one turn of _delay_loop_1(). 0 means no delay at all.
+//
+constexpr uint8_t
+SMoSteps(uint32_t ns)
+{
+    return (SMoCycles(ns)+2)/3;
+}
+
+inline void
+SMoDelaySteps(uint8_t steps)
+{
+    if (steps)
+        _delay_loop_1(steps);
+}
+
+//
+// Untuned, wait twice the datasheet minimum ns exactly, otherwise the knob
+//
+template <uint32_t ns> inline void
+SMoDelayKnob(uint8_t knob)
+{
+    if (SMoTiming::gTuned)
+        SMoDelaySteps(SMoTiming::gDelay[knob]);
+    else
+        SMoDelayNs<2*ns>();
 }
 
 #include "SMoConfig.h"
+#include "SMoTrace.h"
 #include "SMoHWIF_Debug.h"
 #include "SMoHWIF_Status.h"
 #include "SMoHWIF_ISP.h"
@@ -28,19 +78,25 @@ inline void SMoDelay50ns() {
 #include "SMoHWIF_HVSP.h"
 #include "SMoHWIF_HVPP.h"
 #include "SMoHWIF_TPI.h"
+#include "SMoHWIF_Store.h"
+#include "SMoHWIF_Timer.h"
 
 //
 // We support a number of different pin layouts:
 //  - Standard Arduino (ATmega168/328)
 //  - Leonardo/Micro   (ATmega32u4)
 //  - Mega             (ATmega1280/2560)
+//  - Host             (native build against simulated targets, see Simulator/)
 //
 
 #define    SMO_LAYOUT_STANDARD     0
 #define    SMO_LAYOUT_LEONARDO     1
 #define    SMO_LAYOUT_MEGA         2
+#define    SMO_LAYOUT_HOST         3
 
-#if defined(__AVR_ATmega32U4__)
+#if defined(SMO_HOST)
+#define SMO_LAYOUT  SMO_LAYOUT_HOST
+#elif defined(__AVR_ATmega32U4__)
 #define SMO_LAYOUT  SMO_LAYOUT_LEONARDO
 #elif defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
 #define SMO_LAYOUT  SMO_LAYOUT_MEGA
@@ -54,13 +110,17 @@ inline void SMoDelay50ns() {
 #include "SMoHWIF_Standard.h"
 #elif SMO_LAYOUT==SMO_LAYOUT_LEONARDO
 #include "SMoHWIF_Leonardo.h"
+#elif SMO_LAYOUT==SMO_LAYOUT_HOST
+#include "SMoHWIF_Host.h"
 #else
 #include "SMoHWIF_Mega.h"
 #endif
 
 template <typename Debug_Platform, typename Status_Platform, 
     typename ISP_Platform, typename TPI_Platform,
-    typename HVSP_Platform, typename HVPP_Platform> 
+    typename HVSP_Platform, typename HVPP_Platform,
+    typename Store_Platform, typename Timer_Platform,
+    typename Sampler_Platform> 
 class SMoHWIF_Platform {
 public:
     typedef Debug_Platform  Debug;
@@ -69,6 +129,9 @@ public:
     typedef HVSP_Platform   HVSP;
     typedef HVPP_Platform   HVPP;
     typedef TPI_Platform    TPI;
+    typedef Store_Platform  Store;
+    typedef Timer_Platform  Timer;
+    typedef Sampler_Platform Sampler;
 };
 
 typedef SMoHWIF_Platform<
@@ -77,7 +140,10 @@ typedef SMoHWIF_Platform<
     SMoHWIF_ISP_Platform,
     SMoHWIF_TPI_Platform,
     SMoHWIF_HVSP_Platform,
-    SMoHWIF_HVPP_Platform
+    SMoHWIF_HVPP_Platform,
+    SMoHWIF_Store_Platform,
+    SMoHWIF_Timer_Platform,
+    SMoHWIF_Sampler_Platform
 >   SMoHWIF;
 
 #endif /* _SMO_HWIF_ */
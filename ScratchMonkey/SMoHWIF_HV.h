@@ -16,12 +16,68 @@
 enum HV_RESET_PIN {};
 enum HV_VCC_PIN {};
 
-template <HV_RESET_PIN HV_RESET, HV_VCC_PIN HV_VCC> class SMoHWIF_HV {
+//
+// Target VCC sensing. With the target's VCC fed through a divider into a
+// spare ADC input, power sequencing waits for the rail to actually discharge
+// or come up instead of sitting out the worst case.
+//
+class SMoHWIF_VCC_Unsensed {
+public:
+    enum { SENSED = false };
+    static void     Setup() {}
+    static void     Stop()  {}
+    static uint16_t Millivolts() { return 0; }
+};
+
+template <int AIN, uint8_t DIVIDER> class SMoHWIF_VCC_Sense {
+public:
+    enum { SENSED = true };
+    static void Setup() {
+        ADCSRA = 0x00;                          // Turn off comparator use of ADC MUX
+        ADMUX  = _BV(REFS1) | _BV(REFS0) | AIN; // 1.1V vs ADC pin
+        ADCSRB = 0x00;
+        ADCSRA = _BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+        delay(1);                               // Let 1.1V stabilize
+    }
+    static void Stop() {
+        ADCSRA = 0x00;                          // Turn off ADC
+    }
+    static uint16_t Millivolts() {
+        ADCSRA |= _BV(ADSC);
+        while (ADCSRA & _BV(ADSC))
+            ;
+        return (uint32_t(ADC) * 1100 * DIVIDER) >> 10;
+    }
+};
+
+template <HV_RESET_PIN HV_RESET, HV_VCC_PIN HV_VCC, 
+    typename VCC_Sense = SMoHWIF_VCC_Unsensed> class SMoHWIF_HV {
 public:
     enum {
         RESET = HV_RESET,
         VCC   = HV_VCC
     };
+    enum {                  // Rail thresholds in mV
+        kVCCOff =  250,     // Safely below power on reset
+        kVCCOn  = 4500      // Good enough for high voltage programming
+    };
+    //
+    // Wait for VCC to fall below kVCCOff or rise above kVCCOn, but no longer
+    // than maxDelay ms. Without a sense input, always wait maxDelay.
+    //
+    static void WaitVCC(bool on, uint16_t maxDelay) {
+        if (!VCC_Sense::SENSED) {
+            delay(maxDelay);
+            return;
+        }
+        VCC_Sense::Setup();
+        for (uint32_t start = millis(); millis()-start < maxDelay; ) {
+            uint16_t millivolts = VCC_Sense::Millivolts();
+            if (on ? millivolts >= kVCCOn : millivolts < kVCCOff)
+                break;
+        }
+        VCC_Sense::Stop();
+    }
 };
 
 #endif /* _SMO_HWIF_HV_ */
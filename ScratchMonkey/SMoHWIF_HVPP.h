@@ -40,10 +40,10 @@ public:
         digitalWrite(HVPP_XTAL, LOW);
         DataMode(OUTPUT);
         InitControlSignals();
-        Ready_Pin::Setup();
         SetControlSignals(initSignals);
     
-        delay(powOffDelay);
+        HV_Platform::WaitVCC(false, powOffDelay);
+        Ready_Pin::Setup();     // May share the ADC MUX with VCC sensing
         digitalWrite(HVPP_VCC, HIGH);
         delayMicroseconds(50);
         for (uint8_t i=0; i<latchCycles; ++i) {
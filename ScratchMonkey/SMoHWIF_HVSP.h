@@ -32,6 +32,9 @@ private:
         HVSP_RESET = HV_Platform::RESET,
         HVSP_VCC   = HV_Platform::VCC
     };
+    enum {                  // Minimum time in ns (tIVSH), tSHSL is adjustable
+        kSetup      =  50
+    };
 public:
     static void Setup(uint8_t powOffDelay, uint8_t syncCycles) {
         pinMode(HVSP_VCC, OUTPUT);
@@ -45,7 +48,7 @@ public:
         SMoDDR(PORT) |= mask;
         SMoPORT(PORT) = SMoPIN(PORT) & ~mask;
 
-        delay(powOffDelay);
+        HV_Platform::WaitVCC(false, powOffDelay);
         digitalWrite(HVSP_VCC, HIGH);
         delayMicroseconds(80);
         for (uint8_t i=0; i<syncCycles; ++i) {
@@ -67,6 +70,8 @@ public:
         SMoDDR(PORT) &= ~(_BV(HVSP_SDI) | _BV(HVSP_SII) | _BV(HVSP_SCI));
     }
     static uint8_t Transfer(uint8_t instrIn, uint8_t dataIn) {
+        const uint8_t instr = instrIn;
+        const uint8_t data  = dataIn;
     #ifdef DEBUG_HVSP
         SMoDebug.print("Byte ");
         SMoDebug.print(instrIn, HEX);
@@ -101,6 +106,7 @@ public:
         SMoDebug.print(" -> ");
         SMoDebug.println(dataOut, HEX);
     #endif
+        SMoTrace::Log(SMoTrace::kHVSP, instr, data, dataOut);
         return dataOut;
     }
     static bool GetReady() {
@@ -110,10 +116,9 @@ private:
     static bool HVSPBit(bool instrInBit, bool dataInBit) {
         SMoPORT(PORT) = (SMoPIN(PORT) & ~(_BV(HVSP_SII)|_BV(HVSP_SDI)|_BV(HVSP_SCI)|_BV(HVSP_SDO))) 
             | (dataInBit << HVSP_SDI) | (instrInBit << HVSP_SII);
-        SMoDelay50ns(); // Enforce setup time for SCI
+        SMoDelayNs<kSetup>();       // Enforce setup time for SCI
         SMoPIN(PORT) = _BV(HVSP_SCI);
-        SMoDelay50ns(); // Enforce setup time for SDO
-        SMoDelay50ns(); // Enforce SCI high time
+        SMoDelayKnob<SMoTiming::kHVSPMinNs>(SMoTiming::kHVSP); // SCI high time, covers SDO valid
         bool dataOutBit = (SMoPIN(PORT) & _BV(HVSP_SDO)) != 0;
         SMoPIN(PORT) = _BV(HVSP_SCI);
 
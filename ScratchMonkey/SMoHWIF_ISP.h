@@ -51,9 +51,13 @@ public:
         pinMode(SCK, OUTPUT);
         pinMode(MISO, INPUT);
     }
+    static bool     UsingHardwareSPI() {
+        return sUsingHardwareSPI;
+    }
     static bool     SlowdownSoftwareSPI() {
         if (++sSoftwareSPIDelay >= 8)
             return false;
+        SMoTrace::Log(SMoTrace::kSPISlow, sSoftwareSPIDelay);
 #ifdef DEBUG_ISP
         SMoDebug.print("Retrying in limp mode ");
         SMoDebug.print(sSoftwareSPIDelay);
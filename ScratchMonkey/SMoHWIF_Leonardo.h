@@ -13,6 +13,22 @@
 #ifndef _SMO_HWIF_LEONARDO_
 #define _SMO_HWIF_LEONARDO_
 
+//
+// Command Buffer Size
+//
+// The STK500 hardware limit, one 256 byte page plus headers
+//
+const uint16_t SMoHWIF_MaxBodySize = 275;
+
+//
+// Host Link
+//
+// The 32u4 talks USB itself, without a UART bridge, so the baud rate is
+// meaningless. Frames are read from and written to the CDC endpoints in
+// whole 64 byte packets (see SMoCommand.cpp).
+//
+#define SMO_USB_CDC
+
 //
 // Debug Pin Assignment
 //
@@ -122,4 +138,23 @@ typedef SMoHWIF_HVPP<SMoHWIF_HV_Platform,
             SMoHWIF_HVPP_Control, SMoHWIF_HVPP_Data,
             SMoHWIF_HVPP_Ready>                             SMoHWIF_HVPP_Platform;
 
+//
+// No room for a standalone image store
+//
+typedef SMoHWIF_Store_None                                  SMoHWIF_Store_Platform;
+
+//
+// Statistics Timer (see SMoStats.h): Timer3, registers at 0x90, 0x71, 0x38
+//
+typedef SMoHWIF_Timer_16<0x90, 0x71, 0x38>                  SMoHWIF_Timer_Platform;
+#define SMoHWIF_TIMER_OVF_vect  TIMER3_OVF_vect
+
+//
+// Capture Sampler (see SMoCapture.h): Compare match A of Timer3, registers
+// at 0x90, 0x94, 0x98, 0x71, 0x38. The 32u4 has no Timer2, so this shares
+// the statistics timer, which runs in the same mode.
+//
+typedef SMoHWIF_Sampler<0x90, 0x94, 0x98, 0x71, 0x38, true> SMoHWIF_Sampler_Platform;
+#define SMoHWIF_SAMPLER_vect    TIMER3_COMPA_vect
+
 #endif /* _SMO_HWIF_LEONARDO_ */
@@ -13,6 +13,14 @@
 #ifndef _SMO_HWIF_MEGA_
 #define _SMO_HWIF_MEGA_
 
+//
+// Command Buffer Size
+//
+// With 8K of SRAM, we can afford multi-page frames of 4K plus headers
+// (See PARAM2_SCRATCHMONKEY_MAX_BODY)
+//
+const uint16_t SMoHWIF_MaxBodySize = 4096+10;
+
 //
 // Debug Pin Assignment
 //
@@ -61,6 +69,7 @@ typedef SMoHWIF_ISP<ISP_RESET_PIN(SS), ISP_CLOCK_PIN(11)>   SMoHWIF_ISP_Platform
 //
 typedef SMoHWIF_HV<HV_RESET_PIN(10), HV_VCC_PIN(11)>        SMoHWIF_HV_Platform;
 
+const int   SMoHWIF_PORT_A  = 0x00;
 const int   SMoHWIF_PORT_F  = 0x0F;
 const int   SMoHWIF_PORT_H  = 0xE0;
 const int   SMoHWIF_PORT_K  = 0xE6;
@@ -121,5 +130,34 @@ typedef SMoHWIF_HVPP<SMoHWIF_HV_Platform,
             SMoHWIF_HVPP_Control, SMoHWIF_HVPP_Data,
             SMoHWIF_HVPP_Ready>                             SMoHWIF_HVPP_Platform;
 
+//
+// Standalone Image Store Pin Assignment (SPI flash, see SMoStore.h)
+//
+//      Signal      Pin         Comment
+//      CS          22
+//      SCK         23
+//      MOSI        24          To DI of flash chip
+//      MISO        25          From DO of flash chip
+//      START       26          Button / target detect switch to GND
+//
+#define SMO_STANDALONE
+
+typedef SMoHWIF_Store_SPIFlash<SMoHWIF_PORT_A,
+            STORE_CS_BIT(0), STORE_SCK_BIT(1), STORE_MOSI_BIT(2),
+            STORE_MISO_BIT(3), STORE_START_BIT(4)>          SMoHWIF_Store_Platform;
+
+//
+// Statistics Timer (see SMoStats.h): Timer5, registers at 0x120, 0x73, 0x3A
+//
+typedef SMoHWIF_Timer_16<0x120, 0x73, 0x3A>                 SMoHWIF_Timer_Platform;
+#define SMoHWIF_TIMER_OVF_vect  TIMER5_OVF_vect
+
+//
+// Capture Sampler (see SMoCapture.h): Timer2, registers at 0xB0, 0xB2, 0xB3,
+// 0x70, 0x37
+//
+typedef SMoHWIF_Sampler<0xB0, 0xB2, 0xB3, 0x70, 0x37, false> SMoHWIF_Sampler_Platform;
+#define SMoHWIF_SAMPLER_vect    TIMER2_COMPA_vect
+
 #endif /* _SMO_HWIF_MEGA_ */
 
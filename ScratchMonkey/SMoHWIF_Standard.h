@@ -13,6 +13,13 @@
 #ifndef _SMO_HWIF_STANDARD_
 #define _SMO_HWIF_STANDARD_
 
+//
+// Command Buffer Size
+//
+// The STK500 hardware limit, one 256 byte page plus headers
+//
+const uint16_t SMoHWIF_MaxBodySize = 275;
+
 //
 // Debug Pin Assignment
 //
@@ -56,8 +63,15 @@ typedef SMoHWIF_ISP<ISP_RESET_PIN(SS), ISP_CLOCK_PIN(9)>    SMoHWIF_ISP_Platform
 //
 //      HVRESET     10
 //      SVCC        11
+//      VSENSE      A6          Arduino Pro Mini etc (SMD MCU) with SMO_VCC_SENSE.
+//                              Target VCC through a 40k/10k divider.
 //
+#if NUM_ANALOG_INPUTS==8 && defined(SMO_VCC_SENSE)
+typedef SMoHWIF_HV<HV_RESET_PIN(10), HV_VCC_PIN(11),
+            SMoHWIF_VCC_Sense<6, 5> >                       SMoHWIF_HV_Platform;
+#else
 typedef SMoHWIF_HV<HV_RESET_PIN(10), HV_VCC_PIN(11)>        SMoHWIF_HV_Platform;
+#endif
 
 const int   SMoHWIF_PORT_B  = 0x03;
 const int   SMoHWIF_PORT_C  = 0x06;
@@ -141,4 +155,22 @@ typedef SMoHWIF_HVPP<SMoHWIF_HV_Platform,
             SMoHWIF_HVPP_Control, SMoHWIF_HVPP_Data,
             SMoHWIF_HVPP_Ready>                             SMoHWIF_HVPP_Platform;
 
+//
+// No room for a standalone image store
+//
+typedef SMoHWIF_Store_None                                  SMoHWIF_Store_Platform;
+
+//
+// Statistics Timer (see SMoStats.h): Timer1 is taken by the ISP clock,
+// Timer2 is too narrow to be worth the interrupt load.
+//
+typedef SMoHWIF_Timer_Micros                                SMoHWIF_Timer_Platform;
+
+//
+// Capture Sampler (see SMoCapture.h): Timer2, registers at 0xB0, 0xB2, 0xB3,
+// 0x70, 0x37. Nothing else uses it once analogWrite() is out of the picture.
+//
+typedef SMoHWIF_Sampler<0xB0, 0xB2, 0xB3, 0x70, 0x37, false> SMoHWIF_Sampler_Platform;
+#define SMoHWIF_SAMPLER_vect    TIMER2_COMPA_vect
+
 #endif /* _SMO_HWIF_STANDARD_ */
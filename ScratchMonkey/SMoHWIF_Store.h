@@ -0,0 +1,150 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoHWIF_Store.h    - Programmer hardware interface for standalone image store
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#ifndef _SMO_HWIF_STORE_
+#define _SMO_HWIF_STORE_
+
+#include "SMoHWIF_Port.h"
+
+enum STORE_CS_BIT {};
+enum STORE_SCK_BIT {};
+enum STORE_MOSI_BIT {};
+enum STORE_MISO_BIT {};
+enum STORE_START_BIT {};
+
+//
+// Layouts without a store
+//
+class SMoHWIF_Store_None {
+public:
+    static void Setup() {}
+    static bool StartRequested() { return false; }
+};
+
+//
+// 25 series SPI flash (W25Qxx, AT25DF, ...) bit banged on a port we don't
+// use otherwise, since the hardware SPI pins are connected to the target.
+// A button or target detect switch to ground on START starts a run.
+//
+template <int PORT,
+    STORE_CS_BIT    STORE_CS,
+    STORE_SCK_BIT   STORE_SCK,
+    STORE_MOSI_BIT  STORE_MOSI,
+    STORE_MISO_BIT  STORE_MISO,
+    STORE_START_BIT STORE_START> class SMoHWIF_Store_SPIFlash {
+private:
+    enum {
+        kWriteEnable    = 0x06,
+        kReadStatus     = 0x05,
+        kPageProgram    = 0x02,
+        kSectorErase    = 0x20,
+        kReadData       = 0x03,
+        kBusy           = 0x01
+    };
+    static uint8_t sStartState;
+    static uint32_t sStartTime;
+
+    static uint8_t Transfer(uint8_t dataOut) {
+        uint8_t dataIn = 0;
+        for (uint8_t bit = 0x80; bit; bit >>= 1) {
+            if (dataOut & bit)
+                SMoPORT(PORT) |= _BV(STORE_MOSI);
+            else
+                SMoPORT(PORT) &= ~_BV(STORE_MOSI);
+            SMoPORT(PORT) |= _BV(STORE_SCK);
+            if (SMoPIN(PORT) & _BV(STORE_MISO))
+                dataIn |= bit;
+            SMoPORT(PORT) &= ~_BV(STORE_SCK);
+        }
+        return dataIn;
+    }
+    static void Select() {
+        SMoPORT(PORT) &= ~_BV(STORE_CS);
+    }
+    static void Deselect() {
+        SMoPORT(PORT) |= _BV(STORE_CS);
+    }
+    static void Command(uint8_t command, uint32_t address) {
+        Select();
+        Transfer(command);
+        Transfer(address >> 16);
+        Transfer(address >> 8);
+        Transfer(address);
+    }
+    static void WriteEnable() {
+        Select();
+        Transfer(kWriteEnable);
+        Deselect();
+    }
+    static void WaitReady() {
+        Select();
+        Transfer(kReadStatus);
+        while (Transfer(0) & kBusy)
+            ;
+        Deselect();
+    }
+public:
+    enum {
+        kPageSize   = 256,
+        kSectorSize = 4096
+    };
+    static void Setup() {
+        SMoPORT(PORT) |= _BV(STORE_CS) | _BV(STORE_START) | _BV(STORE_MISO);
+        SMoDDR(PORT)  |= _BV(STORE_CS) | _BV(STORE_SCK) | _BV(STORE_MOSI);
+        SMoDDR(PORT)  &= ~(_BV(STORE_MISO) | _BV(STORE_START));
+        sStartState    = _BV(STORE_START);
+    }
+    static void Read(uint32_t address, uint8_t * data, uint16_t numBytes) {
+        Command(kReadData, address);
+        while (numBytes--)
+            *data++ = Transfer(0);
+        Deselect();
+    }
+    static void EraseSector(uint32_t address) {
+        WriteEnable();
+        Command(kSectorErase, address);
+        Deselect();
+        WaitReady();
+    }
+    //
+    // Data must not cross a page boundary
+    //
+    static void WritePage(uint32_t address, const uint8_t * data, uint16_t numBytes) {
+        WriteEnable();
+        Command(kPageProgram, address);
+        while (numBytes--)
+            Transfer(*data++);
+        Deselect();
+        WaitReady();
+    }
+    //
+    // Debounced falling edge on START
+    //
+    static bool StartRequested() {
+        uint8_t state = SMoPIN(PORT) & _BV(STORE_START);
+        if (state == sStartState) {
+            sStartTime = millis();
+            return false;
+        } else if (millis() - sStartTime < 20) {
+            return false;
+        }
+        sStartState = state;
+        return !state;
+    }
+};
+
+template <int PORT, STORE_CS_BIT STORE_CS, STORE_SCK_BIT STORE_SCK, STORE_MOSI_BIT STORE_MOSI,
+    STORE_MISO_BIT STORE_MISO, STORE_START_BIT STORE_START>
+uint8_t SMoHWIF_Store_SPIFlash<PORT, STORE_CS, STORE_SCK, STORE_MOSI, STORE_MISO, STORE_START>::sStartState;
+template <int PORT, STORE_CS_BIT STORE_CS, STORE_SCK_BIT STORE_SCK, STORE_MOSI_BIT STORE_MOSI,
+    STORE_MISO_BIT STORE_MISO, STORE_START_BIT STORE_START>
+uint32_t SMoHWIF_Store_SPIFlash<PORT, STORE_CS, STORE_SCK, STORE_MOSI, STORE_MISO, STORE_START>::sStartTime;
+
+#endif /* _SMO_HWIF_STORE_ */
@@ -28,11 +28,14 @@ private:
         TPI_RESET = HV_Platform::RESET,
         TPI_SVCC  = HV_Platform::VCC
     };
+    enum {                  // Minimum time in ns, clock pulse widths are adjustable
+        kSetup      =  50
+    };
 public:
     static void Setup() {
         pinMode(TPI_SVCC, OUTPUT);
         digitalWrite(TPI_SVCC, LOW);
-        delay(150);
+        HV_Platform::WaitVCC(false, 150);
         pinMode(TPI_RESET, OUTPUT);
         SMoDDR(PORT)  |= _BV(TPI_DATA) | _BV(TPI_CLK);
         SMoPORT(PORT) &= ~_BV(TPI_DATA);
@@ -42,7 +45,7 @@ public:
 
         // Turn on supply voltage
         digitalWrite(TPI_SVCC, HIGH);
-        delay(150);
+        HV_Platform::WaitVCC(true, 150);
     
         // Reset
         digitalWrite(TPI_RESET, LOW);
@@ -65,6 +68,7 @@ public:
         SMoDebug.print("TPI W ");
         SMoDebug.println((uint8_t)byte, HEX);
     #endif
+        SMoTrace::Log(SMoTrace::kTPIOut, byte);
 
         SMoDDR(PORT) |= _BV(TPI_DATA);
 
@@ -124,35 +128,30 @@ public:
                 SMoDebug.print((uint8_t)byte, HEX);
                 SMoDebug.println(parity?"":"!");
     #endif
+                SMoTrace::Log(SMoTrace::kTPIIn, byte, t, !parity);
                 return parity ? byte : -1;
            }
     #ifdef DEBUG_TPI
         SMoDebug.println("TPI R ?");
     #endif
+        SMoTrace::Log(SMoTrace::kTPIIn, 0, 256, 2);
         return -1;
     }
 private:
     static void SendBit(bool bit) {
         SMoPORT(PORT) = (SMoPIN(PORT) & ~(_BV(TPI_DATA)|_BV(TPI_CLK))) | (bit << TPI_DATA);
-        SMoDelay50ns(); // Respect setup time for TPI_CLK
+        SMoDelayNs<kSetup>();       // Respect setup time for TPI_CLK
         SMoPIN(PORT) = _BV(TPI_CLK);
-        SMoDelay50ns(); // Clock high pulse width >= 200ns
-        SMoDelay50ns();
-        SMoDelay50ns();
-        SMoDelay50ns();
+        SMoDelayKnob<SMoTiming::kTPIMinNs>(SMoTiming::kTPI);  // Clock high pulse width
         SMoPIN(PORT) = _BV(TPI_CLK);
     }
     static bool ReadBit()
     {
         SMoPORT(PORT) |= _BV(TPI_CLK);
-        SMoDelay50ns(); // Clock high pulse width >= 200ns
-        SMoDelay50ns();
-        SMoDelay50ns();
-        SMoDelay50ns();
+        SMoDelayKnob<SMoTiming::kTPIMinNs>(SMoTiming::kTPI);  // Clock high pulse width
         bool bit = (SMoPIN(PORT) & _BV(TPI_DATA)) != 0;
         SMoPORT(PORT) &= ~_BV(TPI_CLK);
-        SMoDelay50ns();
-        SMoDelay50ns();
+        SMoDelayKnob<SMoTiming::kTPIMinNs>(SMoTiming::kTPI);  // Clock low pulse width
 
         return bit;
     }
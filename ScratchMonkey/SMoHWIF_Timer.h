@@ -0,0 +1,124 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoHWIF_Timer.h    - Programmer hardware interface for timing measurements
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#ifndef _SMO_HWIF_TIMER_
+#define _SMO_HWIF_TIMER_
+
+//
+// Layouts without a spare timer (Timer1 generates the ISP clock) fall back
+// on micros(). Ticks are 1us, although micros() only advances in steps of
+// 4us on 16MHz boards (8us at 8MHz).
+//
+class SMoHWIF_Timer_Micros {
+public:
+    enum { kTickNs = 1000 };
+
+    static void Setup() {}
+    static void Overflow() {}
+    static uint32_t Now() { return micros(); }
+};
+
+//
+// A 16 bit timer counting at F_CPU/8, extended to 32 bits by its overflow
+// interrupt, which has to be routed to Overflow() (see ScratchMonkey.ino). As
+// with ports, we pass the register addresses: TCCR is the address of
+// TCCRnA, TIMSK and TIFR those of TIMSKn and TIFRn.
+//
+template <int TCCR, int TIMSK, int TIFR> class SMoHWIF_Timer_16 {
+private:
+    static volatile uint16_t sOverflows;
+public:
+    enum { kTickNs = 8000/(F_CPU/1000000L) };
+
+    static void Setup() {
+        _SFR_MEM8(TCCR)     = 0;                // Normal mode
+        _SFR_MEM8(TCCR+1)   = _BV(1);           // Prescale by 8
+        _SFR_MEM16(TCCR+4)  = 0;
+        _SFR_MEM8(TIFR)     = _BV(0);           // Clear TOVn
+        _SFR_MEM8(TIMSK)   |= _BV(0);           // Enable TOIEn
+    }
+    static void Overflow() {
+        ++sOverflows;
+    }
+    static uint32_t Now() {
+        uint8_t  sreg   = SREG;
+        cli();
+        uint16_t low    = _SFR_MEM16(TCCR+4);
+        uint16_t high   = sOverflows;
+        //
+        // Overflow pending, but not yet serviced
+        //
+        if ((_SFR_MEM8(TIFR) & _BV(0)) && low < 0x8000)
+            ++high;
+        SREG = sreg;
+        return (uint32_t(high) << 16) | low;
+    }
+};
+
+template <int TCCR, int TIMSK, int TIFR>
+volatile uint16_t SMoHWIF_Timer_16<TCCR, TIMSK, TIFR>::sOverflows;
+
+//
+// Layouts without a timer to spare for signal capture (see SMoCapture.h)
+//
+class SMoHWIF_Sampler_None {
+public:
+    enum { kTickNs = 0 };
+
+    static bool Start(uint8_t) { return false; }
+    static void Next() {}
+    static void Stop() {}
+};
+
+//
+// Compare match A interrupt of a timer counting at F_CPU/8, which has to be
+// routed to SMoCapture::Sample() (see ScratchMonkey.ino). The timer runs
+// freely and each match schedules the next one interval ticks later, so the
+// sample clock does not drift with interrupt latency, and a 16 bit timer
+// can be shared with SMoHWIF_Timer_16. TCCR is the address of TCCRnA, TCNT
+// that of TCNTn, OCR that of OCRnA, TIMSK and TIFR those of TIMSKn and TIFRn.
+//
+template <int TCCR, int TCNT, int OCR, int TIMSK, int TIFR, bool WIDE> 
+class SMoHWIF_Sampler {
+private:
+    static uint8_t sInterval;
+public:
+    enum { kTickNs = 8000/(F_CPU/1000000L) };
+
+    static bool Start(uint8_t interval) {
+        sInterval = interval;
+        uint8_t  sreg   = SREG;
+        cli();
+        _SFR_MEM8(TCCR)     = 0;                // Normal mode
+        _SFR_MEM8(TCCR+1)   = _BV(1);           // Prescale by 8
+        if (WIDE)
+            _SFR_MEM16(OCR) = _SFR_MEM16(TCNT)+interval;
+        else
+            _SFR_MEM8(OCR)  = _SFR_MEM8(TCNT)+interval;
+        _SFR_MEM8(TIFR)     = _BV(1);           // Clear OCFnA
+        _SFR_MEM8(TIMSK)   |= _BV(1);           // Enable OCIEnA
+        SREG = sreg;
+        return true;
+    }
+    static void Next() {
+        if (WIDE)
+            _SFR_MEM16(OCR) += sInterval;
+        else
+            _SFR_MEM8(OCR)  += sInterval;
+    }
+    static void Stop() {
+        _SFR_MEM8(TIMSK)   &= ~_BV(1);
+    }
+};
+
+template <int TCCR, int TCNT, int OCR, int TIMSK, int TIFR, bool WIDE>
+uint8_t SMoHWIF_Sampler<TCCR, TCNT, OCR, TIMSK, TIFR, WIDE>::sInterval;
+
+#endif /* _SMO_HWIF_TIMER_ */
@@ -0,0 +1,130 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoHelper.cpp      - Two stage ISP programming through a helper on the target
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#include "SMoHelper.h"
+#include "SMoCommand.h"
+#include "SMoGeneral.h"
+#include "SMoPatch.h"
+#include "SMoStats.h"
+#include "SMoVerify.h"
+
+#include "SMoHWIF.h"
+
+#ifdef SMO_HELPER
+
+bool    SMoHelper::gActive;
+
+enum {
+    kStartTimeout   = 200,  // ms, for the target's start-up delay
+    kPollTimeout    = 100,
+    kEraseDelay     = 10,
+    kMaxLoad        = 254   // Bytes per kLoad
+};
+
+static bool
+PollReady(uint16_t timeout)
+{
+    uint32_t start = millis();
+    do {
+        if (SMoHWIF::ISP::Transfer(0) == SMoHelper::kReady)
+            return true;
+    } while (millis()-start < timeout);
+
+    return false;
+}
+
+static void
+SendAddress(uint8_t command, uint32_t address)
+{
+    SMoHWIF::ISP::Transfer(command);
+    SMoHWIF::ISP::Transfer(address & 0xFF);
+    SMoHWIF::ISP::Transfer((address >> 8) & 0xFF);
+}
+
+void
+SMoHelper::ProgramFlash()
+{
+    uint16_t        numBytes    =  ((SMoCommand::gBody[1]<<8)|SMoCommand::gBody[2]) & ~1;
+    const uint8_t   mode        =   SMoCommand::gBody[3];
+    const uint8_t * data        =  &SMoCommand::gBody[10];
+    const uint32_t  address     =  (SMoGeneral::gAddress & 0x7FFFFF) << 1;
+    uint32_t        load        =   address;
+
+#ifdef SMO_PATCH
+    SMoPatch::Apply(true, SMoGeneral::gAddress, &SMoCommand::gBody[10], numBytes);
+#endif
+    SMoStats::Moved(SMoStats::kISP, numBytes);
+    SMoGeneral::gAddress += numBytes >> 1;
+    while (numBytes) {
+        uint8_t chunk = numBytes < kMaxLoad ? numBytes : kMaxLoad;
+        SendAddress(kLoad, load);
+        SMoHWIF::ISP::Transfer(chunk >> 1);
+        for (uint8_t i=0; i<chunk; ++i)
+            SMoHWIF::ISP::Transfer(*data++);
+        load     += chunk;
+        numBytes -= chunk;
+    }
+    if ((mode & 0x81) == 0x81) {
+        SendAddress(kWrite, address);
+        SMoHWIF::ISP::Transfer(address >> 16);
+        uint32_t start = SMoStats::Now();
+        if (!PollReady(kPollTimeout)) {
+            SMoCommand::SendResponse(STATUS_RDY_BSY_TOUT);
+            return;
+        }
+        SMoStats::Polled(start, 1);
+    }
+    SMoCommand::SendResponse();
+}
+
+void
+SMoHelper::Command()
+{
+    const uint32_t address  = (uint32_t(SMoCommand::gBody[2]) << 24)
+                            | (uint32_t(SMoCommand::gBody[3]) << 16)
+                            | (uint32_t(SMoCommand::gBody[4]) <<  8)
+                            |  SMoCommand::gBody[5];
+
+    switch (SMoCommand::gBody[1]) {
+    case SCRATCHMONKEY_HELPER_START:
+#ifdef SMO_VERIFY
+        //
+        // The helper can't read pages back
+        //
+        if (SMoVerify::gEnabled) {
+            SMoCommand::SendResponse(STATUS_CMD_FAILED);
+            break;
+        }
+#endif
+        digitalWrite(SMoHWIF::ISP::RESET, HIGH);
+        gActive = PollReady(kStartTimeout);
+        SMoCommand::SendResponse(gActive ? STATUS_CMD_OK : STATUS_CMD_FAILED);
+        break;
+    case SCRATCHMONKEY_HELPER_FINISH:
+        if (gActive && address != 0xFFFFFFFF) {
+            //
+            // The helper erases the page it runs from, so it can't report
+            // back when it's done
+            //
+            SendAddress(kErase, address);
+            SMoHWIF::ISP::Transfer(address >> 16);
+            delay(kEraseDelay);
+        }
+        digitalWrite(SMoHWIF::ISP::RESET, LOW);
+        gActive = false;
+        SMoCommand::SendResponse();
+        break;
+    default:
+        SMoCommand::SendResponse(STATUS_CMD_FAILED);
+        break;
+    }
+}
+
+#endif /* SMO_HELPER */
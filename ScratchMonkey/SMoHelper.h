@@ -0,0 +1,65 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoHelper.h        - Two stage ISP programming through a helper on the target
+//
+// ISP shifts 4 bytes for every byte of flash, which makes it slow for the
+// large ATmegas. With SMO_HELPER defined (see SMoConfig.h), the host can
+// instead use ISP to load a small helper into the start of the target's
+// smallest boot section (Tools/smoprog --helper) and program BOOTRST. The
+// programmer then releases RESET, and the helper listens on the ISP lines as
+// an SPI slave and writes the pages it is sent with SPM: 1 byte per byte
+// of flash, at the same SCK rate, which for the slave is limited to fclk/4
+// just the same. The target's /SS pin has to be tied low for that, since
+// the ISP header does not carry it.
+//
+// CMD_SCRATCHMONKEY_HELPER
+//   [1]      SCRATCHMONKEY_HELPER_START
+//              Target in ISP programming mode, with the helper in place and
+//              BOOTRST programmed. Releases RESET and waits for the helper
+//              to report ready. From then on, CMD_PROGRAM_FLASH_ISP (also
+//              through SMoRegion, SMoStore and SMoScript) goes to the
+//              helper, while all other ISP commands are meaningless.
+//              The helper can't read back, so this fails with
+//              PARAM_SCRATCHMONKEY_VERIFY set, and setting that fails
+//              while the helper is running.
+//            SCRATCHMONKEY_HELPER_FINISH: [2..5] byte address of the helper
+//              page, or 0xFFFFFFFF to keep the helper. Has the helper erase
+//              its own page, which leaves it running off into erased flash,
+//              then holds the target in reset. The host has to enter ISP
+//              programming mode again for anything else.
+//
+// The helper reads commands with their arguments, and in between keeps
+// kReady in SPDR for the programmer to poll with 0 bytes:
+//
+//   kLoad  Z(2) n data(2n)     Fill the page buffer from the word at Z on
+//   kWrite Z(2) RAMPZ          Write the page buffer to the page at Z
+//   kErase Z(2) RAMPZ          Erase the page at Z
+//
+// While writing or erasing, it answers polls with 0.
+//
+
+#ifndef _SMO_HELPER_
+#define _SMO_HELPER_
+
+#include <inttypes.h>
+
+#include "SMoConfig.h"
+
+namespace SMoHelper {
+    enum {
+        kLoad   = 0x4C,
+        kWrite  = 0x57,
+        kErase  = 0x45,
+        kReady  = 0xA5
+    };
+#ifdef SMO_HELPER
+    extern bool gActive;    // CMD_PROGRAM_FLASH_ISP goes to the helper
+
+    void    Command();
+    void    ProgramFlash();
+#endif
+} // namespace SMoHelper
+
+#endif /* _SMO_HELPER_ */
@@ -16,6 +16,13 @@
 #include "SMoGeneral.h"
 #include "SMoCommand.h"
 #include "SMoConfig.h"
+#include "SMoReadAhead.h"
+#include "SMoPatch.h"
+#include "SMoStats.h"
+#include "SMoSession.h"
+#include "SMoVerify.h"
+#include "SMoDevice.h"
+#include "SMoHelper.h"
 #ifdef DEBUG_ISP
 #include "SMoDebug.h"
 #endif
@@ -27,7 +34,7 @@ const int ISP_RESET = SMoHWIF::ISP::RESET;
 static uint8_t 
 SPITransaction(const uint8_t * sendData, int8_t responseIndex = 3)
 {
-    uint8_t response;
+    uint8_t response = 0;
 
 #ifdef DEBUG_ISP
     SMoDebug.print("SPI ");
@@ -45,6 +52,8 @@ SPITransaction(const uint8_t * sendData, int8_t responseIndex = 3)
         if (ix == responseIndex)
             response = recv;
     }
+    sendData -= 4;
+    SMoTrace::Log(SMoTrace::kSPI, sendData[0], (sendData[1] << 8) | sendData[2], (sendData[3] << 8) | response);
 #ifdef DEBUG_ISP
     SMoDebug.println();
 #endif
@@ -67,16 +76,15 @@ SPITransaction(uint8_t b1, uint8_t b2, uint8_t b3, uint8_t b4)
     SMoHWIF::ISP::Transfer(b1);
     SMoHWIF::ISP::Transfer(b2);
     SMoHWIF::ISP::Transfer(b3);
-#ifdef DEBUG_ISP
     uint8_t result = SMoHWIF::ISP::Transfer(b4);
+#ifdef DEBUG_ISP
     SMoDebug.print(" [");
     SMoDebug.print(result, HEX);
     SMoDebug.println("]");
-  
-    return result;  
-#else
-    return SMoHWIF::ISP::Transfer(b4);
 #endif
+    SMoTrace::Log(SMoTrace::kSPI, b1, (b2 << 8) | b3, (b4 << 8) | result);
+  
+    return result;
 }
 
 static uint8_t
@@ -90,12 +98,21 @@ ISPPollReady()
 {
     uint32_t timeout = millis()+100;
     uint32_t now;
+    uint32_t start   = SMoStats::Now();
+    uint16_t polls   = 0;
     do {
-        if (SPITransaction(0xF0, 0, 0, 0))
+        ++polls;
+        //
+        // Poll RDY/BSY: Bit 0 of the last byte is set while the chip is busy
+        //
+        if (!(SPITransaction(0xF0, 0, 0, 0) & 1)) {
+            SMoStats::Polled(start, polls);
             return true;
+        }
         now = millis();
     } while ((timeout < 100 && now & 0x800000) || now < timeout);
 
+    SMoStats::Polled(start, polls);
     SMoCommand::SendResponse(STATUS_RDY_BSY_TOUT);
 
     return false;
@@ -136,6 +153,13 @@ SMoISP::EnterProgmode()
     const uint8_t   pollIndex   =   SMoCommand::gBody[7];
     const uint8_t * command     =  &SMoCommand::gBody[8];
 
+#ifdef SMO_HELPER
+    SMoHelper::gActive = false;
+#endif
+    if (SMoSession::Resume(SMoSession::kISP)) {
+        SMoCommand::SendResponse();
+        return;
+    }
     pinMode(ISP_RESET,      OUTPUT);
 
     SMoHWIF::ISP::SetupHardwareSPI();
@@ -167,16 +191,34 @@ SMoISP::EnterProgmode()
             response     = SPITransaction(command, pollIndex-1);
         } 
     }
+    if (response == pollValue) {
+        SMoSession::Entered(SMoSession::kISP);
+        SMoDevice::Identify(SMoSession::kISP);
+    }
     SMoCommand::SendResponse(response==pollValue ? STATUS_CMD_OK : STATUS_CMD_FAILED);
 }
 
 void
 SMoISP::LeaveProgmode()
+{
+    if (!SMoSession::Hold(SMoSession::kISP))
+        Stop();
+    SMoCommand::SendResponse();
+}
+
+void
+SMoISP::Stop()
 {
     SMoHWIF::ISP::StopClock();
     SMoHWIF::ISP::StopSPI();
     digitalWrite(ISP_RESET, HIGH);
-    SMoCommand::SendResponse();
+}
+
+void
+SMoISP::Signature(uint8_t * sig)
+{
+    for (uint8_t i=0; i<3; ++i)
+        sig[i] = SPITransaction(0x30, 0x00, i, 0x00);
 }
 
 void
@@ -208,14 +250,16 @@ ProgramMemory(bool wordBased)
     const uint8_t   pollVal2    =   SMoCommand::gBody[9];
     const uint8_t * data        =  &SMoCommand::gBody[10];
 
+#ifdef SMO_PATCH
+    SMoPatch::Apply(wordBased, SMoGeneral::gAddress, &SMoCommand::gBody[10], numBytes);
+#endif
+    SMoStats::Moved(SMoStats::kISP, numBytes);
     LoadExtendedAddress();
     uint32_t address = SMoGeneral::gAddress;
-    while (numBytes--) {
+    for (int16_t n = numBytes; n > 0; n -= wordBased ? 2 : 1) {
         SPITransaction(cmd1, SMoGeneral::gAddress, *data++);
-        if (wordBased) {
-            --numBytes;
+        if (wordBased)
             SPITransaction(cmd1|8, SMoGeneral::gAddress, *data++);
-        }
         ++SMoGeneral::gAddress;
     }
     if ((mode & 0x81) == 0x81) {
@@ -231,34 +275,81 @@ ProgramMemory(bool wordBased)
         delay(cmdDelay);
     if (mode & 0x04) {
         uint8_t pollVal = wordBased ? pollVal1 : pollVal2;
-        if (pollVal == SMoCommand::gBody[10])
+        if (pollVal == SMoCommand::gBody[10]) {
             delay(cmdDelay); // Values are identical - don't poll
-        else
+        } else {
+            uint32_t start = SMoStats::Now();
+            uint16_t polls = 1;
             while (SPITransaction(cmd3, address, 0) == pollVal)
-                ;
+                ++polls;
+            SMoStats::Polled(start, polls);
+        }
     }
     if (mode & 0x08)
         if (!ISPPollReady())
             return;
-    SMoCommand::SendResponse();
+    SMoVerify::Respond(address, 10, wordBased);
 }
 
+//
+// Remember the read instructions avrdude uses, so we can read ahead with them
+//
+static uint8_t  sReadFlashCmd   = 0x20;
+static uint8_t  sReadEEPROMCmd  = 0xA0;
+
 static void
-ReadMemory(bool wordBased)
+ReadMemoryBlock(uint8_t cmd, bool wordBased, uint8_t * data, uint16_t numBytes)
 {
-    uint16_t  numBytes    =  (SMoCommand::gBody[1]<<8)|SMoCommand::gBody[2];
-    const uint8_t   cmd   =   SMoCommand::gBody[3];
-    uint8_t * data        =  &SMoCommand::gBody[2];
-
+    SMoStats::Moved(SMoStats::kISP, numBytes);
     LoadExtendedAddress();
-    while (numBytes--) {
+    //
+    // An odd byte count for flash reads the whole last word, like HVSP/HVPP
+    //
+    for (int16_t n = numBytes; n > 0; n -= wordBased ? 2 : 1) {
         *data++ = SPITransaction(cmd, SMoGeneral::gAddress, 0);
-        if (wordBased) {
-            --numBytes;
+        if (wordBased)
             *data++ = SPITransaction(cmd|8, SMoGeneral::gAddress, 0);
-        }
         ++SMoGeneral::gAddress;
     }
+}
+
+void
+SMoISP::ReadFlashBlock(uint8_t * data, uint16_t numBytes)
+{
+    ReadMemoryBlock(sReadFlashCmd, true, data, numBytes);
+}
+
+void
+SMoISP::ReadEEPROMBlock(uint8_t * data, uint16_t numBytes)
+{
+    ReadMemoryBlock(sReadEEPROMCmd, false, data, numBytes);
+}
+
+static void
+ReadMemory(bool wordBased)
+{
+    uint16_t  numBytes    =  (SMoCommand::gBody[1]<<8)|SMoCommand::gBody[2];
+    const uint8_t   cmd   =   SMoCommand::gBody[3];
+    uint8_t * data        =  &SMoCommand::gBody[2];
+
+    if (wordBased)
+        sReadFlashCmd   = cmd;
+    else
+        sReadEEPROMCmd  = cmd;
+#ifdef SMO_READ_AHEAD
+    uint16_t cached = SMoReadAhead::Fetch(data, numBytes);
+    data     += cached;
+    numBytes -= cached;
+#endif
+    ReadMemoryBlock(cmd, wordBased, data, numBytes);
+    data     += numBytes;
+#ifdef SMO_READ_AHEAD
+    //
+    // Limp mode is too slow to read ahead without risking serial overruns
+    //
+    if (SMoHWIF::ISP::UsingHardwareSPI())
+        SMoReadAhead::Arm(SMoCommand::gBody[0], data-&SMoCommand::gBody[2], wordBased);
+#endif
     *data++ = STATUS_CMD_OK;
     SMoCommand::SendResponse(STATUS_CMD_OK, data-&SMoCommand::gBody[0]);   
 }
@@ -266,6 +357,12 @@ ReadMemory(bool wordBased)
 void
 SMoISP::ProgramFlash()
 {
+#ifdef SMO_HELPER
+    if (SMoHelper::gActive) {
+        SMoHelper::ProgramFlash();
+        return;
+    }
+#endif
     ProgramMemory(true);
 }
 
@@ -291,6 +388,7 @@ void
 SMoISP::ProgramFuse()
 {
     SPITransaction(&SMoCommand::gBody[1]);
+    SMoSession::Drop();
     SMoCommand::gBody[2] = STATUS_CMD_OK;
     SMoCommand::SendResponse();
 }
@@ -355,3 +453,9 @@ SMoISP::SPIMulti()
     SMoDebug.println();
 #endif
 }
+
+uint8_t
+SMoISP::Transfer(const uint8_t * instr)
+{
+    return SPITransaction(instr);
+}
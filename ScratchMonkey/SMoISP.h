@@ -13,6 +13,8 @@
 #ifndef _SMO_ISP_
 #define _SMO_ISP_
 
+#include <inttypes.h>
+
 namespace SMoISP {
     void EnterProgmode();
     void LeaveProgmode();
@@ -28,6 +30,21 @@ namespace SMoISP {
     inline void ReadSignature()    { ReadFuse();    }
     inline void ReadOscCal()       { ReadFuse();    }
     void SPIMulti();
+    //
+    // Read from SMoGeneral::gAddress without sending a response
+    //
+    void ReadFlashBlock(uint8_t * data, uint16_t numBytes);
+    void ReadEEPROMBlock(uint8_t * data, uint16_t numBytes);
+    //
+    // Single 4 byte instruction, returning the last byte received
+    //
+    uint8_t Transfer(const uint8_t * instr);
+    //
+    // For SMoSession: End programming mode without a response, read the
+    // three signature bytes
+    //
+    void    Stop();
+    void    Signature(uint8_t * sig);
 } // namespace SMoISP
 
 #endif /* _SMO_ISP_ */
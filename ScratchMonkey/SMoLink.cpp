@@ -0,0 +1,43 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoLink.cpp        - Link throughput self test
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#include "SMoLink.h"
+#include "SMoCommand.h"
+
+#ifdef SMO_LINK_TEST
+
+void
+SMoLink::Command()
+{
+    switch (SMoCommand::gBody[1]) {
+    case SCRATCHMONKEY_LINK_SINK:
+        SMoCommand::SendResponse();
+        break;
+    case SCRATCHMONKEY_LINK_SOURCE: {
+        uint16_t count = (SMoCommand::gBody[2] << 8) | SMoCommand::gBody[3];
+        if (count > SMoCommand::kMaxBodySize-2)
+            count = SMoCommand::kMaxBodySize-2;
+        for (uint16_t i = 0; i<count; ++i)
+            SMoCommand::gBody[2+i] = i;
+        SMoCommand::SendResponse(STATUS_CMD_OK, count+2);
+        break; }
+    case SCRATCHMONKEY_LINK_ECHO:
+        //
+        // The data is already where the response wants it
+        //
+        SMoCommand::SendResponse(STATUS_CMD_OK, SMoCommand::gSize);
+        break;
+    default:
+        SMoCommand::SendResponse(STATUS_CMD_FAILED);
+        break;
+    }
+}
+
+#endif
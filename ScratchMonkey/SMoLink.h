@@ -0,0 +1,34 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoLink.h          - Link throughput self test
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// With SMO_LINK_TEST defined (see SMoConfig.h), the host can move data over
+// the serial link as fast as the framing allows, without a target attached,
+// to find out what the USB serial bridge and the baud rate cost by
+// themselves (Tools/smolink).
+//
+// CMD_SCRATCHMONKEY_LINK
+//   [1]      SCRATCHMONKEY_LINK_SINK: [2..] data, ignored
+//              Response: status
+//            SCRATCHMONKEY_LINK_SOURCE: [2..3] number of bytes
+//              Response: status, that many bytes (counting up from 0),
+//              clipped to the frame size
+//            SCRATCHMONKEY_LINK_ECHO: [2..] data
+//              Response: status, the same data
+//
+
+#ifndef _SMO_LINK_
+#define _SMO_LINK_
+
+#include "SMoConfig.h"
+
+namespace SMoLink {
+    void Command();
+} // namespace SMoLink
+
+#endif /* _SMO_LINK_ */
@@ -0,0 +1,83 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoPageHash.cpp    - Per page checksums of flash / EEPROM contents
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#include "SMoPageHash.h"
+#include "SMoCommand.h"
+#include "SMoGeneral.h"
+#include "SMoISP.h"
+#include "SMoHVSP.h"
+#include "SMoHVPP.h"
+
+#include <util/crc16.h>
+
+const uint8_t   kChunkSize  = 32;
+
+bool
+SMoPageHash::Read(uint8_t command, uint8_t * data, uint8_t numBytes)
+{
+    switch (command) {
+    case CMD_READ_FLASH_ISP:
+        SMoISP::ReadFlashBlock(data, numBytes);
+        break;
+    case CMD_READ_EEPROM_ISP:
+        SMoISP::ReadEEPROMBlock(data, numBytes);
+        break;
+    case CMD_READ_FLASH_HVSP:
+        SMoHVSP::ReadFlashBlock(data, numBytes);
+        break;
+    case CMD_READ_EEPROM_HVSP:
+        SMoHVSP::ReadEEPROMBlock(data, numBytes);
+        break;
+    case CMD_READ_FLASH_PP:
+        SMoHVPP::ReadFlashBlock(data, numBytes);
+        break;
+    case CMD_READ_EEPROM_PP:
+        SMoHVPP::ReadEEPROMBlock(data, numBytes);
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+void
+SMoPageHash::Compute()
+{
+    const uint32_t  address     = (uint32_t(SMoCommand::gBody[1]) << 24)
+                                | (uint32_t(SMoCommand::gBody[2]) << 16)
+                                | (uint32_t(SMoCommand::gBody[3]) <<  8)
+                                |  SMoCommand::gBody[4];
+    const uint16_t  pageSize    = (SMoCommand::gBody[5] << 8) | SMoCommand::gBody[6];
+    const uint16_t  numPages    = (SMoCommand::gBody[7] << 8) | SMoCommand::gBody[8];
+    const uint8_t   command     = SMoCommand::gBody[9];
+    uint8_t *       hash        = &SMoCommand::gBody[2];
+    uint8_t         chunk[kChunkSize];
+
+    if (!pageSize || (pageSize & 1) || numPages > (SMoCommand::kMaxBodySize-2)/2) {
+        SMoCommand::SendResponse(STATUS_CMD_FAILED);
+        return;
+    }
+    SMoGeneral::gAddress = address;
+    for (uint16_t page = 0; page < numPages; ++page) {
+        uint16_t crc = 0xFFFF;
+        for (uint16_t offset = 0; offset < pageSize; offset += kChunkSize) {
+            uint8_t numBytes = pageSize-offset < kChunkSize ? pageSize-offset : kChunkSize;
+            if (!Read(command, chunk, numBytes)) {
+                SMoCommand::SendResponse(STATUS_CMD_FAILED);
+                return;
+            }
+            for (uint8_t i = 0; i < numBytes; ++i)
+                crc = _crc_ccitt_update(crc, chunk[i]);
+        }
+        *hash++ = crc >> 8;
+        *hash++ = crc & 0xFF;
+    }
+    SMoCommand::SendResponse(STATUS_CMD_OK, hash-&SMoCommand::gBody[0]);
+}
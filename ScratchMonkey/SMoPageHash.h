@@ -0,0 +1,36 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoPageHash.h      - Per page checksums of flash / EEPROM contents
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// To reflash only the pages that changed, the host compares these checksums
+// against its image instead of reading back the whole memory.
+//
+// CMD_SCRATCHMONKEY_PAGE_HASH
+//   [1..4]   Start address, as for CMD_LOAD_ADDRESS
+//   [5..6]   Page size in bytes
+//   [7..8]   Number of pages
+//   [9]      Read command (CMD_READ_FLASH_ISP, CMD_READ_EEPROM_PP, ...)
+//   Response: status, CRC-CCITT (2, initial value 0xFFFF, as computed by
+//             _crc_ccitt_update) for each page
+//
+
+#ifndef _SMO_PAGE_HASH_
+#define _SMO_PAGE_HASH_
+
+#include <inttypes.h>
+
+namespace SMoPageHash {
+    void Compute();
+    //
+    // Read numBytes from SMoGeneral::gAddress with the given read command,
+    // without sending a response. Returns false for unknown commands.
+    //
+    bool Read(uint8_t command, uint8_t * data, uint8_t numBytes);
+} // namespace SMoPageHash
+
+#endif /* _SMO_PAGE_HASH_ */
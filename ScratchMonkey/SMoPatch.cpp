@@ -0,0 +1,128 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoPatch.cpp       - Per device patches to the programmed data
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#include "SMoPatch.h"
+#include "SMoCommand.h"
+#include "SMoConfig.h"
+#include "SMoHWIF.h"
+
+#include <string.h>
+
+#ifdef SMO_PATCH
+
+const uint8_t   kMaxPatches     = 4;
+const uint8_t   kMaxPatchSize   = 16;
+
+struct Patch {
+    uint32_t    address;    // Byte address
+    uint8_t     flags;
+    uint8_t     size;
+    uint8_t     data[kMaxPatchSize];
+};
+
+static Patch    sPatch[kMaxPatches];
+static uint8_t  sNumPatches;
+
+void
+SMoPatch::Command()
+{
+    switch (SMoCommand::gBody[1]) {
+    case SCRATCHMONKEY_PATCH_CLEAR:
+        Clear();
+        break;
+    case SCRATCHMONKEY_PATCH_ADD: {
+        uint16_t size = SMoCommand::gSize-7;
+        if (SMoCommand::gSize < 8 || size > kMaxPatchSize || sNumPatches == kMaxPatches) {
+            SMoCommand::SendResponse(STATUS_CMD_FAILED);
+            return;
+        }
+        Patch & patch   = sPatch[sNumPatches++];
+        patch.flags     = SMoCommand::gBody[2];
+        patch.address   = (uint32_t(SMoCommand::gBody[3]) << 24)
+                        | (uint32_t(SMoCommand::gBody[4]) << 16)
+                        | (uint32_t(SMoCommand::gBody[5]) <<  8)
+                        |  SMoCommand::gBody[6];
+        patch.size      = size;
+        memcpy(patch.data, &SMoCommand::gBody[7], size);
+        break; }
+    case SCRATCHMONKEY_PATCH_NEXT:
+        NextUnit();
+        break;
+    default:
+        SMoCommand::SendResponse(STATUS_CMD_UNKNOWN);
+        return;
+    }
+    SMoCommand::SendResponse();
+}
+
+void
+SMoPatch::Clear()
+{
+    sNumPatches = 0;
+}
+
+void
+SMoPatch::Apply(bool flash, uint32_t address, uint8_t * data, uint16_t numBytes)
+{
+    //
+    // Strip flags ISP uses for extended addressing
+    //
+    address &= 0x7FFFFF;
+    if (flash)
+        address <<= 1;
+    for (uint8_t i = 0; i < sNumPatches; ++i) {
+        const Patch & patch = sPatch[i];
+        if (!(patch.flags & SCRATCHMONKEY_PATCH_EEPROM) != flash)
+            continue;
+        for (uint8_t b = 0; b < patch.size; ++b) {
+            uint32_t offset = patch.address + b - address;
+            if (offset < numBytes)
+                data[offset] = patch.data[b];
+        }
+    }
+}
+
+void
+SMoPatch::NextUnit()
+{
+    for (uint8_t i = 0; i < sNumPatches; ++i) {
+        Patch & patch = sPatch[i];
+        if (!(patch.flags & SCRATCHMONKEY_PATCH_COUNTER))
+            continue;
+        //
+        // Counters are little endian unless requested otherwise
+        //
+        bool bigEndian = patch.flags & SCRATCHMONKEY_PATCH_BIG_ENDIAN;
+        for (uint8_t b = 0; b < patch.size; ++b) 
+            if (++patch.data[bigEndian ? patch.size-1-b : b])
+                break;
+    }
+}
+
+#ifdef SMO_STANDALONE
+void
+SMoPatch::Save(uint32_t address)
+{
+    SMoHWIF::Store::EraseSector(address);
+    SMoHWIF::Store::WritePage(address, &sNumPatches, 1);
+    SMoHWIF::Store::WritePage(address+1, reinterpret_cast<const uint8_t *>(sPatch), sNumPatches*sizeof(Patch));
+}
+
+void
+SMoPatch::Load(uint32_t address)
+{
+    SMoHWIF::Store::Read(address, &sNumPatches, 1);
+    if (sNumPatches > kMaxPatches)  // Erased
+        sNumPatches = 0;
+    SMoHWIF::Store::Read(address+1, reinterpret_cast<uint8_t *>(sPatch), sNumPatches*sizeof(Patch));
+}
+#endif
+
+#endif /* SMO_PATCH */
@@ -0,0 +1,51 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoPatch.h         - Per device patches to the programmed data
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// Serial numbers and calibration values differ for every unit, but we don't
+// want to resend the whole image for that. Instead, the host sets up a few
+// patches, which the ISP / HVSP / HVPP program handlers merge into the data
+// they write. Counter patches are incremented for every unit.
+//
+// Patches last until the next CMD_SIGN_ON, so they don't end up in the
+// writes of an unrelated session. On layouts with an image store (see
+// SMoStore.h), the patches present when a recording ends are kept with it,
+// and a replay uses, and counts up, those, which survive power cycles. That
+// costs a sector erase of the store per unit, so its endurance (typically
+// 100000 cycles) limits the number of units per recording.
+//
+// CMD_SCRATCHMONKEY_PATCH
+//   [1]      SCRATCHMONKEY_PATCH_CLEAR: Remove all patches
+//            SCRATCHMONKEY_PATCH_ADD: [2] flags, [3..6] byte address, [7..] data
+//            SCRATCHMONKEY_PATCH_NEXT: Increment counters for the next unit
+//   Response: status
+//
+
+#ifndef _SMO_PATCH_
+#define _SMO_PATCH_
+
+#include <inttypes.h>
+
+namespace SMoPatch {
+    void Command();
+    void Clear();
+    //
+    // Patch numBytes of data destined for address (as in SMoGeneral::gAddress,
+    // so word address for flash).
+    //
+    void Apply(bool flash, uint32_t address, uint8_t * data, uint16_t numBytes);
+    void NextUnit();
+    //
+    // Keep the patches in, and get them back from, the image store sector
+    // at address
+    //
+    void Save(uint32_t address);
+    void Load(uint32_t address);
+} // namespace SMoPatch
+
+#endif /* _SMO_PATCH_ */
@@ -0,0 +1,127 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoReadAhead.cpp   - Speculative reading of flash / EEPROM blocks
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#include "SMoReadAhead.h"
+#include "SMoCommand.h"
+#include "SMoGeneral.h"
+#include "SMoISP.h"
+#include "SMoHVSP.h"
+#include "SMoHVPP.h"
+#include "SMoConfig.h"
+#include "SMoHWIF.h"
+
+#include <string.h>
+
+#ifdef SMO_READ_AHEAD
+
+const uint16_t  kBufferSize     = 256;
+//
+// We read in small chunks, so an incoming command won't overflow the serial
+// receive buffer while we're busy talking to the target.
+//
+const uint16_t  kChunkSize      = 8;
+
+static uint8_t  sCommand;       // 0 if buffer is invalid
+static uint8_t  sShift;         // 1 if addresses count words, 0 for bytes
+static uint32_t sStart;         // Address where buffer starts
+static uint32_t sNext;          // Address of next byte to read
+static uint16_t sValid;         // Bytes read so far
+static uint16_t sWanted;        // Bytes we want to read
+static uint8_t  sBuffer[kBufferSize];
+
+void
+SMoReadAhead::Arm(uint8_t command, uint16_t numBytes, bool wordAddress)
+{
+    sCommand    = command;
+    sShift      = wordAddress;
+    sStart      = SMoGeneral::gAddress;
+    sNext       = sStart;
+    sValid      = 0;
+    sWanted     = numBytes < kBufferSize ? numBytes : kBufferSize;
+    if (wordAddress)
+        sWanted &= ~1;
+}
+
+void
+SMoReadAhead::Invalidate()
+{
+    sCommand    = 0;
+}
+
+static void
+ReadChunk()
+{
+    uint16_t chunk = sWanted - sValid;
+    if (chunk > kChunkSize)
+        chunk = kChunkSize;
+    //
+    // Don't cross into the next 64K segment: For ISP, that would change the
+    // extended address register behind the back of the next live command.
+    //
+    uint32_t last = sNext + (chunk >> sShift) - 1;
+    if ((last ^ sStart) & 0xFFFF0000) {
+        sWanted = sValid;
+        return;
+    }
+    uint32_t address        = SMoGeneral::gAddress;
+    SMoGeneral::gAddress    = sNext;
+    uint8_t * data          = &sBuffer[sValid];
+    switch (sCommand) {
+    case CMD_READ_FLASH_ISP:
+        SMoISP::ReadFlashBlock(data, chunk);
+        break;
+    case CMD_READ_EEPROM_ISP:
+        SMoISP::ReadEEPROMBlock(data, chunk);
+        break;
+    case CMD_READ_FLASH_HVSP:
+        SMoHVSP::ReadFlashBlock(data, chunk);
+        break;
+    case CMD_READ_EEPROM_HVSP:
+        SMoHVSP::ReadEEPROMBlock(data, chunk);
+        break;
+    case CMD_READ_FLASH_PP:
+        SMoHVPP::ReadFlashBlock(data, chunk);
+        break;
+    case CMD_READ_EEPROM_PP:
+        SMoHVPP::ReadEEPROMBlock(data, chunk);
+        break;
+    }
+    sNext                   = SMoGeneral::gAddress;
+    SMoGeneral::gAddress    = address;
+    sValid                 += chunk;
+}
+
+void
+SMoReadAhead::Check(int command)
+{
+    if (command == SMoCommand::kIncomplete) {
+        if (sCommand && sValid < sWanted && !SMoCommand::Busy())
+            ReadChunk();
+    } else if (command != sCommand && command != CMD_LOAD_ADDRESS) {
+        Invalidate();
+    }
+}
+
+uint16_t
+SMoReadAhead::Fetch(uint8_t * data, uint16_t numBytes)
+{
+    uint16_t supplied = 0;
+
+    if (sCommand && SMoGeneral::gAddress == sStart) {
+        supplied = sValid < numBytes ? sValid : numBytes;
+        memcpy(data, sBuffer, supplied);
+        SMoGeneral::gAddress += supplied >> sShift;
+    }
+    Invalidate();
+
+    return supplied;
+}
+
+#endif /* SMO_READ_AHEAD */
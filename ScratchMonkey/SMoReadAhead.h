@@ -0,0 +1,41 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoReadAhead.h     - Speculative reading of flash / EEPROM blocks
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// avrdude reads memories as a sequence of blocks at consecutive addresses,
+// and we'd otherwise sit idle while it parses each response. Instead, we
+// read ahead into a spare buffer and answer the next request from it.
+//
+
+#ifndef _SMO_READ_AHEAD_
+#define _SMO_READ_AHEAD_
+
+#include <inttypes.h>
+
+namespace SMoReadAhead {
+    //
+    // Called by the read handlers after completing a block read: command is the
+    // STK read command, numBytes the block size, and wordAddress tells whether
+    // SMoGeneral::gAddress counts words (flash) or bytes (EEPROM).
+    //
+    void        Arm(uint8_t command, uint16_t numBytes, bool wordAddress);
+    //
+    // Called from the main loop for every command code returned by the parser.
+    // Reads ahead while we're idle, and invalidates the buffer for any command
+    // other than a read of the same memory.
+    //
+    void        Check(int command);
+    void        Invalidate();
+    //
+    // If the requested block starts at the predicted address, copy whatever we
+    // already read and return the number of bytes supplied.
+    //
+    uint16_t    Fetch(uint8_t * data, uint16_t numBytes);
+} // namespace SMoReadAhead
+
+#endif /* _SMO_READ_AHEAD_ */
@@ -0,0 +1,284 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoRegion.cpp      - Streaming programming of whole memory regions
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#include "SMoRegion.h"
+#include "SMoCommand.h"
+#include "SMoGeneral.h"
+#include "SMoISP.h"
+#include "SMoHVSP.h"
+#include "SMoHVPP.h"
+#include "SMoTPI.h"
+#include "SMoDevice.h"
+#include "SMoConfig.h"
+#include "SMoHWIF.h"
+
+#include <string.h>
+
+//
+// Frames beyond the one we're working on have to fit into the serial
+// receive buffer, which holds one byte less than its size.
+//
+#ifdef SERIAL_RX_BUFFER_SIZE
+const uint16_t  kWindow         = SERIAL_RX_BUFFER_SIZE-1;
+#else
+const uint16_t  kWindow         = 63;
+#endif
+const uint8_t   kMaxParams      = 7;
+
+static bool     sActive;
+static uint8_t  sCommand;               // Program command to issue per page
+static uint8_t  sParams[kMaxParams];    // ... and its parameters
+static uint8_t  sNumParams;
+static uint8_t  sHeaderSize;            // Offset of data in command body
+static uint16_t sPageSize;
+static uint16_t sPageOffset;            // Bytes already loaded in current page
+static uint32_t sRemaining;             // Bytes still expected
+static uint32_t sAddress;               // Byte address of next byte
+static uint32_t sPageAddress;           // Byte address of current page
+static uint8_t  sStatus;
+
+static void
+PutLong(uint8_t * dst, uint32_t value)
+{
+    dst[0]  = value >> 24;
+    dst[1]  = value >> 16;
+    dst[2]  = value >> 8;
+    dst[3]  = value;
+}
+
+//
+// Determine the layout of a program command
+//
+static bool
+SetupCommand(uint8_t command)
+{
+    switch (command) {
+    case CMD_PROGRAM_FLASH_ISP:
+    case CMD_PROGRAM_EEPROM_ISP:
+        sNumParams  = 7;
+        sHeaderSize = 10;
+        return true;
+    case CMD_PROGRAM_FLASH_PP:
+    case CMD_PROGRAM_FLASH_HVSP:
+    case CMD_PROGRAM_EEPROM_PP:
+    case CMD_PROGRAM_EEPROM_HVSP:
+        sNumParams  = 2;
+        sHeaderSize = 5;
+        return true;
+    case CMD_XPROG:
+        sNumParams  = 2;
+        sHeaderSize = 10;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool
+IsWordAddressed(uint8_t command)
+{
+    return command == CMD_PROGRAM_FLASH_ISP 
+        || command == CMD_PROGRAM_FLASH_HVSP
+        || command == CMD_PROGRAM_FLASH_PP;
+}
+
+static void
+SetupAddress(uint32_t address)
+{
+    sAddress        = address & 0x7FFFFFFF;
+    if (IsWordAddressed(sCommand))
+        sAddress  <<= 1;
+    sPageAddress    = sAddress;
+    sPageOffset     = 0;
+    sStatus         = STATUS_CMD_OK;
+    SMoGeneral::gAddress = address;
+}
+
+void
+SMoRegion::Start()
+{
+    const uint32_t  address     = (uint32_t(SMoCommand::gBody[1]) << 24)
+                                | (uint32_t(SMoCommand::gBody[2]) << 16)
+                                | (uint32_t(SMoCommand::gBody[3]) <<  8)
+                                |  SMoCommand::gBody[4];
+    const uint16_t  pageSize    = (SMoCommand::gBody[5] << 8) | SMoCommand::gBody[6];
+    const uint32_t  length      = (uint32_t(SMoCommand::gBody[7]) << 24)
+                                | (uint32_t(SMoCommand::gBody[8]) << 16)
+                                | (uint32_t(SMoCommand::gBody[9]) <<  8)
+                                |  SMoCommand::gBody[10];
+    const uint8_t   command     = SMoCommand::gBody[11];
+    uint16_t        window      = kWindow;
+
+    sActive = false;
+    if (!SetupCommand(command) || !pageSize || SMoCommand::gSize < 12+sNumParams) {
+        SMoCommand::SendResponse(STATUS_CMD_FAILED);
+        return;
+    }
+#ifdef SMO_SHARE_SERIAL_PINS
+    //
+    // Serial port is turned off while we talk to the target, so we can't
+    // accept any data in the meantime.
+    //
+    if (command == CMD_PROGRAM_FLASH_PP || command == CMD_PROGRAM_EEPROM_PP)
+        window = 0;
+#endif
+    memcpy(sParams, &SMoCommand::gBody[12], sNumParams);
+    sActive         = true;
+    sCommand        = command;
+    sPageSize       = pageSize;
+    sRemaining      = length;
+    SetupAddress(address);
+
+    const uint16_t  maxData = (SMoCommand::kMaxBodySize+1-sHeaderSize) & ~1; // Whole words
+    SMoCommand::gBody[2]    = window >> 8;
+    SMoCommand::gBody[3]    = window & 0xFF;
+    SMoCommand::gBody[4]    = maxData >> 8;
+    SMoCommand::gBody[5]    = maxData & 0xFF;
+    SMoCommand::SendResponse(STATUS_CMD_OK, 6);
+}
+
+static void
+RunProgramCommand(uint8_t command)
+{
+    switch (command) {
+    case CMD_PROGRAM_FLASH_ISP:
+        SMoISP::ProgramFlash();
+        break;
+    case CMD_PROGRAM_EEPROM_ISP:
+        SMoISP::ProgramEEPROM();
+        break;
+    case CMD_PROGRAM_FLASH_HVSP:
+        SMoHVSP::ProgramFlash();
+        break;
+    case CMD_PROGRAM_EEPROM_HVSP:
+        SMoHVSP::ProgramEEPROM();
+        break;
+    case CMD_PROGRAM_FLASH_PP:
+        SMoHVPP::ProgramFlash();
+        break;
+    case CMD_PROGRAM_EEPROM_PP:
+        SMoHVPP::ProgramEEPROM();
+        break;
+    case CMD_XPROG:
+        SMoTPI::WriteMem();
+        break;
+    }
+}
+
+//
+// Program numBytes of data located at gBody[sHeaderSize], committing the
+// page if requested.
+//
+static void
+ProgramPiece(uint16_t numBytes, bool commit)
+{
+    uint8_t * body = &SMoCommand::gBody[0];
+
+    if (sCommand == CMD_XPROG) {
+        body[0] = CMD_XPROG;
+        body[1] = XPRG_CMD_WRITE_MEM;
+        body[2] = sParams[0];
+        body[3] = sParams[1];
+        PutLong(&body[4], sAddress);
+        body[8] = numBytes >> 8;
+        body[9] = numBytes & 0xFF;
+    } else {
+        body[0] = sCommand;
+        body[1] = numBytes >> 8;
+        body[2] = numBytes & 0xFF;
+        memcpy(&body[3], sParams, sNumParams);
+        if (!commit)
+            body[3] &= ~0x80;   // Load page buffer only
+    }
+    SMoCommand::DeferResponses(true);
+    RunProgramCommand(sCommand);
+    sStatus = SMoCommand::DeferredStatus();
+    SMoCommand::DeferResponses(false);
+}
+
+//
+// Program numBytes of data located at gBody[sHeaderSize] page by page. 
+// sRemaining must already exclude them.
+//
+static void
+ProgramData(uint16_t numBytes)
+{
+    uint16_t offset = 0;
+    while (numBytes) {
+        uint16_t piece = sPageSize-sPageOffset;
+        if (piece > numBytes)
+            piece = numBytes;
+        if (offset)
+            memmove(&SMoCommand::gBody[sHeaderSize], &SMoCommand::gBody[sHeaderSize+offset], piece);
+        sPageOffset += piece;
+        ProgramPiece(piece, sPageOffset == sPageSize || (piece == numBytes && !sRemaining));
+        if (sStatus != STATUS_CMD_OK)
+            break;
+        sAddress    += piece;
+        offset      += piece;
+        numBytes    -= piece;
+        if (sPageOffset == sPageSize) {
+            sPageOffset  = 0;
+            sPageAddress = sAddress;
+        }
+    }
+}
+
+void
+SMoRegion::Data()
+{
+    uint16_t numBytes = SMoCommand::gSize-1;
+
+    if (!sActive || numBytes > sRemaining || numBytes+sHeaderSize > SMoCommand::kMaxBodySize+1
+     || (IsWordAddressed(sCommand) && (numBytes & 1))
+    ) {
+        sActive = false;
+        SMoCommand::SendResponse(STATUS_CMD_FAILED);
+        return;
+    }
+    sRemaining -= numBytes;
+    if (sStatus == STATUS_CMD_OK) {
+        //
+        // Make room for the command header in front of the data
+        //
+        memmove(&SMoCommand::gBody[sHeaderSize], &SMoCommand::gBody[1], numBytes);
+        ProgramData(numBytes);
+    }
+    if (!sRemaining)
+        sActive = false;
+    PutLong(&SMoCommand::gBody[2], sStatus == STATUS_CMD_OK ? sAddress : sPageAddress);
+    SMoCommand::SendResponse(sStatus, 6);
+}
+
+void
+SMoRegion::Program()
+{
+    const uint8_t   command     = SMoCommand::gBody[0];
+    const uint16_t  numBytes    = (SMoCommand::gBody[1] << 8) | SMoCommand::gBody[2];
+    const uint8_t   mode        = SMoCommand::gBody[3];
+    const uint16_t  pageSize    = SMoGeneral::gPageSize ? SMoGeneral::gPageSize : SMoDevice::PageSize(command);
+
+    if (!pageSize || numBytes <= pageSize || !(mode & 1)) {
+        RunProgramCommand(command);
+        return;
+    }
+    //
+    // Oversized paged write: Split into pages
+    //
+    sActive         = false;
+    SetupCommand(command);
+    memcpy(sParams, &SMoCommand::gBody[3], sNumParams);
+    sCommand        = command;
+    sPageSize       = pageSize;
+    sRemaining      = 0;
+    SetupAddress(SMoGeneral::gAddress);
+    ProgramData(numBytes);
+    SMoCommand::SendResponse(sStatus);
+}
@@ -0,0 +1,46 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoRegion.h        - Streaming programming of whole memory regions
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// Instead of a CMD_LOAD_ADDRESS / CMD_PROGRAM_* round trip for every page,
+// the host describes the whole region once and then streams the data in
+// CMD_SCRATCHMONKEY_REGION_DATA frames, which we split into pages and feed
+// to the regular ISP / HVSP / HVPP / TPI program handlers.
+//
+// CMD_SCRATCHMONKEY_REGION_START
+//   [1..4]   Start address, as for CMD_LOAD_ADDRESS or XPRG_CMD_WRITE_MEM
+//   [5..6]   Page size in bytes
+//   [7..10]  Total length in bytes
+//   [11]     Program command (CMD_PROGRAM_FLASH_ISP ... CMD_XPROG)
+//   [12..]   Parameters of that command between the length and the data
+//            (ISP: mode..pollVal2, HVSP/HVPP: mode, pollTimeout,
+//             TPI: memType, wrMode)
+//   Response: status, window(2), maximum data bytes per frame(2)
+//
+// CMD_SCRATCHMONKEY_REGION_DATA
+//   [1..]    Data
+//   Response: status, address(4) of the next byte or of the failing page
+//
+// Flow control: The host may send further data frames before the previous
+// ones are acknowledged, as long as the unacknowledged frames other than the
+// oldest one add up to no more than window bytes, including framing.
+//
+// Program commands with more data than PARAM2_SCRATCHMONKEY_PAGE_SIZE, which
+// the host may send on boards with large frame buffers, are split the same way.
+//
+
+#ifndef _SMO_REGION_
+#define _SMO_REGION_
+
+namespace SMoRegion {
+    void Start();
+    void Data();
+    void Program();
+} // namespace SMoRegion
+
+#endif /* _SMO_REGION_ */
@@ -0,0 +1,250 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoScript.cpp      - Batches of programming steps in a single command
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#include "SMoScript.h"
+#include "SMoCommand.h"
+#include "SMoISP.h"
+#include "SMoHVSP.h"
+#include "SMoHVPP.h"
+#include "SMoHWIF.h"
+
+#include <string.h>
+
+const uint8_t   kMaxResults = 64;
+//
+// Commands which have no business in a script, or whose responses can't
+// be bounded up front
+//
+const uint32_t  kNotInScript = 0xFFFFFFFF;
+
+//
+// Operand bytes following each opcode (COMMAND is variable)
+//
+static const uint8_t kOperands[] = {
+    0,  // END
+    2,  // COMMAND count len, plus body
+    4,  // SPI
+    2,  // HVSP
+    1,  // HVPP_COMMAND
+    2,  // HVPP_ADDRESS
+    2,  // HVPP_DATA
+    1,  // HVPP_COMMIT
+    1,  // HVPP_READ
+    3,  // POLL
+    1,  // DELAY
+    2,  // COMPARE
+    1,  // ABORT_UNLESS
+    0   // APPEND
+};
+
+//
+// Upper bound on the response size of a command
+//
+static uint32_t
+ResponseSize(const uint8_t * body)
+{
+    switch (body[0]) {
+    case CMD_SIGN_ON:
+        return 16;
+    case CMD_GET_PARAMETER:
+    case CMD_READ_FUSE_ISP:
+    case CMD_READ_LOCK_ISP:
+    case CMD_READ_SIGNATURE_ISP:
+    case CMD_READ_OSCCAL_ISP:
+        return 4;
+    case CMD_READ_FUSE_HVSP:
+    case CMD_READ_LOCK_HVSP:
+    case CMD_READ_SIGNATURE_HVSP:
+    case CMD_READ_OSCCAL_HVSP:
+    case CMD_READ_FUSE_PP:
+    case CMD_READ_LOCK_PP:
+    case CMD_READ_SIGNATURE_PP:
+    case CMD_READ_OSCCAL_PP:
+        return 3;
+    case CMD_SET_PARAMETER:
+    case CMD_LOAD_ADDRESS:
+    case CMD_SET_CONTROL_STACK:
+    case CMD_ENTER_PROGMODE_ISP:
+    case CMD_LEAVE_PROGMODE_ISP:
+    case CMD_CHIP_ERASE_ISP:
+    case CMD_PROGRAM_FLASH_ISP:
+    case CMD_PROGRAM_EEPROM_ISP:
+    case CMD_PROGRAM_FUSE_ISP:
+    case CMD_PROGRAM_LOCK_ISP:
+    case CMD_ENTER_PROGMODE_HVSP:
+    case CMD_ENTER_PROGMODE_HVSP_STK600:
+    case CMD_LEAVE_PROGMODE_HVSP:
+    case CMD_LEAVE_PROGMODE_HVSP_STK600:
+    case CMD_CHIP_ERASE_HVSP:
+    case CMD_PROGRAM_FLASH_HVSP:
+    case CMD_PROGRAM_EEPROM_HVSP:
+    case CMD_PROGRAM_FUSE_HVSP:
+    case CMD_PROGRAM_LOCK_HVSP:
+    case CMD_ENTER_PROGMODE_PP:
+    case CMD_LEAVE_PROGMODE_PP:
+    case CMD_CHIP_ERASE_PP:
+    case CMD_PROGRAM_FLASH_PP:
+    case CMD_PROGRAM_EEPROM_PP:
+    case CMD_PROGRAM_FUSE_PP:
+    case CMD_PROGRAM_LOCK_PP:
+    case CMD_XPROG_SETMODE:
+    case CMD_SCRATCHMONKEY_HELPER:
+    case CMD_SCRATCHMONKEY_PATCH:
+        return 2;
+    case CMD_READ_FLASH_ISP:
+    case CMD_READ_EEPROM_ISP:
+    case CMD_READ_FLASH_HVSP:
+    case CMD_READ_EEPROM_HVSP:
+    case CMD_READ_FLASH_PP:
+    case CMD_READ_EEPROM_PP:
+        return ((uint32_t(body[1]) << 8) | body[2]) + 3;
+    case CMD_SPI_MULTI:
+        return body[2] + 3;
+    case CMD_XPROG:
+        if (body[1] == XPRG_CMD_READ_MEM)
+            return ((uint32_t(body[7]) << 8) | body[8]) + 3;
+        return 3;
+    case CMD_SCRATCHMONKEY_REGION_START:
+    case CMD_SCRATCHMONKEY_REGION_DATA:
+        return 6;
+    case CMD_SCRATCHMONKEY_PAGE_HASH:
+        return ((uint32_t(body[7]) << 8) | body[8])*2 + 2;
+    default:
+        //
+        // SCRIPT and STORE (which would overwrite this script), diagnostics,
+        // and anything unknown
+        //
+        return kNotInScript;
+    }
+}
+
+//
+// Execute SPI / HVSP / HVPP_READ instruction
+//
+static uint8_t
+Primitive(const uint8_t * op)
+{
+    switch (op[0]) {
+    case SMoScript::kSPI:
+        return SMoISP::Transfer(&op[1]);
+    case SMoScript::kHVSP:
+        return SMoHVSP::Transfer(op[1], op[2]);
+    default:
+        return SMoHVPP::ReadData(op[1]);
+    }
+}
+
+void
+SMoScript::Run()
+{
+    const uint16_t  size        = SMoCommand::gSize-1;
+    uint8_t * const script      = &SMoCommand::gBody[SMoCommand::kMaxBodySize+1-size];
+    const uint16_t  room        = script-&SMoCommand::gBody[0];
+    const uint8_t * primitive   = 0;
+    uint8_t         results[kMaxResults];
+    uint8_t         numResults  = 0;
+    uint8_t         value       = 0;
+    bool            flag        = false;
+    uint8_t         status      = STATUS_CMD_OK;
+    uint16_t        pc          = 0;
+
+    memmove(script, &SMoCommand::gBody[1], size);
+    while (pc < size && status == STATUS_CMD_OK) {
+        const uint8_t * op = &script[pc];
+        if (op[0] == kEnd)
+            break;
+        if (op[0] > kAppend || pc+1+kOperands[op[0]] > size) {
+            status = STATUS_CMD_FAILED;
+            break;
+        }
+        uint16_t next = pc+1+kOperands[op[0]];
+        switch (op[0]) {
+        case kCommand: {
+            const uint8_t   count   = op[1];
+            const uint8_t   len     = op[2];
+            const uint8_t * body    = &op[3];
+            next += len;
+            if (!len || next > size || ResponseSize(body) > room
+             || numResults+count > kMaxResults
+            ) {
+                status = STATUS_CMD_FAILED;
+                break;
+            }
+            memcpy(&SMoCommand::gBody[0], body, len);
+            SMoCommand::gSize = len;
+            SMoCommand::DeferResponses(true);
+            SMoCommand::Dispatch(SMoCommand::gBody[0]);
+            status = SMoCommand::DeferredStatus();
+            if (status == STATUS_CMD_OK && SMoCommand::DeferredSize() < 2+count)
+                status = STATUS_CMD_FAILED;
+            SMoCommand::DeferResponses(false);
+            if (status == STATUS_CMD_OK) {
+                memcpy(&results[numResults], &SMoCommand::gBody[2], count);
+                numResults += count;
+            }
+            break; }
+        case kSPI:
+        case kHVSP:
+        case kHVPPRead:
+            primitive   = op;
+            value       = Primitive(op);
+            break;
+        case kHVPPCommand:
+            SMoHVPP::LoadCommand(op[1]);
+            break;
+        case kHVPPAddress:
+            SMoHVPP::LoadAddress(op[1], op[2]);
+            break;
+        case kHVPPData:
+            SMoHVPP::LoadData(op[1], op[2]);
+            break;
+        case kHVPPCommit:
+            SMoHVPP::CommitData(op[1]);
+            break;
+        case kPoll: {
+            if (!primitive) {
+                status = STATUS_CMD_FAILED;
+                break;
+            }
+            uint32_t start = millis();
+            while ((value & op[1]) != op[2]) {
+                if (millis()-start > op[3]) {
+                    status = STATUS_RDY_BSY_TOUT;
+                    break;
+                }
+                value = Primitive(primitive);
+            }
+            break; }
+        case kDelay:
+            delay(op[1]);
+            break;
+        case kCompare:
+            flag = (value & op[1]) == op[2];
+            break;
+        case kAbortUnless:
+            if (!flag)
+                status = op[1];
+            break;
+        case kAppend:
+            if (numResults == kMaxResults)
+                status = STATUS_CMD_FAILED;
+            else
+                results[numResults++] = value;
+            break;
+        }
+        if (status == STATUS_CMD_OK)
+            pc = next;
+    }
+    SMoCommand::gBody[0] = CMD_SCRATCHMONKEY_SCRIPT;
+    SMoCommand::gBody[2] = pc >> 8;
+    SMoCommand::gBody[3] = pc & 0xFF;
+    memcpy(&SMoCommand::gBody[4], results, numResults);
+    SMoCommand::SendResponse(status, 4+numResults);
+}
@@ -0,0 +1,67 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoScript.h        - Batches of programming steps in a single command
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// Identifying a chip and checking its fuses takes a dozen or more commands,
+// each of which costs a USB round trip. CMD_SCRATCHMONKEY_SCRIPT runs a
+// sequence of steps in one go, collecting results along the way.
+//
+// CMD_SCRATCHMONKEY_SCRIPT
+//   [1..]    Instructions (opcode followed by operands):
+//      END                                 Stop (also at end of command)
+//      COMMAND count len body[len]         Run STK command, abort if it
+//                                          fails, append count response
+//                                          bytes (from [2] on) to results
+//      SPI b1 b2 b3 b4                     ISP instruction, value = byte 4
+//      HVSP instr data                     HVSP transfer, value = data out
+//      HVPP_COMMAND cmd                    HVPP load command
+//      HVPP_ADDRESS byteSel addr           HVPP load address byte
+//      HVPP_DATA byteSel data              HVPP load data byte
+//      HVPP_COMMIT byteSel                 HVPP commit (write) data
+//      HVPP_READ byteSel                   HVPP read, value = data
+//      POLL mask match timeout             Repeat last SPI / HVSP / HVPP_READ
+//                                          until (value & mask) == match,
+//                                          abort after timeout ms
+//      DELAY ms                            Wait
+//      COMPARE mask match                  flag = (value & mask) == match
+//      ABORT_UNLESS status                 Abort with status if !flag
+//      APPEND                              Append value to results
+//   Response: status, offset(2) of the instruction that aborted (or of the
+//             end), results
+//
+// The script is moved to the end of the command buffer so the STK commands
+// it runs can use the front, so it has to leave room for their responses.
+// COMMAND fails for commands whose response size isn't known up front
+// (SCRIPT and STORE themselves, STATS, TRACE, LINK, TIMING, CAPTURE,
+// DEVICE, and unknown commands), and when count exceeds the response.
+//
+
+#ifndef _SMO_SCRIPT_
+#define _SMO_SCRIPT_
+
+namespace SMoScript {
+    enum {
+        kEnd            = 0x00,
+        kCommand        = 0x01,
+        kSPI            = 0x02,
+        kHVSP           = 0x03,
+        kHVPPCommand    = 0x04,
+        kHVPPAddress    = 0x05,
+        kHVPPData       = 0x06,
+        kHVPPCommit     = 0x07,
+        kHVPPRead       = 0x08,
+        kPoll           = 0x09,
+        kDelay          = 0x0A,
+        kCompare        = 0x0B,
+        kAbortUnless    = 0x0C,
+        kAppend         = 0x0D
+    };
+    void Run();
+} // namespace SMoScript
+
+#endif /* _SMO_SCRIPT_ */
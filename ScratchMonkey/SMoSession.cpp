@@ -0,0 +1,135 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoSession.cpp     - Keep the target in programming mode between sessions
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#include "SMoSession.h"
+#include "SMoCommand.h"
+#include "SMoISP.h"
+#include "SMoHVSP.h"
+#include "SMoHVPP.h"
+#include "SMoTPI.h"
+#include "SMoHWIF.h"
+
+#include <Arduino.h>
+#include <string.h>
+
+void
+SMoSession::Signature(uint8_t protocol, uint8_t * sig)
+{
+    switch (protocol) {
+    case kISP:
+        SMoISP::Signature(sig);
+        break;
+    case kHVSP:
+        SMoHVSP::Signature(sig);
+        break;
+    case kHVPP:
+        SMoHVPP::Signature(sig);
+        break;
+    case kTPI:
+        SMoTPI::Signature(sig);
+        break;
+    }
+}
+
+#ifdef SMO_STICKY_SESSION
+
+const uint8_t   kMaxEnter       = 12;   // CMD_ENTER_PROGMODE_ISP is the longest
+
+uint8_t         SMoSession::gTimeout = SMO_STICKY_TIMEOUT;
+
+static uint8_t  sProtocol;              // Session in progress
+static bool     sHeld;                  // Host left, we didn't
+static uint8_t  sEnter[kMaxEnter];      // Enter command of the session
+static uint8_t  sEnterSize;
+static uint8_t  sSignature[3];
+static uint32_t sHeldSince;
+
+bool
+SMoSession::Resume(uint8_t protocol)
+{
+    uint8_t size = SMoCommand::gSize < kMaxEnter ? SMoCommand::gSize : kMaxEnter;
+
+    if (sHeld && protocol == sProtocol && size == sEnterSize 
+     && !memcmp(sEnter, &SMoCommand::gBody[0], size)
+    ) {
+        uint8_t sig[3];
+        Signature(sProtocol, sig);
+        if (!memcmp(sig, sSignature, 3)) {
+            sHeld = false;
+            return true;
+        }
+    }
+    Drop();
+    memcpy(sEnter, &SMoCommand::gBody[0], size);
+    sEnterSize  = size;
+    return false;
+}
+
+void
+SMoSession::Entered(uint8_t protocol)
+{
+    sProtocol   = protocol;
+    sHeld       = false;
+}
+
+bool
+SMoSession::Hold(uint8_t protocol)
+{
+    if (!gTimeout || protocol != sProtocol)
+        return false;
+#ifdef SMO_SHARE_SERIAL_PINS
+    //
+    // The HVPP control port includes RX and TX, which go back to the UART
+    // once the host leaves, so the target can't stay powered
+    //
+    if (protocol == kHVPP)
+        return false;
+#endif
+    Signature(sProtocol, sSignature);
+    sHeld       = true;
+    sHeldSince  = millis();
+    return true;
+}
+
+void
+SMoSession::Drop()
+{
+    if (sHeld) {
+        switch (sProtocol) {
+        case kISP:
+            SMoISP::Stop();
+            break;
+        case kHVSP:
+            SMoHVSP::Stop();
+            break;
+        case kHVPP:
+            SMoHVPP::Stop();
+            break;
+        case kTPI:
+            SMoTPI::Stop();
+            break;
+        }
+    }
+    sProtocol   = kNone;
+    sHeld       = false;
+}
+
+void
+SMoSession::Check(int command)
+{
+    if (!sHeld)
+        return;
+    if (command != SMoCommand::kIncomplete)
+        sHeldSince = millis();
+    else if (millis()-sHeldSince > gTimeout*1000UL)
+        Drop();
+}
+
+#endif /* SMO_STICKY_SESSION */
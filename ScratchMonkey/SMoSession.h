@@ -0,0 +1,83 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoSession.h       - Keep the target in programming mode between sessions
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// A recipe like Tools/RunTest runs avrdude several times per chip, and each
+// run enters and leaves programming mode, which for the high voltage
+// protocols means powering the target down and up again, with all the
+// delays that entails. With SMO_STICKY_SESSION defined (see SMoConfig.h),
+// leaving programming mode only holds the target where it is, and entering
+// again with the same parameters and control stack picks up the session,
+// provided the signature still reads the same. Entering any other way, or
+// PARAM_SCRATCHMONKEY_STICKY seconds without a command, really ends it.
+//
+// Sessions that wrote fuses or lock bits always end when the host leaves
+// them, as do HVPP sessions on boards wiring HVPP to the serial pins
+// (SMO_SHARE_SERIAL_PINS, the Uno). A held ISP session ends when the host
+// changes PARAM_SCK_DURATION.
+//
+// Programmers that reset when the host opens the port (most boards with a
+// UART bridge, unless auto reset is disabled) lose the session along with
+// everything else, so it only survives a reconnect on the Leonardo/Micro
+// or with auto reset disabled.
+//
+
+#ifndef _SMO_SESSION_
+#define _SMO_SESSION_
+
+#include <inttypes.h>
+
+#include "SMoConfig.h"
+
+namespace SMoSession {
+    enum {
+        kNone,
+        kISP,
+        kHVSP,
+        kHVPP,
+        kTPI
+    };
+    //
+    // Read the signature of the target in programming mode with protocol
+    //
+    void    Signature(uint8_t protocol, uint8_t * sig);
+#ifdef SMO_STICKY_SESSION
+    extern uint8_t  gTimeout;   // Seconds, 0 to always end sessions right away
+
+    //
+    // Called by EnterProgmode() before doing anything. Returns true if the
+    // held session can be picked up, in which case the target is ready.
+    // Otherwise, any held session has been ended, and the caller must call
+    // Entered() once it succeeded.
+    //
+    bool    Resume(uint8_t protocol);
+    void    Entered(uint8_t protocol);
+    //
+    // Called by LeaveProgmode(). Returns true if the session is held, in
+    // which case the caller must leave the target alone.
+    //
+    bool    Hold(uint8_t protocol);
+    //
+    // End a held session now, or keep the session in progress from being
+    // held, e.g. after writing fuses or lock bits, which only take effect
+    // once the target is reset
+    //
+    void    Drop();
+    //
+    // Called from the main loop, ends a held session after the timeout
+    //
+    void    Check(int command);
+#else
+    inline bool Resume(uint8_t) { return false; }
+    inline void Entered(uint8_t) {}
+    inline bool Hold(uint8_t) { return false; }
+    inline void Drop() {}
+#endif
+} // namespace SMoSession
+
+#endif /* _SMO_SESSION_ */
@@ -0,0 +1,178 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoStats.cpp       - Performance counters
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#include "SMoStats.h"
+#include "SMoCommand.h"
+
+#ifdef SMO_STATS
+
+#include <string.h>
+
+#if SMO_LAYOUT==SMO_LAYOUT_MEGA
+const uint8_t   kMaxCommands    = 32;
+#else
+const uint8_t   kMaxCommands    = 16;
+#endif
+const uint8_t   kNumBuckets     = 8;
+const uint8_t   kEntrySize      = 1+3*4+kNumBuckets*2;
+
+struct Entry {
+    uint8_t     fCommand;
+    uint32_t    fCount;
+    uint32_t    fTotal;
+    uint32_t    fMax;
+    uint16_t    fHistogram[kNumBuckets];
+};
+
+static Entry    sEntries[kMaxCommands];
+static uint8_t  sNumEntries;
+static uint8_t  sCommand;               // Command being timed, or 0
+static uint32_t sStart;
+static bool     sIdleValid;             // sLastEnd was set since clearing
+static uint32_t sLastEnd;
+static uint32_t sIdle;
+static uint32_t sPollIterations;
+static uint32_t sPollTicks;
+static uint32_t sBytes[SMoStats::kNumBackends];
+
+static void
+Clear()
+{
+    memset(sEntries, 0, sizeof(sEntries));
+    memset(sBytes, 0, sizeof(sBytes));
+    sNumEntries     = 0;
+    sIdleValid      = false;
+    sIdle           = 0;
+    sPollIterations = 0;
+    sPollTicks      = 0;
+}
+
+static Entry *
+FindEntry(uint8_t command)
+{
+    for (uint8_t i = 0; i<sNumEntries; ++i)
+        if (sEntries[i].fCommand == command)
+            return &sEntries[i];
+    if (sNumEntries < kMaxCommands-1) {
+        sEntries[sNumEntries].fCommand = command;
+        return &sEntries[sNumEntries++];
+    }
+    //
+    // Table full, lump the rest together
+    //
+    sNumEntries = kMaxCommands;
+    return &sEntries[kMaxCommands-1];
+}
+
+static uint8_t *
+PutLong(uint8_t * dst, uint32_t value)
+{
+    *dst++  = value >> 24;
+    *dst++  = value >> 16;
+    *dst++  = value >> 8;
+    *dst++  = value;
+    return dst;
+}
+
+static uint8_t *
+PutShort(uint8_t * dst, uint16_t value)
+{
+    *dst++  = value >> 8;
+    *dst++  = value;
+    return dst;
+}
+
+void
+SMoStats::Begin(int command)
+{
+    if (command <= 0 || command == CMD_SCRATCHMONKEY_STATS)
+        return;
+    sCommand    = command;
+    sStart      = Now();
+    if (sIdleValid)
+        sIdle  += sStart-sLastEnd;
+}
+
+void
+SMoStats::End()
+{
+    if (!sCommand)
+        return;
+    sLastEnd            = Now();
+    sIdleValid          = true;
+
+    uint32_t ticks      = sLastEnd-sStart;
+    Entry *  entry      = FindEntry(sCommand);
+    ++entry->fCount;
+    entry->fTotal      += ticks;
+    if (ticks > entry->fMax)
+        entry->fMax     = ticks;
+
+    uint8_t  bucket     = 0;
+    for (ticks >>= 6; ticks && bucket < kNumBuckets-1; ticks >>= 2)
+        ++bucket;
+    ++entry->fHistogram[bucket];
+    sCommand            = 0;
+}
+
+void
+SMoStats::Polled(uint32_t start, uint16_t iterations)
+{
+    sPollIterations    += iterations;
+    sPollTicks         += Now()-start;
+}
+
+void
+SMoStats::Moved(uint8_t backend, uint16_t numBytes)
+{
+    sBytes[backend]    += numBytes;
+}
+
+void
+SMoStats::Command()
+{
+    uint8_t * out = &SMoCommand::gBody[2];
+
+    switch (SMoCommand::gBody[1]) {
+    case SCRATCHMONKEY_STATS_CLEAR:
+        Clear();
+        break;
+    case SCRATCHMONKEY_STATS_SUMMARY:
+        out = PutShort(out, SMoHWIF::Timer::kTickNs);
+        out = PutLong(out, sIdle);
+        out = PutLong(out, sPollIterations);
+        out = PutLong(out, sPollTicks);
+        for (uint8_t i = 0; i<kNumBackends; ++i)
+            out = PutLong(out, sBytes[i]);
+        *out++ = sNumEntries;
+        break;
+    case SCRATCHMONKEY_STATS_COMMANDS: {
+        uint8_t first = SMoCommand::gBody[2];
+        *out++ = sNumEntries;
+        for (uint8_t i = first; i<sNumEntries; ++i) {
+            if (out+kEntrySize > &SMoCommand::gBody[SMoCommand::kMaxBodySize])
+                break;
+            const Entry & entry = sEntries[i];
+            *out++ = entry.fCommand;
+            out = PutLong(out, entry.fCount);
+            out = PutLong(out, entry.fTotal);
+            out = PutLong(out, entry.fMax);
+            for (uint8_t b = 0; b<kNumBuckets; ++b)
+                out = PutShort(out, entry.fHistogram[b]);
+        }
+        break; }
+    default:
+        SMoCommand::SendResponse(STATUS_CMD_FAILED);
+        return;
+    }
+    SMoCommand::SendResponse(STATUS_CMD_OK, out-&SMoCommand::gBody[0]);
+}
+
+#endif /* SMO_STATS */
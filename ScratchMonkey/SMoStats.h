@@ -0,0 +1,68 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoStats.h         - Performance counters
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// With SMO_STATS defined (see SMoConfig.h), we time every command handler
+// with a hardware timer (see SMoHWIF_Timer.h) and count where the time goes.
+// Otherwise, all hooks compile to nothing.
+//
+// CMD_SCRATCHMONKEY_STATS
+//   [1]      SCRATCHMONKEY_STATS_CLEAR: Reset all counters
+//            SCRATCHMONKEY_STATS_SUMMARY
+//              Response: status, tick length in ns(2), serial idle ticks(4),
+//              poll iterations(4), poll ticks(4), bytes moved(4) by ISP,
+//              HVSP, HVPP, TPI, number of command entries(1)
+//            SCRATCHMONKEY_STATS_COMMANDS: [2] first entry
+//              Response: status, number of command entries(1), entries:
+//              command code(1) count(4) total ticks(4) maximum ticks(4)
+//              histogram(8x2), as many as fit into a frame
+//   All values are big endian and wrap around silently. Histogram bucket i
+//   counts handlers taking less than 64*4^i ticks, the last one all others.
+//   Command code 0 collects commands that did not fit into the table.
+//
+
+#ifndef _SMO_STATS_
+#define _SMO_STATS_
+
+#include "SMoConfig.h"
+#include "SMoHWIF.h"
+
+namespace SMoStats {
+    enum {
+        kISP,
+        kHVSP,
+        kHVPP,
+        kTPI,
+        kNumBackends
+    };
+#ifdef SMO_STATS
+    inline uint32_t Now() { return SMoHWIF::Timer::Now(); }
+    //
+    // Bracket the handler of a top level command
+    //
+    void            Begin(int command);
+    void            End();
+    //
+    // A poll loop started at start ran for a number of iterations
+    //
+    void            Polled(uint32_t start, uint16_t iterations);
+    //
+    // Data read from or written to the target
+    //
+    void            Moved(uint8_t backend, uint16_t numBytes);
+    void            Command();
+#else
+    inline uint32_t Now() { return 0; }
+    inline void     Begin(int) {}
+    inline void     End() {}
+    inline void     Polled(uint32_t, uint16_t) {}
+    inline void     Moved(uint8_t, uint16_t) {}
+#endif
+} // namespace SMoStats
+
+#endif /* _SMO_STATS_ */
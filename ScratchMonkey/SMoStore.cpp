@@ -0,0 +1,222 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoStore.cpp       - Standalone programming from recorded commands
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#include "SMoStore.h"
+#include "SMoCommand.h"
+#include "SMoReadAhead.h"
+#include "SMoPatch.h"
+#include "SMoGeneral.h"
+#include "SMoConfig.h"
+#include "SMoHWIF.h"
+
+#include <string.h>
+
+#ifdef SMO_STANDALONE
+
+//
+// Store layout, by sector:
+//   0      Magic "SMo2", number of records (2)
+//   1      Patches as of the last unit (see SMoPatch.h)
+//   2...   Records: body size (2), expected size (2), body, expected data
+//
+const uint8_t   kMagic[4]       = {'S', 'M', 'o', '2'};
+const uint32_t  kPatchSector    = SMoHWIF::Store::kSectorSize;
+const uint32_t  kFirstRecord    = 2*SMoHWIF::Store::kSectorSize;
+const uint32_t  kStoreLimit     = 0x1000000;    // 24 bit addresses
+
+const uint8_t   kCompareChunk   = 16;
+
+static uint32_t sWriteAddress;
+static uint16_t sNumRecords;
+
+//
+// Memory read by a command, for patching expected data: 1 for flash, 0 for
+// EEPROM, -1 for anything else
+//
+static int8_t
+ReadMemoryType(uint8_t command)
+{
+    switch (command) {
+    case CMD_READ_FLASH_ISP:
+    case CMD_READ_FLASH_HVSP:
+    case CMD_READ_FLASH_PP:
+        return 1;
+    case CMD_READ_EEPROM_ISP:
+    case CMD_READ_EEPROM_HVSP:
+    case CMD_READ_EEPROM_PP:
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+static void
+Write(const uint8_t * data, uint16_t numBytes)
+{
+    while (numBytes) {
+        uint16_t piece = SMoHWIF::Store::kPageSize - (sWriteAddress % SMoHWIF::Store::kPageSize);
+        if (piece > numBytes)
+            piece = numBytes;
+        if (!(sWriteAddress % SMoHWIF::Store::kSectorSize))
+            SMoHWIF::Store::EraseSector(sWriteAddress);
+        SMoHWIF::Store::WritePage(sWriteAddress, data, piece);
+        sWriteAddress  += piece;
+        data           += piece;
+        numBytes       -= piece;
+    }
+}
+
+//
+// Replay the recording, returning the index of the failing record, or
+// 0xFFFF if all went well.
+//
+static uint16_t
+Run()
+{
+    uint8_t header[6];
+
+    SMoHWIF::Store::Read(0, header, 6);
+    if (memcmp(header, kMagic, 4)) {
+        SMoHWIF::Status::Set(SCRATCHMONKEY_ERR_LED);
+        return 0;
+    }
+    uint16_t numRecords = (header[4] << 8) | header[5];
+    uint32_t address    = kFirstRecord;
+    uint16_t record;
+#ifdef SMO_READ_AHEAD
+    SMoReadAhead::Invalidate();
+#endif
+#ifdef SMO_PATCH
+    SMoPatch::Load(kPatchSector);
+#endif
+    for (record = 0; record < numRecords; ++record) {
+        SMoHWIF::Status::Set(SCRATCHMONKEY_PGM_LED);
+        SMoHWIF::Store::Read(address, header, 4);
+        address += 4;
+        uint16_t bodySize   = (header[0] << 8) | header[1];
+        uint16_t expectSize = (header[2] << 8) | header[3];
+        if (bodySize > SMoCommand::kMaxBodySize || expectSize > SMoCommand::kMaxBodySize-2)
+            break;
+        SMoHWIF::Store::Read(address, SMoCommand::gBody, bodySize);
+        address += bodySize;
+        SMoCommand::gSize = bodySize;
+        const int8_t    memory      = ReadMemoryType(SMoCommand::gBody[0]);
+        const uint16_t  numBytes    = (SMoCommand::gBody[1] << 8) | SMoCommand::gBody[2];
+        const uint32_t  readAddress = SMoGeneral::gAddress;
+        SMoCommand::DeferResponses(true);
+        SMoCommand::Dispatch(SMoCommand::gBody[0]);
+        uint8_t status = SMoCommand::DeferredStatus();
+        SMoCommand::DeferResponses(false);
+        if (status != STATUS_CMD_OK)
+            break;
+        //
+        // Compare response against expected data, which was recorded without
+        // the patches for this unit.
+        //
+        if (expectSize) {
+            SMoHWIF::Status::Set(SCRATCHMONKEY_VFY_LED);
+            uint8_t  expected[kCompareChunk];
+            uint16_t i;
+            for (i = 0; i < expectSize; i += kCompareChunk) {
+                uint8_t chunk = expectSize-i < kCompareChunk ? expectSize-i : kCompareChunk;
+                SMoHWIF::Store::Read(address+i, expected, chunk);
+#ifdef SMO_PATCH
+                if (memory >= 0 && i < numBytes)
+                    SMoPatch::Apply(memory, readAddress + (i >> memory), expected, 
+                                    numBytes-i < chunk ? numBytes-i : chunk);
+#endif
+                if (memcmp(expected, &SMoCommand::gBody[2+i], chunk))
+                    break;
+            }
+            if (i < expectSize)
+                break;
+            address += expectSize;
+        }
+    }
+#ifdef SMO_READ_AHEAD
+    SMoReadAhead::Invalidate();
+#endif
+    SMoHWIF::Status::Set(record < numRecords ? SCRATCHMONKEY_ERR_LED : SCRATCHMONKEY_RDY_LED);
+#ifdef SMO_PATCH
+    if (record == numRecords) {
+        SMoPatch::NextUnit();
+        SMoPatch::Save(kPatchSector);
+    }
+#endif
+
+    return record < numRecords ? record : 0xFFFF;
+}
+
+void
+SMoStore::Command()
+{
+    switch (SMoCommand::gBody[1]) {
+    case SCRATCHMONKEY_STORE_BEGIN:
+        sNumRecords     = 0;
+        SMoHWIF::Store::EraseSector(0);
+        sWriteAddress   = kFirstRecord;
+        break;
+    case SCRATCHMONKEY_STORE_RECORD: {
+        uint16_t bodySize   = (SMoCommand::gBody[2] << 8) | SMoCommand::gBody[3];
+        uint16_t expectSize = SMoCommand::gSize-4-bodySize;
+        if (!sWriteAddress || SMoCommand::gSize < 4+bodySize 
+         || sWriteAddress+SMoCommand::gSize > kStoreLimit
+        ) {
+            SMoCommand::SendResponse(STATUS_CMD_FAILED);
+            return;
+        }
+        //
+        // Replace subcommand with expected size to form record header
+        //
+        SMoCommand::gBody[0] = bodySize >> 8;
+        SMoCommand::gBody[1] = bodySize & 0xFF;
+        SMoCommand::gBody[2] = expectSize >> 8;
+        SMoCommand::gBody[3] = expectSize & 0xFF;
+        Write(SMoCommand::gBody, SMoCommand::gSize);
+        SMoCommand::gBody[0] = CMD_SCRATCHMONKEY_STORE;
+        ++sNumRecords;
+        break; }
+    case SCRATCHMONKEY_STORE_END: {
+        if (!sWriteAddress) {
+            SMoCommand::SendResponse(STATUS_CMD_FAILED);
+            return;
+        }
+        uint8_t header[6];
+        memcpy(header, kMagic, 4);
+        header[4] = sNumRecords >> 8;
+        header[5] = sNumRecords & 0xFF;
+        SMoHWIF::Store::WritePage(0, header, 6);
+#ifdef SMO_PATCH
+        SMoPatch::Save(kPatchSector);
+#endif
+        sWriteAddress = 0;
+        break; }
+    case SCRATCHMONKEY_STORE_RUN: {
+        uint16_t failed = Run();
+        SMoCommand::gBody[0] = CMD_SCRATCHMONKEY_STORE;
+        SMoCommand::gBody[2] = failed >> 8;
+        SMoCommand::gBody[3] = failed & 0xFF;
+        SMoCommand::SendResponse(failed == 0xFFFF ? STATUS_CMD_OK : STATUS_CMD_FAILED, 4);
+        return; }
+    default:
+        SMoCommand::SendResponse(STATUS_CMD_UNKNOWN);
+        return;
+    }
+    SMoCommand::SendResponse();
+}
+
+void
+SMoStore::CheckStart()
+{
+    if (SMoHWIF::Store::StartRequested())
+        Run();
+}
+
+#endif /* SMO_STANDALONE */
@@ -0,0 +1,35 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoStore.h         - Standalone programming from recorded commands
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// The host records a complete programming session (enter programming mode,
+// erase, program, verify, fuses, lock bits) once. Afterwards, pressing the
+// START button replays it through the regular command handlers without a
+// host, and the status LEDs show the outcome: RDY for success, ERR for
+// failure.
+//
+// CMD_SCRATCHMONKEY_STORE
+//   [1]      SCRATCHMONKEY_STORE_BEGIN: Start a new recording
+//            SCRATCHMONKEY_STORE_RECORD: [2..3] body size, [4..] body,
+//              followed by the expected response data (response bytes
+//              from [2] on), if any
+//            SCRATCHMONKEY_STORE_END: Make the recording valid, keeping the
+//              current patches with it (see SMoPatch.h)
+//            SCRATCHMONKEY_STORE_RUN: Replay the recording now
+//   Response: status, for RUN followed by the index (2) of the failed record
+//
+
+#ifndef _SMO_STORE_
+#define _SMO_STORE_
+
+namespace SMoStore {
+    void Command();
+    void CheckStart();
+} // namespace SMoStore
+
+#endif /* _SMO_STORE_ */
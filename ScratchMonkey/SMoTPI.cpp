@@ -12,6 +12,9 @@
 #include "SMoGeneral.h"
 #include "SMoCommand.h"
 #include "SMoConfig.h"
+#include "SMoStats.h"
+#include "SMoSession.h"
+#include "SMoDevice.h"
 #include "SMoHWIF.h"
 #ifdef DEBUG_TPI
 #include "SMoDebug.h"
@@ -62,6 +65,10 @@ SMoTPI::EnterProgmode()
 #ifdef DEBUG_TPI
     SMoDebugInit();
 #endif
+    if (SMoSession::Resume(SMoSession::kTPI)) {
+        SMoCommand::SendXPROGResponse();
+        return;
+    }
     SMoHWIF::TPI::Setup();
     
     // Remove excessive guard bits
@@ -103,6 +110,10 @@ SMoTPI::EnterProgmode()
             break;
         }
     }
+    if (ok) {
+        SMoSession::Entered(SMoSession::kTPI);
+        SMoDevice::Identify(SMoSession::kTPI);
+    }
         
     SMoCommand::SendXPROGResponse(ok ? STATUS_CMD_OK : STATUS_CMD_FAILED);
 }
@@ -110,10 +121,17 @@ SMoTPI::EnterProgmode()
 void
 SMoTPI::LeaveProgmode()
 {
-    SMoHWIF::TPI::Stop();
+    if (!SMoSession::Hold(SMoSession::kTPI))
+        Stop();
     SMoCommand::SendXPROGResponse();
 }
 
+void
+SMoTPI::Stop()
+{
+    SMoHWIF::TPI::Stop();
+}
+
 static void
 SetPointerRegister(uint8_t * addr)
 {
@@ -133,11 +151,27 @@ SetNVMCommand(uint8_t cmd)
 static void
 PollNVMStatus()
 {
-    int res;
+    int      res;
+    uint32_t start = SMoStats::Now();
+    uint16_t polls = 0;
     do {
+        ++polls;
         SMoHWIF::TPI::SendByte(TPI_CMD_SIN | TPI_SIO_ADDR(TPI_IOREG_NVMCSR));
         res = SMoHWIF::TPI::ReadByte();
     } while (res & TPI_IOREG_NVMCSR_NVMBSY);
+    SMoStats::Polled(start, polls);
+}
+
+void
+SMoTPI::Signature(uint8_t * sig)
+{
+    uint8_t addr[4] = {0, 0, 0x3F, 0xC0};
+
+    SetPointerRegister(addr);
+    for (uint8_t i=0; i<3; ++i) {
+        SMoHWIF::TPI::SendByte(TPI_CMD_SLD_PI);
+        sig[i] = SMoHWIF::TPI::ReadByte();
+    }
 }
 
 void
@@ -170,6 +204,7 @@ SMoTPI::WriteMem()
     // uint8_t  wrMode  = SMoCommand::gBody[3];
     uint16_t    len     = (SMoCommand::gBody[8] <<  8) | SMoCommand::gBody[9];
 
+    SMoStats::Moved(SMoStats::kTPI, len);
     SetPointerRegister(&SMoCommand::gBody[4]);
     SetNVMCommand(TPI_NVMCMD_WORD_WRITE);
 
@@ -184,6 +219,8 @@ SMoTPI::WriteMem()
   
     SetNVMCommand(TPI_NVMCMD_NO_OPERATION);
     PollNVMStatus();
+    if (memType == XPRG_MEM_TYPE_FUSE || memType == XPRG_MEM_TYPE_LOCKBITS)
+        SMoSession::Drop();
   
     SMoCommand::SendXPROGResponse();
 }
@@ -191,9 +228,10 @@ SMoTPI::WriteMem()
 void
 SMoTPI::ReadMem()
 {
-    uint8_t     memType = SMoCommand::gBody[2];
+    // uint8_t  memType = SMoCommand::gBody[2];
     uint16_t    len     = (SMoCommand::gBody[7] <<  8) | SMoCommand::gBody[8];
 
+    SMoStats::Moved(SMoStats::kTPI, len);
     SetPointerRegister(&SMoCommand::gBody[3]);
 
     uint8_t *   data    = &SMoCommand::gBody[3];
@@ -13,6 +13,8 @@
 #ifndef _SMO_TPI_
 #define _SMO_TPI_
 
+#include <inttypes.h>
+
 namespace SMoTPI {
     void EnterProgmode();
     void LeaveProgmode();
@@ -20,6 +22,12 @@ namespace SMoTPI {
     void WriteMem();
     void ReadMem();
     void SetParam();
+    //
+    // For SMoSession: End programming mode without a response, read the
+    // three signature bytes
+    //
+    void Stop();
+    void Signature(uint8_t * sig);
 } // namespace SMoTPI
 
 #endif /* _SMO_TPI_ */
@@ -0,0 +1,226 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoTiming.cpp      - Adjustable bit timing for HVSP, HVPP and TPI
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#include "SMoTiming.h"
+#include "SMoCommand.h"
+#include "SMoGeneral.h"
+#include "SMoReadAhead.h"
+#include "SMoHWIF.h"
+
+#ifdef SMO_TIMING
+#include <avr/eeprom.h>
+#endif
+
+//
+// Datasheet minimums, see SMoHWIF_HVSP.h, SMoHVPP.cpp, SMoHWIF_TPI.h, and
+// the untuned delays, twice as long
+//
+static const uint8_t kMinimum[SMoTiming::kNumKnobs] = {
+    SMoSteps(SMoTiming::kHVSPMinNs),
+    SMoSteps(SMoTiming::kHVPPMinNs),
+    SMoSteps(SMoTiming::kTPIMinNs)
+};
+static const uint8_t kDefaults[SMoTiming::kNumKnobs] = {
+    SMoSteps(2*SMoTiming::kHVSPMinNs),
+    SMoSteps(2*SMoTiming::kHVPPMinNs),
+    SMoSteps(2*SMoTiming::kTPIMinNs)
+};
+
+uint8_t SMoTiming::gDelay[SMoTiming::kNumKnobs];
+bool    SMoTiming::gTuned;
+
+//
+// Never go faster than the datasheet allows
+//
+static uint8_t
+Clamp(uint8_t knob, uint8_t setting)
+{
+    if (setting > SMoTiming::kSlowest)
+        setting = SMoTiming::kSlowest;
+    return setting < kMinimum[knob] ? kMinimum[knob] : setting;
+}
+
+#ifdef SMO_TIMING
+//
+// Knobs are only valid for the clock they were measured at
+//
+struct Record {
+    uint8_t     fMagic;
+    uint8_t     fMHz;
+    uint8_t     fDelay[SMoTiming::kNumKnobs];
+    uint8_t     fCheck;
+};
+
+const uint8_t   kMagic      = 0x5E;
+const uint8_t   kMHz        = F_CPU / 1000000L;
+const uint8_t   kMaxProbe   = 16;
+const uint8_t   kMaxCompare = 32;
+
+static Record * const   sRecord = 0;    // EEPROM address
+static bool             sLoaded;
+
+static uint8_t
+Check(const Record & record)
+{
+    uint8_t check = 0xA5;
+    for (uint8_t i=0; i<SMoTiming::kNumKnobs; ++i)
+        check ^= record.fDelay[i];
+    return check;
+}
+#endif
+
+void
+SMoTiming::Setup()
+{
+    memcpy(gDelay, kDefaults, kNumKnobs);
+#ifdef SMO_TIMING
+    Record record;
+
+    eeprom_read_block(&record, sRecord, sizeof(record));
+    sLoaded = record.fMagic == kMagic && record.fMHz == kMHz && record.fCheck == Check(record);
+    if (sLoaded)
+        for (uint8_t i=0; i<kNumKnobs; ++i)
+            gDelay[i] = Clamp(i, record.fDelay[i]);
+    gTuned = sLoaded;
+#endif
+}
+
+#ifdef SMO_TIMING
+//
+// Run the probe command once, from the same address and never from the read
+// ahead buffer. Return true if it succeeded and the count bytes of its
+// response from [2] on match ref (or record them, if ref is to be filled in).
+//
+static bool
+Probe(const uint8_t * probe, uint8_t len, uint8_t count, uint8_t * ref, bool record)
+{
+    static uint32_t sAddress;
+
+    if (record)
+        sAddress = SMoGeneral::gAddress;
+    SMoGeneral::gAddress = sAddress;
+#ifdef SMO_READ_AHEAD
+    SMoReadAhead::Invalidate();
+#endif
+    memcpy(&SMoCommand::gBody[0], probe, len);
+    SMoCommand::gSize = len;
+    SMoCommand::DeferResponses(true);
+    SMoCommand::Dispatch(SMoCommand::gBody[0]);
+    uint8_t status = SMoCommand::DeferredStatus();
+    SMoCommand::DeferResponses(false);
+    if (status != STATUS_CMD_OK)
+        return false;
+    if (record)
+        memcpy(ref, &SMoCommand::gBody[2], count);
+    return !memcmp(ref, &SMoCommand::gBody[2], count);
+}
+
+static void
+Shmoo()
+{
+    const uint8_t   knob    = SMoCommand::gBody[2];
+    const uint8_t   repeats = SMoCommand::gBody[3];
+    const uint8_t   margin  = SMoCommand::gBody[4];
+    const uint8_t   count   = SMoCommand::gBody[5];
+    const uint8_t   len     = SMoCommand::gBody[6];
+    uint8_t         probe[kMaxProbe];
+    uint8_t         ref[kMaxCompare];
+
+    //
+    // The probe must be a plain STK command, none of our own
+    //
+    if (knob >= SMoTiming::kNumKnobs || !repeats || !len || len > kMaxProbe 
+     || count > kMaxCompare || SMoCommand::gSize < 7+len || (SMoCommand::gBody[7] & 0xF0) == 0xA0
+    ) {
+        SMoCommand::SendResponse(STATUS_CMD_FAILED);
+        return;
+    }
+    memcpy(probe, &SMoCommand::gBody[7], len);
+
+    const uint8_t   previous    = SMoTiming::gDelay[knob];
+    const bool      tuned       = SMoTiming::gTuned;
+    uint16_t        passed      = 0;
+
+    SMoTiming::gTuned       = true;
+    SMoTiming::gDelay[knob] = SMoTiming::kSlowest;
+    bool ok = Probe(probe, len, count, ref, true) && Probe(probe, len, count, ref, false);
+    if (ok) {
+        for (uint8_t setting = 0; setting <= SMoTiming::kSlowest; ++setting) {
+            SMoTiming::gDelay[knob] = setting;
+            uint8_t i = 0;
+            while (i < repeats && Probe(probe, len, count, ref, false))
+                ++i;
+            if (i == repeats)
+                passed |= 1 << setting;
+        }
+    }
+    //
+    // Fastest setting from which on everything slower passed as well
+    //
+    uint8_t fastest = SMoTiming::kSlowest+1;
+    while (fastest > 0 && (passed & (1 << (fastest-1))))
+        --fastest;
+    if (fastest > SMoTiming::kSlowest) {
+        SMoTiming::gDelay[knob] = previous;
+        SMoTiming::gTuned       = tuned;
+        ok = false;
+    } else {
+        SMoTiming::gDelay[knob] = Clamp(knob, fastest+margin < SMoTiming::kSlowest ? fastest+margin : SMoTiming::kSlowest);
+    }
+    SMoCommand::gBody[0] = CMD_SCRATCHMONKEY_TIMING;
+    SMoCommand::gBody[2] = passed >> 8;
+    SMoCommand::gBody[3] = passed & 0xFF;
+    SMoCommand::gBody[4] = SMoTiming::gDelay[knob];
+    SMoCommand::SendResponse(ok ? STATUS_CMD_OK : STATUS_CMD_FAILED, 5);
+}
+
+void
+SMoTiming::Command()
+{
+    Record record;
+
+    switch (SMoCommand::gBody[1]) {
+    case SCRATCHMONKEY_TIMING_GET:
+        memcpy(&SMoCommand::gBody[2], gDelay, kNumKnobs);
+        SMoCommand::gBody[2+kNumKnobs] = kMHz;
+        SMoCommand::gBody[3+kNumKnobs] = sLoaded;
+        SMoCommand::SendResponse(STATUS_CMD_OK, 4+kNumKnobs);
+        break;
+    case SCRATCHMONKEY_TIMING_SET:
+        for (uint8_t i=0; i<kNumKnobs; ++i)
+            gDelay[i] = Clamp(i, SMoCommand::gBody[2+i]);
+        gTuned          = true;
+        SMoCommand::SendResponse();
+        break;
+    case SCRATCHMONKEY_TIMING_SHMOO:
+        Shmoo();
+        break;
+    case SCRATCHMONKEY_TIMING_STORE:
+        record.fMagic   = kMagic;
+        record.fMHz     = kMHz;
+        memcpy(record.fDelay, gDelay, kNumKnobs);
+        record.fCheck   = Check(record);
+        eeprom_update_block(&record, sRecord, sizeof(record));
+        sLoaded         = true;
+        SMoCommand::SendResponse();
+        break;
+    case SCRATCHMONKEY_TIMING_CLEAR:
+        eeprom_update_byte(&sRecord->fMagic, 0xFF);
+        memcpy(gDelay, kDefaults, kNumKnobs);
+        gTuned          = false;
+        sLoaded         = false;
+        SMoCommand::SendResponse();
+        break;
+    default:
+        SMoCommand::SendResponse(STATUS_CMD_FAILED);
+        break;
+    }
+}
+#endif
@@ -0,0 +1,83 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoTiming.h        - Adjustable bit timing for HVSP, HVPP and TPI
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// The datasheet minimums (see SMoDelayNs() in SMoHWIF.h) say nothing about
+// the cables and level shifters between programmer and target. Each of the
+// three bit banged protocols has a knob, counted in steps of 3 cycles, that
+// can be swept to find out how much headroom a given setup has:
+//
+//   kHVSP      SCI high time in SMoHWIF_HVSP
+//   kHVPP      Settle time after a control change in HVPPSetControls()
+//   kTPI       TPI_CLK high and low times in SMoHWIF_TPI
+//
+// Out of the box, each protocol waits twice its datasheet minimum, timed
+// exactly by SMoDelayNs(). Once the knobs are tuned, they are timed by
+// SMoDelaySteps() instead, and may go as low as the datasheet minimum.
+// With SMO_TIMING defined (see SMoConfig.h), the knobs can be set, swept
+// and stored in the programmer's EEPROM, from where they are loaded at
+// startup (Tools/smoshmoo).
+//
+// CMD_SCRATCHMONKEY_TIMING
+//   [1]      SCRATCHMONKEY_TIMING_GET
+//              Response: status, knobs(3), F_CPU in MHz, 1 if loaded
+//              from EEPROM
+//            SCRATCHMONKEY_TIMING_SET: [2..4] knobs, raised to the
+//              datasheet minimums and capped at kSlowest, tunes them
+//            SCRATCHMONKEY_TIMING_SHMOO: [2] knob [3] repeats [4] margin
+//              [5] count [6] len [7..] body[len]
+//              Runs the STK command in body (typically a signature or
+//              flash read, always from the address loaded before the
+//              sweep) with the knob at kSlowest to record a reference
+//              of count response bytes from [2] on, then repeats times at
+//              each setting from 0 to kSlowest. Sets the knob to the fastest
+//              setting from which on all slower ones passed, plus margin.
+//              Response: status, pass map(2, bit i = setting i passed),
+//              new setting. Fails if even kSlowest does not work twice.
+//              Settings below the datasheet minimum are probed for the
+//              pass map, but never chosen. Tunes the knobs if it succeeds.
+//            SCRATCHMONKEY_TIMING_STORE: Save the knobs to EEPROM
+//            SCRATCHMONKEY_TIMING_CLEAR: Erase them there, back to the
+//              untuned defaults
+//
+// The target has to be in programming mode for the protocol swept.
+//
+
+#ifndef _SMO_TIMING_
+#define _SMO_TIMING_
+
+#include <inttypes.h>
+
+#include "SMoConfig.h"
+
+namespace SMoTiming {
+    enum {
+        kHVSP,
+        kHVPP,
+        kTPI,
+        kNumKnobs
+    };
+    enum {
+        kSlowest    = 15
+    };
+    //
+    // Datasheet minimums in ns
+    //
+    enum {
+        kHVSPMinNs  = 125,  // tSHSL
+        kHVPPMinNs  = 250,  // tOLDV, the longest wait after a control change
+        kTPIMinNs   = 200   // TPI_CLK pulse width
+    };
+    extern uint8_t  gDelay[kNumKnobs];
+    extern bool     gTuned;
+
+    void    Setup();
+    void    Command();
+} // namespace SMoTiming
+
+#endif /* _SMO_TIMING_ */
@@ -0,0 +1,94 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoTrace.cpp       - Binary event trace
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#include "SMoTrace.h"
+#include "SMoCommand.h"
+#include "SMoHWIF.h"
+
+#ifdef SMO_TRACE
+
+#if SMO_LAYOUT==SMO_LAYOUT_MEGA
+const uint16_t  kNumRecords     = 128;
+#else
+const uint16_t  kNumRecords     = 32;
+#endif
+const uint8_t   kRecordSize     = 10;
+
+struct Record {
+    uint8_t     fEvent;
+    uint8_t     fArg;
+    uint16_t    fA;
+    uint16_t    fB;
+    uint32_t    fTime;
+};
+
+static Record   sRecords[kNumRecords];
+static uint16_t sLogged;                // Sequence number of next record
+static bool     sFull;                  // All records in use
+
+void
+SMoTrace::Log(uint8_t event, uint8_t arg, uint16_t a, uint16_t b)
+{
+    Record & record = sRecords[sLogged++ & (kNumRecords-1)];
+    record.fEvent   = event;
+    record.fArg     = arg;
+    record.fA       = a;
+    record.fB       = b;
+    record.fTime    = SMoHWIF::Timer::Now();
+    if (sLogged == kNumRecords)
+        sFull       = true;
+}
+
+void
+SMoTrace::Command()
+{
+    uint8_t *   out     = &SMoCommand::gBody[2];
+    uint16_t    logged  = sLogged;
+
+    switch (SMoCommand::gBody[1]) {
+    case SCRATCHMONKEY_TRACE_CLEAR:
+        sLogged = 0;
+        sFull   = false;
+        break;
+    case SCRATCHMONKEY_TRACE_READ: {
+        uint16_t first  = (SMoCommand::gBody[2] << 8) | SMoCommand::gBody[3];
+        uint16_t kept   = sFull ? kNumRecords : logged;
+        if (uint16_t(logged-first) > kept)
+            first = logged-kept;
+        *out++ = SMoHWIF::Timer::kTickNs >> 8;
+        *out++ = SMoHWIF::Timer::kTickNs & 0xFF;
+        *out++ = logged >> 8;
+        *out++ = logged & 0xFF;
+        *out++ = first >> 8;
+        *out++ = first & 0xFF;
+        for (; first != logged; ++first) {
+            if (out+kRecordSize > &SMoCommand::gBody[SMoCommand::kMaxBodySize])
+                break;
+            const Record & record = sRecords[first & (kNumRecords-1)];
+            *out++ = record.fEvent;
+            *out++ = record.fArg;
+            *out++ = record.fA >> 8;
+            *out++ = record.fA & 0xFF;
+            *out++ = record.fB >> 8;
+            *out++ = record.fB & 0xFF;
+            *out++ = record.fTime >> 24;
+            *out++ = record.fTime >> 16;
+            *out++ = record.fTime >> 8;
+            *out++ = record.fTime & 0xFF;
+        }
+        break; }
+    default:
+        SMoCommand::SendResponse(STATUS_CMD_FAILED);
+        return;
+    }
+    SMoCommand::SendResponse(STATUS_CMD_OK, out-&SMoCommand::gBody[0]);
+}
+
+#endif /* SMO_TRACE */
@@ -0,0 +1,54 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoTrace.h         - Binary event trace
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// The DEBUG_ options print as they go, at 19200 baud, which slows down
+// programming so much that timing problems tend to disappear. With SMO_TRACE
+// defined (see SMoConfig.h), we just log fixed size records with a time stamp
+// into a ring buffer, and the host fetches them afterwards (Tools/smotrace).
+// Otherwise, Log() compiles to nothing.
+//
+// CMD_SCRATCHMONKEY_TRACE
+//   [1]      SCRATCHMONKEY_TRACE_CLEAR: Empty the buffer
+//            SCRATCHMONKEY_TRACE_READ: [2..3] sequence number of first record
+//              Response: status, tick length in ns(2), number of records
+//              logged(2), sequence number of first record returned(2),
+//              records: event(1) arg(1) a(2) b(2) time(4), as many as fit
+//   All values are big endian. Sequence numbers wrap around at 65536, and
+//   only the newest records are kept.
+//
+
+#ifndef _SMO_TRACE_
+#define _SMO_TRACE_
+
+#include <inttypes.h>
+
+#include "SMoConfig.h"
+
+namespace SMoTrace {
+    enum {                  // arg          a               b
+        kCommand    = 1,    // command      size
+        kResponse   = 2,    // status       size            deferred
+        kSPI        = 3,    // byte 1       bytes 2, 3      byte 4, result
+        kSPISlow    = 4,    // delay
+        kHVSP       = 5,    // instr        data in         data out
+        kHVPPCtrl   = 6,    // index        signals
+        kHVPPOut    = 7,    // data
+        kHVPPIn     = 8,    // data
+        kTPIOut     = 9,    // data
+        kTPIIn      = 10    // data         wait bits       0 ok, 1 parity, 2 no start bit
+    };
+#ifdef SMO_TRACE
+    void        Log(uint8_t event, uint8_t arg, uint16_t a = 0, uint16_t b = 0);
+    void        Command();
+#else
+    inline void Log(uint8_t, uint8_t, uint16_t = 0, uint16_t = 0) {}
+#endif
+} // namespace SMoTrace
+
+#endif /* _SMO_TRACE_ */
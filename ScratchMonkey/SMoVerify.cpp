@@ -0,0 +1,119 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoVerify.cpp      - Read back pages right after writing them
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#include "SMoVerify.h"
+#include "SMoGeneral.h"
+#include "SMoPageHash.h"
+
+#include <util/crc16.h>
+
+#ifdef SMO_VERIFY
+
+const uint8_t   kChunkSize  = 16;
+
+bool            SMoVerify::gEnabled;
+
+static uint32_t sLoadedAddress; // Where the loaded but unwritten data starts
+static uint32_t sLoadedNext;    // gAddress after loading it
+static uint16_t sLoadedBytes;
+static uint16_t sLoadedCRC;
+
+static uint32_t
+ByteAddress(uint32_t address, bool wordAddress)
+{
+    //
+    // Drop the extended address flags of ISP and HVPP
+    //
+    address &= 0x7FFFFF;
+    return wordAddress ? address << 1 : address;
+}
+
+static void
+PutLong(uint8_t * p, uint32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+void
+SMoVerify::Respond(uint32_t address, uint8_t offset, bool wordAddress)
+{
+    const uint8_t   mode        = SMoCommand::gBody[3];
+    const uint16_t  numBytes    = (SMoCommand::gBody[1] << 8) | SMoCommand::gBody[2];
+    const uint8_t * data        = &SMoCommand::gBody[offset];
+    const uint8_t   command     = SMoCommand::gBody[0]+1;  // CMD_READ_x follows CMD_PROGRAM_x
+    const uint32_t  next        = SMoGeneral::gAddress;
+    uint16_t        mismatches  = 0;
+    uint32_t        first       = 0xFFFFFFFF;
+    uint8_t         chunk[kChunkSize];
+
+    if (!gEnabled) {
+        sLoadedBytes = 0;
+        SMoCommand::SendResponse();
+        return;
+    }
+    if ((mode & 0x81) == 0x01) {
+        //
+        // Page buffer loaded, but not written yet
+        //
+        if (!sLoadedBytes || sLoadedNext != address) {
+            sLoadedAddress  = address;
+            sLoadedBytes    = 0;
+            sLoadedCRC      = 0xFFFF;
+        }
+        for (uint16_t i = 0; i < numBytes; ++i)
+            sLoadedCRC = _crc_ccitt_update(sLoadedCRC, data[i]);
+        sLoadedBytes   += numBytes;
+        sLoadedNext     = next;
+        SMoCommand::SendResponse();
+        return;
+    }
+    if (sLoadedBytes && sLoadedNext == address) {
+        uint16_t crc = 0xFFFF;
+        SMoGeneral::gAddress = sLoadedAddress;
+        for (uint16_t done = 0; done < sLoadedBytes; done += kChunkSize) {
+            uint8_t n = sLoadedBytes-done < kChunkSize ? sLoadedBytes-done : kChunkSize;
+            SMoPageHash::Read(command, chunk, n);
+            for (uint8_t i = 0; i < n; ++i)
+                crc = _crc_ccitt_update(crc, chunk[i]);
+        }
+        if (crc != sLoadedCRC) {
+            mismatches  = 1;
+            first       = ByteAddress(sLoadedAddress, wordAddress);
+        }
+    }
+    sLoadedBytes = 0;
+    SMoGeneral::gAddress = address;
+    for (uint16_t done = 0; done < numBytes; done += kChunkSize) {
+        uint8_t n = numBytes-done < kChunkSize ? numBytes-done : kChunkSize;
+        SMoPageHash::Read(command, chunk, n);
+        for (uint8_t i = 0; i < n; ++i)
+            if (chunk[i] != data[done+i] && !mismatches++)
+                first = ByteAddress(address, wordAddress)+done+i;
+    }
+    SMoGeneral::gAddress = next;
+
+    const uint8_t status = mismatches ? STATUS_CMD_FAILED : STATUS_CMD_OK;
+    if (SMoCommand::Deferring()) {
+        //
+        // gBody may still hold data the caller needs
+        //
+        SMoCommand::SendResponse(status);
+    } else {
+        SMoCommand::gBody[2] = mismatches >> 8;
+        SMoCommand::gBody[3] = mismatches & 0xFF;
+        PutLong(&SMoCommand::gBody[4], first);
+        SMoCommand::SendResponse(status, 8);
+    }
+}
+
+#endif /* SMO_VERIFY */
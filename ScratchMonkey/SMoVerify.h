@@ -0,0 +1,58 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoVerify.h        - Read back pages right after writing them
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// Verifying after programming normally takes a second pass reading the
+// whole memory back over the serial link. With SMO_VERIFY defined (see
+// SMoConfig.h) and PARAM_SCRATCHMONKEY_VERIFY set to 1, the ISP, HVSP and
+// HVPP flash and EEPROM program commands instead read each page back as
+// soon as it is written, compare it with the data still in gBody, and
+// extend their response:
+//
+//   Response: status (STATUS_CMD_FAILED on a mismatch), number of bytes
+//             differing(2), byte address(4) of the first one (0xFFFFFFFF
+//             if none)
+//
+// Commands run internally (SMoRegion, SMoStore, SMoScript) only pass on
+// the status. Data that an earlier command only loaded into the page
+// buffer (SMoRegion does that for pages split between frames) is gone by
+// the time the page is written, so it is checked against a CRC taken while
+// loading, and any difference there counts as a single byte at the start
+// of that data.
+//
+// Pages written through SMoHelper can't be read back, so the parameter
+// can't be set while the helper is running, nor the helper started with it.
+//
+// CMD_SIGN_ON turns the parameter off again, so avrdude always gets
+// standard responses.
+//
+
+#ifndef _SMO_VERIFY_
+#define _SMO_VERIFY_
+
+#include <inttypes.h>
+
+#include "SMoConfig.h"
+#include "SMoCommand.h"
+
+namespace SMoVerify {
+#ifdef SMO_VERIFY
+    extern bool gEnabled;
+
+    //
+    // Called by the program handlers instead of SendResponse() once the
+    // command succeeded. address is SMoGeneral::gAddress before the command,
+    // the data starts at gBody[offset], and the mode byte is gBody[3].
+    //
+    void    Respond(uint32_t address, uint8_t offset, bool wordAddress);
+#else
+    inline void Respond(uint32_t, uint8_t, bool) { SMoCommand::SendResponse(); }
+#endif
+} // namespace SMoVerify
+
+#endif /* _SMO_VERIFY_ */
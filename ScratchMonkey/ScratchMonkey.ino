@@ -34,6 +34,20 @@
 #include "SMoHVSP.h"
 #include "SMoHVPP.h"
 #include "SMoTPI.h"
+#include "SMoReadAhead.h"
+#include "SMoRegion.h"
+#include "SMoPageHash.h"
+#include "SMoStore.h"
+#include "SMoPatch.h"
+#include "SMoScript.h"
+#include "SMoStats.h"
+#include "SMoTrace.h"
+#include "SMoLink.h"
+#include "SMoTiming.h"
+#include "SMoCapture.h"
+#include "SMoDevice.h"
+#include "SMoHelper.h"
+#include "SMoSession.h"
 #include "SMoConfig.h"
 #include "SMoHWIF.h"
 
@@ -48,12 +62,50 @@ setup()
     SMoDebugInit();
 #endif
     SMoHWIF::Status::Setup();
+    SMoHWIF::Store::Setup();
+    SMoTiming::Setup();
+#ifdef SMO_WANT_TIMER
+    SMoHWIF::Timer::Setup();
+#endif
+}
+
+#if defined(SMO_WANT_TIMER) && defined(SMoHWIF_TIMER_OVF_vect)
+ISR(SMoHWIF_TIMER_OVF_vect)
+{
+    SMoHWIF::Timer::Overflow();
+}
+#endif
+
+#if defined(SMO_CAPTURE) && defined(SMoHWIF_SAMPLER_vect)
+ISR(SMoHWIF_SAMPLER_vect)
+{
+    SMoCapture::Sample();
 }
+#endif
 
 void
 loop()
 {
-    switch (SMoCommand::GetNextCommand()) {
+    int command = SMoCommand::GetNextCommand();
+#ifdef SMO_READ_AHEAD
+    SMoReadAhead::Check(command);
+#endif
+#ifdef SMO_STICKY_SESSION
+    SMoSession::Check(command);
+#endif
+#ifdef SMO_STANDALONE
+    if (command == SMoCommand::kIncomplete && !SMoCommand::Busy())
+        SMoStore::CheckStart();
+#endif
+    SMoStats::Begin(command);
+    SMoCommand::Dispatch(command);
+    SMoStats::End();
+}
+
+void
+SMoCommand::Dispatch(int command)
+{
+    switch (command) {
         //
         // General commands
         //
@@ -85,13 +137,13 @@ loop()
         SMoISP::ChipErase();    
         break;
     case CMD_PROGRAM_FLASH_ISP:
-        SMoISP::ProgramFlash();
+        SMoRegion::Program();
         break;
     case CMD_READ_FLASH_ISP:
         SMoISP::ReadFlash();
         break;
     case CMD_PROGRAM_EEPROM_ISP:
-        SMoISP::ProgramEEPROM();
+        SMoRegion::Program();
         break;
     case CMD_READ_EEPROM_ISP:
         SMoISP::ReadEEPROM();
@@ -132,13 +184,13 @@ loop()
         SMoHVSP::ChipErase();    
         break;
     case CMD_PROGRAM_FLASH_HVSP:
-        SMoHVSP::ProgramFlash();
+        SMoRegion::Program();
         break;
     case CMD_READ_FLASH_HVSP:
         SMoHVSP::ReadFlash();
         break;
     case CMD_PROGRAM_EEPROM_HVSP:
-        SMoHVSP::ProgramEEPROM();
+        SMoRegion::Program();
         break;
     case CMD_READ_EEPROM_HVSP:
         SMoHVSP::ReadEEPROM();
@@ -176,13 +228,13 @@ loop()
         SMoHVPP::ChipErase();    
         break;
     case CMD_PROGRAM_FLASH_PP:
-        SMoHVPP::ProgramFlash();
+        SMoRegion::Program();
         break;
     case CMD_READ_FLASH_PP:
         SMoHVPP::ReadFlash();
         break;
     case CMD_PROGRAM_EEPROM_PP:
-        SMoHVPP::ProgramEEPROM();
+        SMoRegion::Program();
         break;
     case CMD_READ_EEPROM_PP:
         SMoHVPP::ReadEEPROM();
@@ -239,6 +291,66 @@ loop()
             goto unknownMode;
         }
         break;
+        //
+        // ScratchMonkey Commands
+        //
+    case CMD_SCRATCHMONKEY_REGION_START:
+        SMoRegion::Start();
+        break;
+    case CMD_SCRATCHMONKEY_REGION_DATA:
+        SMoRegion::Data();
+        break;
+    case CMD_SCRATCHMONKEY_PAGE_HASH:
+        SMoPageHash::Compute();
+        break;
+    case CMD_SCRATCHMONKEY_SCRIPT:
+        SMoScript::Run();
+        break;
+#ifdef SMO_STATS
+    case CMD_SCRATCHMONKEY_STATS:
+        SMoStats::Command();
+        break;
+#endif
+#ifdef SMO_TRACE
+    case CMD_SCRATCHMONKEY_TRACE:
+        SMoTrace::Command();
+        break;
+#endif
+#ifdef SMO_LINK_TEST
+    case CMD_SCRATCHMONKEY_LINK:
+        SMoLink::Command();
+        break;
+#endif
+#ifdef SMO_TIMING
+    case CMD_SCRATCHMONKEY_TIMING:
+        SMoTiming::Command();
+        break;
+#endif
+#ifdef SMO_CAPTURE
+    case CMD_SCRATCHMONKEY_CAPTURE:
+        SMoCapture::Command();
+        break;
+#endif
+#ifdef SMO_DEVICES
+    case CMD_SCRATCHMONKEY_DEVICE:
+        SMoDevice::Command();
+        break;
+#endif
+#ifdef SMO_HELPER
+    case CMD_SCRATCHMONKEY_HELPER:
+        SMoHelper::Command();
+        break;
+#endif
+#ifdef SMO_PATCH
+    case CMD_SCRATCHMONKEY_PATCH:
+        SMoPatch::Command();
+        break;
+#endif
+#ifdef SMO_STANDALONE
+    case CMD_SCRATCHMONKEY_STORE:
+        SMoStore::Command();
+        break;
+#endif
         // Pseudocommands   
     case SMoCommand::kHeaderError:
     case SMoCommand::kChecksumError:
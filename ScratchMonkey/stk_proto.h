@@ -100,6 +100,88 @@
 
 #define CMD_JTAG_AVR                        0x90
 
+// *** ScratchMonkey specific commands ***
+
+// Program a whole region in a stream of data frames
+//  START: address(4) pageSize(2) length(4) programCmd params...
+//  DATA:  data...
+#define CMD_SCRATCHMONKEY_REGION_START      0xA0
+#define CMD_SCRATCHMONKEY_REGION_DATA       0xA1
+// Checksum pages to find the ones that need reflashing
+//  address(4) pageSize(2) numPages(2) readCmd
+#define CMD_SCRATCHMONKEY_PAGE_HASH         0xA2
+// Record commands for standalone operation
+//  BEGIN | RECORD bodySize(2) body expected... | END | RUN
+#define CMD_SCRATCHMONKEY_STORE             0xA3
+
+#define SCRATCHMONKEY_STORE_BEGIN           0x01
+#define SCRATCHMONKEY_STORE_RECORD          0x02
+#define SCRATCHMONKEY_STORE_END             0x03
+#define SCRATCHMONKEY_STORE_RUN             0x04
+// Merge per device data into programmed pages
+//  CLEAR | ADD flags address(4) data... | NEXT
+#define CMD_SCRATCHMONKEY_PATCH             0xA4
+
+#define SCRATCHMONKEY_PATCH_CLEAR           0x01
+#define SCRATCHMONKEY_PATCH_ADD             0x02
+#define SCRATCHMONKEY_PATCH_NEXT            0x03
+
+// Patch flags
+#define SCRATCHMONKEY_PATCH_EEPROM          0x01    // Otherwise flash
+#define SCRATCHMONKEY_PATCH_COUNTER         0x02    // Increment for every unit
+#define SCRATCHMONKEY_PATCH_BIG_ENDIAN      0x04    // Counter byte order
+// Run a sequence of steps (see SMoScript.h)
+#define CMD_SCRATCHMONKEY_SCRIPT            0xA5
+// Performance counters (see SMoStats.h)
+//  CLEAR | SUMMARY | COMMANDS first
+#define CMD_SCRATCHMONKEY_STATS             0xA6
+
+#define SCRATCHMONKEY_STATS_CLEAR           0x01
+#define SCRATCHMONKEY_STATS_SUMMARY         0x02
+#define SCRATCHMONKEY_STATS_COMMANDS        0x03
+// Binary event trace (see SMoTrace.h)
+//  CLEAR | READ first(2)
+#define CMD_SCRATCHMONKEY_TRACE             0xA7
+
+#define SCRATCHMONKEY_TRACE_CLEAR           0x01
+#define SCRATCHMONKEY_TRACE_READ            0x02
+// Link throughput self test (see SMoLink.h)
+//  SINK data... | SOURCE count(2) | ECHO data...
+#define CMD_SCRATCHMONKEY_LINK              0xA8
+
+#define SCRATCHMONKEY_LINK_SINK             0x01
+#define SCRATCHMONKEY_LINK_SOURCE           0x02
+#define SCRATCHMONKEY_LINK_ECHO             0x03
+// Adjustable bit timing (see SMoTiming.h)
+//  GET | SET knobs(3) | SHMOO knob repeats margin count len body | STORE | CLEAR
+#define CMD_SCRATCHMONKEY_TIMING            0xA9
+
+#define SCRATCHMONKEY_TIMING_GET            0x01
+#define SCRATCHMONKEY_TIMING_SET            0x02
+#define SCRATCHMONKEY_TIMING_SHMOO          0x03
+#define SCRATCHMONKEY_TIMING_STORE          0x04
+#define SCRATCHMONKEY_TIMING_CLEAR          0x05
+// Pin sampling while a command runs (see SMoCapture.h)
+//  RUN interval ports ports(3) len body | READ first(2)
+#define CMD_SCRATCHMONKEY_CAPTURE           0xAA
+
+#define SCRATCHMONKEY_CAPTURE_RUN           0x01
+#define SCRATCHMONKEY_CAPTURE_READ          0x02
+
+// What the device table says about the target (see SMoDevice.h)
+//  INFO | CONTROL_STACK
+#define CMD_SCRATCHMONKEY_DEVICE            0xAB
+
+#define SCRATCHMONKEY_DEVICE_INFO           0x01
+#define SCRATCHMONKEY_DEVICE_CONTROL_STACK  0x02
+
+// Two stage programming through a helper on the target (see SMoHelper.h)
+//  START | FINISH address(4)
+#define CMD_SCRATCHMONKEY_HELPER            0xAC
+
+#define SCRATCHMONKEY_HELPER_START          0x01
+#define SCRATCHMONKEY_HELPER_FINISH         0x02
+
 // *****************[ STK test command constants ]***************************
 
 #define CMD_ENTER_TESTMODE                  0x60
@@ -145,6 +227,10 @@ enum {
     SCRATCHMONKEY_VFY_LED   = (1<<2),
     SCRATCHMONKEY_ERR_LED   = (1<<3)
 };
+/* Seconds to hold a target in programming mode after leaving, see SMoSession.h */
+#define PARAM_SCRATCHMONKEY_STICKY          0x2B
+/* 1 to read back every page right after writing it, see SMoVerify.h */
+#define PARAM_SCRATCHMONKEY_VERIFY          0x2C
 
 /* STK500v2 parameters */
 #define PARAM_BUILD_NUMBER_LOW              0x80
@@ -195,6 +281,12 @@ enum {
 #define PARAM2_RC_ID_TABLE_REV              0xC8
 #define PARAM2_EC_ID_TABLE_REV              0xC9
 
+/* ScratchMonkey 2 byte parameters */
+// Largest command body we accept (read only)
+#define PARAM2_SCRATCHMONKEY_MAX_BODY       0xD0
+// Page size to split larger program commands by (0 = don't split), until sign on
+#define PARAM2_SCRATCHMONKEY_PAGE_SIZE      0xD1
+
 /* STK600 XPROG section */
 // XPROG modes
 #define XPRG_MODE_PDI                       0
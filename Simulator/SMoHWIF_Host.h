@@ -0,0 +1,63 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoHWIF_Host.h     - Native build layout, talking to simulated targets
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// Pin numbers follow the standard layout, so status LEDs and reset cost the
+// same number of pin accesses. The frame buffer is the Uno's as well, unless
+// the build asks for a different one. Like the Mega, it has an image store
+// for standalone programming.
+//
+
+#ifndef _SMO_HWIF_HOST_
+#define _SMO_HWIF_HOST_
+
+#include "SMoHWIF_Sim.h"
+
+#ifdef SMO_HOST_MAX_BODY
+const uint16_t SMoHWIF_MaxBodySize = SMO_HOST_MAX_BODY;
+#else
+const uint16_t SMoHWIF_MaxBodySize = 275;
+#endif
+
+typedef SMoHWIF_Debug_Hard<Serial1> SMoHWIF_Debug_Platform;
+
+typedef SMoHWIF_Status<
+    STATUS_RDY_PIN(5),
+    STATUS_PGM_PIN(7),
+    STATUS_VFY_PIN(6),
+    STATUS_ERR_PIN(8),
+    false>                                                  SMoHWIF_Status_Platform;
+
+typedef SMoHWIF_ISP_Sim<ISP_RESET_PIN(SS), ISP_CLOCK_PIN(9)> SMoHWIF_ISP_Platform;
+
+typedef SMoHWIF_HV<HV_RESET_PIN(10), HV_VCC_PIN(11),
+            SMoHWIF_VCC_Sim>                                SMoHWIF_HV_Platform;
+
+typedef SMoHWIF_HVSP_Sim<SMoHWIF_HV_Platform>               SMoHWIF_HVSP_Platform;
+
+typedef SMoHWIF_HVPP_Sim<SMoHWIF_HV_Platform>               SMoHWIF_HVPP_Platform;
+
+//
+// Builds may ask for the Uno's HVPP wiring, whose control port includes the
+// serial pins
+//
+#ifdef SMO_HOST_SHARE_SERIAL_PINS
+#define SMO_SHARE_SERIAL_PINS
+#endif
+
+typedef SMoHWIF_TPI_Sim<SMoHWIF_HV_Platform>                SMoHWIF_TPI_Platform;
+
+#define SMO_STANDALONE
+
+typedef SMoHWIF_Store_Sim                                   SMoHWIF_Store_Platform;
+
+typedef SMoHWIF_Timer_Sim                                   SMoHWIF_Timer_Platform;
+
+typedef SMoHWIF_Sampler_None                                SMoHWIF_Sampler_Platform;
+
+#endif /* _SMO_HWIF_HOST_ */
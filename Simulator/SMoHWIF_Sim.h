@@ -0,0 +1,289 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SMoHWIF_Sim.h      - Hardware interface to simulated targets
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// Same static interfaces as the real ISP / HVSP / HVPP / TPI templates, and
+// the same pin wiggling and delays where they take time, but the bits go to
+// SimTarget instead of the ports.
+//
+
+#ifndef _SMO_HWIF_SIM_
+#define _SMO_HWIF_SIM_
+
+#include "SimCore.h"
+#include "SimTarget.h"
+
+//
+// The cables to the simulated target need a few steps on each timing knob
+// (see SMoTiming.h), so a timing sweep has something to find. Any faster,
+// and the data read back gets garbled.
+//
+const uint8_t kSimHarnessSteps[SMoTiming::kNumKnobs] = {1, 2, 1};
+
+inline bool
+SimHarnessGarbles(uint8_t knob)
+{
+    return SMoTiming::gDelay[knob] < kSimHarnessSteps[knob];
+}
+
+template <ISP_RESET_PIN ISP_RESET, ISP_CLOCK_PIN MCU_CLOCK> class SMoHWIF_ISP_Sim {
+    static bool     sUsingHardwareSPI;
+    static int8_t   sSoftwareSPIDelay;
+public:
+    enum {
+        RESET = ISP_RESET,
+        CLOCK = MCU_CLOCK,
+    };
+    static void     SetupHardwareSPI() {
+        sUsingHardwareSPI = true;
+
+        digitalWrite(MISO,      LOW);
+        pinMode(MISO,           INPUT);
+        SimTarget::Select(SimTarget::kISP);
+    }
+    static void     SetupSoftwareSPI() {
+        sUsingHardwareSPI = false;
+        sSoftwareSPIDelay = 1;
+
+        pinMode(MOSI, OUTPUT);
+        pinMode(SCK, OUTPUT);
+        pinMode(MISO, INPUT);
+    }
+    static bool     UsingHardwareSPI() {
+        return sUsingHardwareSPI;
+    }
+    static bool     SlowdownSoftwareSPI() {
+        if (++sSoftwareSPIDelay >= 8)
+            return false;
+        SMoTrace::Log(SMoTrace::kSPISlow, sSoftwareSPIDelay);
+        return true;
+    }
+    static void     StopSPI() {
+        pinMode(MOSI, INPUT);
+        pinMode(SCK,  INPUT);
+    }
+    static void     SetupClock() {
+        pinMode(MCU_CLOCK, OUTPUT);
+    }
+    static void     StopClock() {
+    }
+    static uint8_t  Transfer(uint8_t out) {
+        if (sUsingHardwareSPI) {
+            const uint64_t kDivider =
+                SMoGeneral::gSCKDuration == 0 ? 8 : (SMoGeneral::gSCKDuration == 1 ? 32 : 128);
+            SimClock::Advance(SimCost::kSPICall + 8*kDivider*1000000000ULL/F_CPU);
+        } else {
+            SimClock::Advance(8*(4000ULL << sSoftwareSPIDelay) + 8*SimCost::kSoftSPIBit);
+        }
+        return SimTarget::ISPTransfer(out);
+    }
+};
+
+template <ISP_RESET_PIN ISP_RESET, ISP_CLOCK_PIN MCU_CLOCK> bool SMoHWIF_ISP_Sim<ISP_RESET,MCU_CLOCK>::sUsingHardwareSPI;
+template <ISP_RESET_PIN ISP_RESET, ISP_CLOCK_PIN MCU_CLOCK> int8_t SMoHWIF_ISP_Sim<ISP_RESET,MCU_CLOCK>::sSoftwareSPIDelay;
+
+template <typename HV_Platform> class SMoHWIF_HVSP_Sim {
+private:
+    enum {
+        HVSP_RESET = HV_Platform::RESET,
+        HVSP_VCC   = HV_Platform::VCC
+    };
+public:
+    static void Setup(uint8_t powOffDelay, uint8_t syncCycles) {
+        pinMode(HVSP_VCC, OUTPUT);
+        digitalWrite(HVSP_VCC, LOW);
+        digitalWrite(HVSP_RESET, HIGH);
+        pinMode(HVSP_RESET, OUTPUT);
+        SimTarget::Select(SimTarget::kHVSP);
+
+        HV_Platform::WaitVCC(false, powOffDelay);
+        digitalWrite(HVSP_VCC, HIGH);
+        delayMicroseconds(80);
+        for (uint8_t i=0; i<syncCycles; ++i)
+            delayMicroseconds(20);
+        digitalWrite(HVSP_RESET, LOW);
+        delayMicroseconds(20);
+        delayMicroseconds(300);
+    }
+    static void Stop() {
+        digitalWrite(HVSP_RESET, HIGH);
+    }
+    static uint8_t Transfer(uint8_t instr, uint8_t data) {
+        SimClock::Advance(SimCost::kHVSPByte);
+        SimDelayCycles(3*11*SMoTiming::gDelay[SMoTiming::kHVSP]);
+        uint8_t dataOut = SimTarget::HVSPTransfer(instr, data);
+        if (SimHarnessGarbles(SMoTiming::kHVSP))
+            dataOut ^= 0x01;
+        SMoTrace::Log(SMoTrace::kHVSP, instr, data, dataOut);
+        return dataOut;
+    }
+    static bool GetReady() {
+        SimClock::Advance(SimCost::kHVPPPort);
+        return SimTarget::Ready();
+    }
+};
+
+template <typename HV_Platform, HVPP_XTAL_PIN HVPP_XTAL = HVPP_XTAL_PIN(13)> class SMoHWIF_HVPP_Sim {
+private:
+    enum {
+        HVPP_RESET = HV_Platform::RESET,
+        HVPP_VCC   = HV_Platform::VCC
+    };
+public:
+    enum {
+        XTAL= HVPP_XTAL,
+    };
+    static void Setup(uint8_t initSignals, uint8_t powOffDelay, uint8_t latchCycles) {
+        pinMode(HVPP_VCC, OUTPUT);
+        digitalWrite(HVPP_VCC, LOW);
+        digitalWrite(HVPP_RESET, HIGH);
+        pinMode(HVPP_RESET, OUTPUT);
+        pinMode(HVPP_XTAL, OUTPUT);
+        digitalWrite(HVPP_XTAL, LOW);
+        SimTarget::Select(SimTarget::kHVPP);
+        DataMode(OUTPUT);
+        SetControlSignals(initSignals);
+
+        HV_Platform::WaitVCC(false, powOffDelay);
+        digitalWrite(HVPP_VCC, HIGH);
+        delayMicroseconds(50);
+        for (uint8_t i=0; i<latchCycles; ++i) {
+            digitalWrite(HVPP_XTAL, HIGH);
+            digitalWrite(HVPP_XTAL, LOW);
+        }
+        digitalWrite(HVPP_RESET, LOW);
+    }
+    static void Stop() {
+        digitalWrite(HVPP_RESET, HIGH);
+        digitalWrite(HVPP_VCC, LOW);
+    }
+    static void InitControlSignals() {
+        SimClock::Advance(SimCost::kHVPPPort);
+    }
+    static void SetControlSignals(uint8_t controls) {
+        SimClock::Advance(SimCost::kHVPPPort);
+        SimTarget::HVPPControl(controls);
+    }
+    static void DataMode(uint8_t) {
+        SimClock::Advance(SimCost::kHVPPPort);
+    }
+    static void SetData(uint8_t data) {
+        SimClock::Advance(SimCost::kHVPPPort);
+        SimTarget::HVPPSetData(data);
+    }
+    static uint8_t GetData() {
+        SimClock::Advance(SimCost::kHVPPPort);
+        return SimTarget::HVPPGetData() ^ (SimHarnessGarbles(SMoTiming::kHVPP) ? 0x80 : 0);
+    }
+    static void PulseXTAL() {
+        digitalWrite(HVPP_XTAL, HIGH);
+        SimTarget::HVPPPulseXTAL();
+        digitalWrite(HVPP_XTAL, LOW);
+    }
+    static bool GetReady() {
+        SimClock::Advance(SimCost::kHVPPPort);
+        return SimTarget::Ready();
+    }
+};
+
+template <typename HV_Platform> class SMoHWIF_TPI_Sim {
+private:
+    enum {
+        TPI_RESET = HV_Platform::RESET,
+        TPI_SVCC  = HV_Platform::VCC
+    };
+public:
+    static void Setup() {
+        pinMode(TPI_SVCC, OUTPUT);
+        digitalWrite(TPI_SVCC, LOW);
+        HV_Platform::WaitVCC(false, 150);
+        pinMode(TPI_RESET, OUTPUT);
+        digitalWrite(TPI_RESET, HIGH);
+        SimTarget::Select(SimTarget::kTPI);
+
+        digitalWrite(TPI_SVCC, HIGH);
+        HV_Platform::WaitVCC(true, 150);
+
+        digitalWrite(TPI_RESET, LOW);
+        delay(10);
+
+        SimClock::Advance(32*SimCost::kTPIBit);
+    }
+    static void Stop() {
+        digitalWrite(TPI_RESET, HIGH);
+    }
+    static void SendByte(uint8_t byte) {
+        SMoTrace::Log(SMoTrace::kTPIOut, byte);
+        SimClock::Advance(12*SimCost::kTPIBit);
+        SimDelayCycles(3*12*SMoTiming::gDelay[SMoTiming::kTPI]);
+        SimTarget::TPIReceive(byte);
+    }
+    static int ReadByte() {
+        uint16_t idle;
+        int      byte = SimTarget::TPITransmit(idle);
+        if (byte < 0) {
+            SimClock::Advance(256*SimCost::kTPIBit);
+            SMoTrace::Log(SMoTrace::kTPIIn, 0, 256, 2);
+            return -1;
+        }
+        SimClock::Advance((idle+12)*SimCost::kTPIBit);
+        SimDelayCycles(uint32_t(SMoTiming::gDelay[SMoTiming::kTPI])*6*(idle+12));
+        if (SimHarnessGarbles(SMoTiming::kTPI))
+            byte ^= 0x01;
+        SMoTrace::Log(SMoTrace::kTPIIn, byte, idle, 0);
+        return byte;
+    }
+};
+
+//
+// ADC conversions at 125kHz on the target supply
+//
+class SMoHWIF_VCC_Sim {
+public:
+    enum { SENSED = true };
+    static void Setup() {
+        delay(1);
+    }
+    static void Stop() {}
+    static uint16_t Millivolts() {
+        SimClock::Advance(104000);
+        return SimTarget::VCCMillivolts();
+    }
+};
+
+class SMoHWIF_Store_Sim {
+public:
+    enum {
+        kPageSize   = SimStore::kPageSize,
+        kSectorSize = SimStore::kSectorSize
+    };
+    static void Setup() {}
+    static void Read(uint32_t address, uint8_t * data, uint16_t numBytes) {
+        SimStore::Read(address, data, numBytes);
+    }
+    static void EraseSector(uint32_t address) {
+        SimStore::EraseSector(address);
+    }
+    static void WritePage(uint32_t address, const uint8_t * data, uint16_t numBytes) {
+        SimStore::WritePage(address, data, numBytes);
+    }
+    static bool StartRequested() {
+        return SimStore::StartPressed();
+    }
+};
+
+class SMoHWIF_Timer_Sim {
+public:
+    enum { kTickNs = 500 };
+
+    static void Setup() {}
+    static void Overflow() {}
+    static uint32_t Now() { return SimClock::Now() / kTickNs; }
+};
+
+#endif /* _SMO_HWIF_SIM_ */
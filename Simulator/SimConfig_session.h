@@ -0,0 +1,13 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SimConfig_session.h - smopty-session: Sticky sessions, with the Uno's
+//                            HVPP wiring sharing the serial pins
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#define SMO_STICKY_SESSION
+#define SMO_HOST_SHARE_SERIAL_PINS
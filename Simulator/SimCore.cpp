@@ -0,0 +1,443 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SimCore.cpp        - Simulated clock, pins and serial link for the native build
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#include "SimCore.h"
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <avr/eeprom.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+volatile uint8_t    SimRegisters[0x200];
+uint8_t             SimEEPROM[E2END+1];
+SPIClass            SPI;
+HardwareSerial      Serial(0);
+HardwareSerial      Serial1(1);
+
+static uint64_t     sNow;
+
+uint64_t
+SimClock::Now()
+{
+    return sNow;
+}
+
+void
+SimClock::Advance(uint64_t ns)
+{
+    sNow += ns;
+}
+
+void
+SimClock::AdvanceTo(uint64_t ns)
+{
+    if (ns > sNow)
+        sNow = ns;
+}
+
+void
+SimClock::Reset()
+{
+    sNow = 0;
+}
+
+//
+// Pins
+//
+static uint8_t              sLevels[NUM_DIGITAL_PINS];
+static SimPins::Observer    sObserver;
+
+//
+// Undriven pins read high, the way the target's RESET pull-up holds them
+//
+static struct PinInit {
+    PinInit() { memset(sLevels, HIGH, sizeof(sLevels)); memset(SimEEPROM, 0xFF, sizeof(SimEEPROM)); }
+} sPinInit;
+
+uint8_t
+SimPins::Level(uint8_t pin)
+{
+    return pin < NUM_DIGITAL_PINS ? sLevels[pin] : LOW;
+}
+
+void
+SimPins::SetObserver(Observer observer)
+{
+    sObserver = observer;
+}
+
+void
+pinMode(uint8_t, uint8_t)
+{
+    SimClock::Advance(SimCost::kPinAccess);
+}
+
+void
+digitalWrite(uint8_t pin, uint8_t value)
+{
+    SimClock::Advance(SimCost::kPinAccess);
+    value = value != LOW;
+    if (pin >= NUM_DIGITAL_PINS || sLevels[pin] == value)
+        return;
+    sLevels[pin] = value;
+    if (sObserver)
+        sObserver(pin, value);
+}
+
+int
+digitalRead(uint8_t pin)
+{
+    SimClock::Advance(SimCost::kPinAccess);
+    return SimPins::Level(pin);
+}
+
+//
+// Time
+//
+unsigned long
+millis()
+{
+    SimClock::Advance(SimCost::kTimeQuery);
+    return SimClock::Now() / 1000000;
+}
+
+unsigned long
+micros()
+{
+    SimClock::Advance(SimCost::kTimeQuery);
+    return SimClock::Now() / 1000;
+}
+
+void
+delay(unsigned long ms)
+{
+    SimClock::Advance(uint64_t(ms) * 1000000);
+}
+
+void
+delayMicroseconds(unsigned int us)
+{
+    SimClock::Advance(uint64_t(us) * 1000);
+}
+
+void
+SimDelayCycles(unsigned long cycles)
+{
+    SimClock::Advance(uint64_t(cycles) * 1000000000 / F_CPU);
+}
+
+//
+// Print
+//
+size_t
+Print::write(const uint8_t * buffer, size_t size)
+{
+    for (size_t i=0; i<size; ++i)
+        write(buffer[i]);
+    return size;
+}
+
+static size_t
+PrintNumber(Print & port, unsigned long n, bool negative, int base)
+{
+    char    buf[8*sizeof(long)+2];
+    char *  p = &buf[sizeof(buf)-1];
+
+    *p = 0;
+    do {
+        int digit = n % base;
+        *--p = digit < 10 ? '0'+digit : 'A'+digit-10;
+        n /= base;
+    } while (n);
+    if (negative)
+        *--p = '-';
+    return port.write(p);
+}
+
+size_t
+Print::print(long n, int base)
+{
+    if (base == DEC && n < 0)
+        return PrintNumber(*this, -n, true, base);
+    return PrintNumber(*this, n, false, base);
+}
+
+size_t
+Print::print(unsigned long n, int base)
+{
+    return PrintNumber(*this, n, false, base);
+}
+
+size_t
+Print::print(double n, int digits)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return write(buf);
+}
+
+//
+// Serial link. The receive side has the 63 usable bytes of the Arduino
+// core's ring buffer, bytes arriving while it is full are lost. The transmit
+// side blocks while its buffer is full, then sends back to back.
+//
+const size_t        kRxCapacity = SERIAL_RX_BUFFER_SIZE-1;
+const size_t        kTxCapacity = SERIAL_TX_BUFFER_SIZE-1;
+
+struct TimedByte {
+    uint64_t    fTime;
+    uint8_t     fByte;
+};
+
+static std::deque<TimedByte>    sInFlight;      // Host to sketch, not yet arrived
+static std::deque<uint8_t>      sRxBuffer;
+static uint64_t                 sRxLineFree;
+static uint32_t                 sOverruns;
+static std::deque<TimedByte>    sTxQueue;       // Sketch to host, not yet sent
+static std::deque<TimedByte>    sDelivered;     // Sketch to host, sent
+static uint64_t                 sTxLineFree;
+static uint64_t                 sLastReceived;
+
+uint64_t
+SimLink::ByteTime()
+{
+    unsigned long baud = Serial.Baud() ? Serial.Baud() : 115200;
+
+    return 10000000000ULL / baud;   // 8N1
+}
+
+static void
+ArriveRx()
+{
+    while (!sInFlight.empty() && sInFlight.front().fTime <= SimClock::Now()) {
+        if (sRxBuffer.size() < kRxCapacity)
+            sRxBuffer.push_back(sInFlight.front().fByte);
+        else
+            ++sOverruns;
+        sInFlight.pop_front();
+    }
+}
+
+static void
+DeliverTx()
+{
+    while (!sTxQueue.empty() && sTxQueue.front().fTime <= SimClock::Now()) {
+        sDelivered.push_back(sTxQueue.front());
+        sTxQueue.pop_front();
+    }
+}
+
+void
+SimLink::Send(const uint8_t * data, size_t size, uint64_t notBefore)
+{
+    uint64_t t = std::max(notBefore, sRxLineFree);
+    for (size_t i=0; i<size; ++i) {
+        t += ByteTime();
+        sInFlight.push_back(TimedByte{t, data[i]});
+    }
+    sRxLineFree = t;
+}
+
+bool
+SimLink::Receive(uint8_t & byte, uint64_t deadline)
+{
+    for (;;) {
+        DeliverTx();
+        if (!sDelivered.empty()) {
+            byte            = sDelivered.front().fByte;
+            sLastReceived   = sDelivered.front().fTime;
+            sDelivered.pop_front();
+            return true;
+        }
+        if (SimClock::Now() > deadline)
+            return false;
+        SimClock::Advance(SimCost::kLoop);
+        loop();
+    }
+}
+
+uint64_t
+SimLink::LastReceived()
+{
+    return sLastReceived;
+}
+
+uint32_t
+SimLink::Overruns()
+{
+    return sOverruns;
+}
+
+void
+SimLink::Reset()
+{
+    sInFlight.clear();
+    sRxBuffer.clear();
+    sTxQueue.clear();
+    sDelivered.clear();
+    sRxLineFree = sTxLineFree = sLastReceived = SimClock::Now();
+    sOverruns   = 0;
+}
+
+void
+HardwareSerial::begin(unsigned long baud)
+{
+    fBaud = baud;
+}
+
+void
+HardwareSerial::end()
+{
+    if (!fIndex)
+        flush();
+}
+
+int
+HardwareSerial::available()
+{
+    if (fIndex)
+        return 0;
+    SimClock::Advance(SimCost::kSerialAccess);
+    ArriveRx();
+    return sRxBuffer.size();
+}
+
+int
+HardwareSerial::peek()
+{
+    if (fIndex)
+        return -1;
+    SimClock::Advance(SimCost::kSerialAccess);
+    ArriveRx();
+    return sRxBuffer.empty() ? -1 : sRxBuffer.front();
+}
+
+int
+HardwareSerial::read()
+{
+    int c = peek();
+    if (c >= 0)
+        sRxBuffer.pop_front();
+    return c;
+}
+
+size_t
+HardwareSerial::write(uint8_t c)
+{
+    if (fIndex) {
+        fputc(c, stderr);
+        return 1;
+    }
+    SimClock::Advance(SimCost::kSerialAccess);
+    //
+    // Wait for room in the buffer. The byte currently in the shift register
+    // does not count against it.
+    //
+    DeliverTx();
+    while (sTxQueue.size() > kTxCapacity) {
+        SimClock::AdvanceTo(sTxQueue.front().fTime);
+        DeliverTx();
+    }
+    sTxLineFree = std::max(sTxLineFree, SimClock::Now()) + SimLink::ByteTime();
+    sTxQueue.push_back(TimedByte{sTxLineFree, c});
+
+    return 1;
+}
+
+size_t
+HardwareSerial::write(const uint8_t * buffer, size_t size)
+{
+    for (size_t i=0; i<size; ++i)
+        write(buffer[i]);
+    return size;
+}
+
+void
+HardwareSerial::flush()
+{
+    if (!fIndex)
+        SimClock::AdvanceTo(sTxLineFree);
+}
+
+//
+// Image store
+//
+const uint64_t      kStoreByteNs    =     4000;     // Bit banged, 8 bits
+const uint64_t      kStorePageNs    =   700000;
+const uint64_t      kStoreSectorNs  = 45000000;
+
+static std::vector<uint8_t>     sStore(SimStore::kSize, 0xFF);
+static bool                     sStartPressed;
+
+void
+SimStore::Read(uint32_t address, uint8_t * data, uint16_t numBytes)
+{
+    SimClock::Advance((4+numBytes)*kStoreByteNs);
+    while (numBytes--)
+        *data++ = sStore[address++ % kSize];
+}
+
+void
+SimStore::EraseSector(uint32_t address)
+{
+    SimClock::Advance(6*kStoreByteNs + kStoreSectorNs);
+    address = address % kSize / kSectorSize * kSectorSize;
+    memset(&sStore[address], 0xFF, kSectorSize);
+}
+
+void
+SimStore::WritePage(uint32_t address, const uint8_t * data, uint16_t numBytes)
+{
+    SimClock::Advance((6+numBytes)*kStoreByteNs + kStorePageNs);
+    address %= kSize;
+    uint32_t page = address / kPageSize * kPageSize;
+    while (numBytes--) {
+        sStore[address] &= *data++;
+        address = page + (address+1) % kPageSize;
+    }
+}
+
+bool
+SimStore::Load(const char * path)
+{
+    FILE * f = fopen(path, "rb");
+    if (!f)
+        return false;
+    bool ok = fread(&sStore[0], 1, kSize, f) == kSize;
+    fclose(f);
+    return ok;
+}
+
+bool
+SimStore::Save(const char * path)
+{
+    FILE * f = fopen(path, "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(&sStore[0], 1, kSize, f) == kSize;
+    return !fclose(f) && ok;
+}
+
+void
+SimStore::PressStart()
+{
+    sStartPressed = true;
+}
+
+bool
+SimStore::StartPressed()
+{
+    bool pressed    = sStartPressed;
+    sStartPressed   = false;
+    return pressed;
+}
@@ -0,0 +1,121 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SimCore.h          - Simulated clock, pins and serial link for the native build
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// The whole simulation runs on a single clock, counted in nanoseconds. The
+// sketch advances it by calling delay() and friends, and by every pin or bus
+// operation, each of which costs roughly what it takes on a 16MHz Uno. The
+// host side of the serial link does not have a clock of its own: Whenever it
+// waits for a response, it runs loop() until the bytes have gone over the
+// wire.
+//
+// The costs are estimates from instruction counts of the Arduino core and
+// the HWIF templates, not measurements. They are good enough to tell whether
+// a change makes the sketch faster or slower, not to predict wall clock time
+// to the last percent.
+//
+
+#ifndef _SIM_CORE_
+#define _SIM_CORE_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <vector>
+
+namespace SimClock {
+    uint64_t    Now();
+    void        Advance(uint64_t ns);
+    void        AdvanceTo(uint64_t ns);
+    void        Reset();
+} // namespace SimClock
+
+//
+// Cost of common operations on the programmer, in nanoseconds
+//
+namespace SimCost {
+    const uint64_t  kPinAccess      =  4000;    // digitalWrite / digitalRead / pinMode
+    const uint64_t  kTimeQuery      =  2000;    // millis() / micros()
+    const uint64_t  kSerialAccess   =  1000;    // Serial.available() / read() / write()
+    const uint64_t  kLoop           =  5000;    // One pass through loop() with no work
+    const uint64_t  kSPICall        =  1000;    // SPI.transfer() overhead, on top of the bits
+    const uint64_t  kSoftSPIBit     = 16000;    // 4 pin accesses per bit in limp mode
+    const uint64_t  kHVSPByte       = 12000;    // 11 bits, 4 port accesses each
+    const uint64_t  kHVPPPort       =  1000;    // Setting or reading a port
+    const uint64_t  kTPIBit         =   625;    // 2 port accesses, delays on top
+} // namespace SimCost
+
+//
+// Pin levels as the sketch last set them, so the target models can react
+//
+namespace SimPins {
+    typedef void (*Observer)(uint8_t pin, uint8_t value);
+
+    uint8_t     Level(uint8_t pin);
+    void        SetObserver(Observer observer);
+} // namespace SimPins
+
+//
+// Host side of the serial link
+//
+namespace SimLink {
+    //
+    // Bytes arrive back to back at the baud rate set by the sketch, starting
+    // no earlier than notBefore. That may lie in the past if the sketch was
+    // busy for longer than the host took to respond.
+    //
+    void        Send(const uint8_t * data, size_t size, uint64_t notBefore);
+    //
+    // Bytes fully transmitted by the sketch, with the time the last stop
+    // bit went over the wire. Runs loop() until at least one byte is there
+    // or the deadline has passed.
+    //
+    bool        Receive(uint8_t & byte, uint64_t deadline);
+    uint64_t    LastReceived();
+    //
+    // Bytes dropped because the sketch did not read them in time
+    //
+    uint32_t    Overruns();
+    void        Reset();
+    uint64_t    ByteTime();
+} // namespace SimLink
+
+//
+// The programmer's image store (see SMoStore.h): A 1MB 25 series SPI flash,
+// with data sheet typical timing, and the START button
+//
+namespace SimStore {
+    const uint32_t  kSize           = 0x100000;
+    const uint16_t  kPageSize       = 256;
+    const uint16_t  kSectorSize     = 4096;
+
+    void        Read(uint32_t address, uint8_t * data, uint16_t numBytes);
+    void        EraseSector(uint32_t address);
+    //
+    // Programming only clears bits, and wraps around within the page
+    //
+    void        WritePage(uint32_t address, const uint8_t * data, uint16_t numBytes);
+    //
+    // Keep the contents in a file across runs
+    //
+    bool        Load(const char * path);
+    bool        Save(const char * path);
+    //
+    // The button is pressed once and read back once
+    //
+    void        PressStart();
+    bool        StartPressed();
+} // namespace SimStore
+
+//
+// The sketch entry points
+//
+void setup();
+void loop();
+
+#endif /* _SIM_CORE_ */
@@ -0,0 +1,70 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SimHost.cpp        - Wall clock, pseudo terminals and serial ports for the host tools
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#include "SimHost.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+uint64_t
+SimHost::WallClock()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec)*1000000000ULL + ts.tv_nsec;
+}
+
+int
+SimHost::OpenPTY(int & slave)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+        perror("posix_openpt");
+        exit(1);
+    }
+    slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    if (slave < 0) {
+        perror("open pty slave");
+        exit(1);
+    }
+    struct termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    return master;
+}
+
+const char *
+SimHost::PTYName(int master)
+{
+    return ptsname(master);
+}
+
+int
+SimHost::OpenSerial(const char * port)
+{
+    int fd = open(port, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+        return -1;
+    struct termios tio;
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    cfsetspeed(&tio, B115200);
+    tio.c_cflag |= CLOCAL | CREAD | HUPCL;
+    tcsetattr(fd, TCSANOW, &tio);
+
+    return fd;
+}
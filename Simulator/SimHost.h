@@ -0,0 +1,34 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SimHost.h          - Wall clock, pseudo terminals and serial ports for the host tools
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#ifndef _SIM_HOST_
+#define _SIM_HOST_
+
+#include <stdint.h>
+
+namespace SimHost {
+    //
+    // Monotonic time in nanoseconds
+    //
+    uint64_t    WallClock();
+    //
+    // Master side of a new raw pseudo terminal. The slave side is kept open
+    // as well, so nothing echoes before the client configures the port, and
+    // a client closing it does not hang us up. Exits on failure.
+    //
+    int         OpenPTY(int & slave);
+    const char *PTYName(int master);
+    //
+    // Raw 115200 baud serial port, or -1
+    //
+    int         OpenSerial(const char * port);
+} // namespace SimHost
+
+#endif /* _SIM_HOST_ */
@@ -0,0 +1,535 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SimSession.cpp     - Host side of a programming session, avrdude style
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#include "SimSession.h"
+#include "SimCore.h"
+#include "SimHost.h"
+#include "stk_proto.h"
+
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <algorithm>
+
+using SimSession::Bytes;
+
+const uint64_t  kResponseTimeout    = 10000000000ULL;   // 10s simulated
+const size_t    kReadBlock          = 256;
+const uint64_t  kFuseWriteDelay     = 4500000;          // avrdude's max_write_delay
+
+//
+// avrdude's control stack for ATmega HVPP, see SimTarget.h
+//
+static const uint8_t sControlStack[32] = {
+    0x0E, 0x1E, 0x0F, 0x1F, 0x2E, 0x3E, 0x2F, 0x3F,
+    0x4E, 0x5E, 0x4F, 0x5F, 0x6E, 0x7E, 0x6F, 0x7F,
+    0x66, 0x76, 0x67, 0x77, 0x6A, 0x7A, 0x6B, 0x7B,
+    0xBE, 0xFD, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00
+};
+
+static int                  sPort = -1;
+static uint64_t             sTimeout = kResponseTimeout;
+static uint64_t             sLatency;
+static uint64_t             sHostTime;
+static uint8_t              sSequence;
+static std::string          sError;
+static SimTarget::Protocol  sProtocol;
+static const SimPart *      sPart;
+
+static bool
+Fail(const char * format, int a = 0, int b = 0)
+{
+    char message[128];
+    snprintf(message, sizeof(message), format, a, b);
+    sError = message;
+    return false;
+}
+
+void
+SimSession::Begin(uint64_t latencyNs)
+{
+    sLatency    = latencyNs;
+    sHostTime   = sPort < 0 ? SimClock::Now() : SimHost::WallClock();
+    sError.clear();
+}
+
+uint64_t
+SimSession::Time()
+{
+    return sHostTime;
+}
+
+bool
+SimSession::Open(const char * port)
+{
+    sPort = SimHost::OpenSerial(port);
+    if (sPort < 0)
+        return Fail("Can't open serial port");
+
+    //
+    // Opening the port resets most boards, so give the bootloader time to
+    // hand over to the sketch, the way avrdude retries its sign on.
+    //
+    sTimeout = 500000000;
+    for (int attempt=0; attempt<10; ++attempt) {
+        tcflush(sPort, TCIOFLUSH);
+        sHostTime = SimHost::WallClock();
+        if (Command(Bytes(1, CMD_SIGN_ON))) {
+            sTimeout = kResponseTimeout;
+            return true;
+        }
+    }
+    sTimeout = kResponseTimeout;
+    return false;
+}
+
+bool
+SimSession::IsOpen()
+{
+    return sPort >= 0;
+}
+
+const std::string &
+SimSession::Error()
+{
+    return sError;
+}
+
+static bool
+ReceiveByte(uint8_t & byte, uint64_t deadline)
+{
+    if (sPort < 0)
+        return SimLink::Receive(byte, deadline);
+    for (;;) {
+        if (read(sPort, &byte, 1) == 1)
+            return true;
+        int64_t wait = int64_t(deadline) - int64_t(SimHost::WallClock());
+        if (wait <= 0)
+            return false;
+        struct pollfd pfd = {sPort, POLLIN, 0};
+        poll(&pfd, 1, int(wait / 1000000) + 1);
+    }
+}
+
+void
+SimSession::Wait(uint64_t ns)
+{
+    sHostTime += ns;
+}
+
+bool
+SimSession::Transact(const Bytes & body, Bytes & reply)
+{
+    Bytes frame;
+    frame.push_back(MESSAGE_START);
+    frame.push_back(++sSequence);
+    frame.push_back(body.size() >> 8);
+    frame.push_back(body.size() & 0xFF);
+    frame.push_back(TOKEN);
+    frame.insert(frame.end(), body.begin(), body.end());
+    uint8_t checksum = 0;
+    for (size_t i=0; i<frame.size(); ++i)
+        checksum ^= frame[i];
+    frame.push_back(checksum);
+    uint64_t    deadline;
+    if (sPort < 0) {
+        SimLink::Send(&frame[0], frame.size(), sHostTime);
+        deadline = std::max(sHostTime, SimClock::Now()) + sTimeout;
+    } else {
+        if (write(sPort, &frame[0], frame.size()) != ssize_t(frame.size()))
+            return Fail("Command %02X: write failed", body[0]);
+        deadline = SimHost::WallClock() + sTimeout;
+    }
+    uint8_t     header[5];
+    do {
+        if (!ReceiveByte(header[0], deadline))
+            return Fail("Command %02X timed out", body[0]);
+    } while (header[0] != MESSAGE_START);
+    for (int i=1; i<5; ++i)
+        if (!ReceiveByte(header[i], deadline))
+            return Fail("Command %02X timed out", body[0]);
+    if (header[1] != sSequence || header[4] != TOKEN)
+        return Fail("Command %02X: garbled response header", body[0]);
+    reply.resize((header[2] << 8) | header[3]);
+    checksum = header[0]^header[1]^header[2]^header[3]^header[4];
+    for (size_t i=0; i<reply.size(); ++i) {
+        if (!ReceiveByte(reply[i], deadline))
+            return Fail("Command %02X timed out", body[0]);
+        checksum ^= reply[i];
+    }
+    uint8_t sum;
+    if (!ReceiveByte(sum, deadline))
+        return Fail("Command %02X timed out", body[0]);
+    sHostTime = sPort < 0 ? SimLink::LastReceived() + sLatency : SimHost::WallClock();
+    if (sum != checksum)
+        return Fail("Command %02X: bad response checksum", body[0]);
+    return true;
+}
+
+bool
+SimSession::Command(const Bytes & body, Bytes * response)
+{
+    Bytes reply;
+    if (!Transact(body, reply))
+        return false;
+    size_t statusIx = body[0] == CMD_XPROG ? 2 : 1;
+    if (reply.size() <= statusIx || reply[0] != body[0])
+        return Fail("Command %02X: unexpected response", body[0]);
+    if (reply[statusIx] != STATUS_CMD_OK)
+        return Fail("Command %02X failed with status %02X", body[0], reply[statusIx]);
+    if (response)
+        response->swap(reply);
+    return true;
+}
+
+static void
+Append32(Bytes & body, uint32_t value)
+{
+    body.push_back(value >> 24);
+    body.push_back((value >> 16) & 0xFF);
+    body.push_back((value >> 8) & 0xFF);
+    body.push_back(value & 0xFF);
+}
+
+static void
+Append16(Bytes & body, uint16_t value)
+{
+    body.push_back(value >> 8);
+    body.push_back(value & 0xFF);
+}
+
+static bool
+LoadAddress(uint32_t address)
+{
+    Bytes body(1, CMD_LOAD_ADDRESS);
+    Append32(body, address);
+    return SimSession::Command(body);
+}
+
+//
+// TPI memories are mapped into the data space
+//
+enum {
+    kTPIFlash       = 0x4000,
+    kTPIConfig      = 0x3F40,
+    kTPISignature   = 0x3FC0
+};
+
+static bool
+TPIRead(uint8_t memType, uint16_t address, Bytes & data, size_t size)
+{
+    Bytes body;
+    body.push_back(CMD_XPROG);
+    body.push_back(XPRG_CMD_READ_MEM);
+    body.push_back(memType);
+    Append32(body, address);
+    Append16(body, size);
+    Bytes reply;
+    if (!SimSession::Command(body, &reply))
+        return false;
+    data.insert(data.end(), reply.begin()+3, reply.begin()+3+size);
+    return true;
+}
+
+static bool
+TPIWrite(uint8_t memType, uint16_t address, const uint8_t * data, size_t size)
+{
+    Bytes body;
+    body.push_back(CMD_XPROG);
+    body.push_back(XPRG_CMD_WRITE_MEM);
+    body.push_back(memType);
+    body.push_back(0);
+    Append32(body, address);
+    Append16(body, size);
+    body.insert(body.end(), data, data+size);
+    return SimSession::Command(body);
+}
+
+static bool
+TPIErase(uint8_t mode, uint16_t address)
+{
+    Bytes body;
+    body.push_back(CMD_XPROG);
+    body.push_back(XPRG_CMD_ERASE);
+    body.push_back(mode);
+    Append32(body, address);
+    return SimSession::Command(body);
+}
+
+static bool
+ReadSignature(uint8_t * signature)
+{
+    Bytes reply;
+    for (uint8_t i=0; i<3; ++i) {
+        switch (sProtocol) {
+        case SimTarget::kISP: {
+            const uint8_t cmd[] = {CMD_READ_SIGNATURE_ISP, 4, 0x30, 0x00, i, 0x00};
+            if (!SimSession::Command(Bytes(cmd, cmd+sizeof(cmd)), &reply))
+                return false;
+            break; }
+        case SimTarget::kHVSP: {
+            const uint8_t cmd[] = {CMD_READ_SIGNATURE_HVSP, i};
+            if (!SimSession::Command(Bytes(cmd, cmd+sizeof(cmd)), &reply))
+                return false;
+            break; }
+        case SimTarget::kHVPP: {
+            const uint8_t cmd[] = {CMD_READ_SIGNATURE_PP, i};
+            if (!SimSession::Command(Bytes(cmd, cmd+sizeof(cmd)), &reply))
+                return false;
+            break; }
+        default: {
+            Bytes sig;
+            if (!TPIRead(XPRG_MEM_TYPE_APPL, kTPISignature, sig, 3))
+                return false;
+            memcpy(signature, &sig[0], 3);
+            return true; }
+        }
+        signature[i] = reply[2];
+    }
+    return true;
+}
+
+bool
+SimSession::Enter(SimTarget::Protocol protocol, const SimPart * part)
+{
+    sProtocol   = protocol;
+    sPart       = part;
+
+    if (!Command(Bytes(1, CMD_SIGN_ON)))
+        return false;
+    const uint8_t kParams[] = {PARAM_HW_VER, PARAM_SW_MAJOR, PARAM_SW_MINOR, PARAM_VTARGET};
+    for (size_t i=0; i<sizeof(kParams); ++i) {
+        const uint8_t cmd[] = {CMD_GET_PARAMETER, kParams[i]};
+        if (!Command(Bytes(cmd, cmd+2)))
+            return false;
+    }
+    switch (protocol) {
+    case SimTarget::kISP: {
+        const uint8_t cmd[] = {CMD_ENTER_PROGMODE_ISP, 200, 100, 25, 32, 0, 0x53, 3, 0xAC, 0x53, 0x00, 0x00};
+        if (!Command(Bytes(cmd, cmd+sizeof(cmd))))
+            return false;
+        break; }
+    case SimTarget::kHVSP: {
+        const uint8_t cmd[] = {CMD_ENTER_PROGMODE_HVSP, 100, 0, 6, 1, 1, 25, 1, 0};
+        if (!Command(Bytes(cmd, cmd+sizeof(cmd))))
+            return false;
+        break; }
+    case SimTarget::kHVPP: {
+        Bytes stack(1, CMD_SET_CONTROL_STACK);
+        stack.insert(stack.end(), sControlStack, sControlStack+32);
+        const uint8_t cmd[] = {CMD_ENTER_PROGMODE_PP, 100, 0, 5, 1, 15, 1, 0};
+        if (!Command(stack) || !Command(Bytes(cmd, cmd+sizeof(cmd))))
+            return false;
+        break; }
+    default: {
+        const uint8_t mode[]  = {CMD_XPROG_SETMODE, XPRG_MODE_TPI};
+        const uint8_t enter[] = {CMD_XPROG, XPRG_CMD_ENTER_PROGMODE};
+        if (!Command(Bytes(mode, mode+2)) || !Command(Bytes(enter, enter+2)))
+            return false;
+        break; }
+    }
+    uint8_t signature[3];
+    if (!ReadSignature(signature))
+        return false;
+    if (memcmp(signature, part->fSignature, 3))
+        return Fail("Signature mismatch, read %06X", (signature[0] << 16) | (signature[1] << 8) | signature[2]);
+    return true;
+}
+
+bool
+SimSession::Erase()
+{
+    switch (sProtocol) {
+    case SimTarget::kISP: {
+        const uint8_t cmd[] = {CMD_CHIP_ERASE_ISP, 9, 1, 0xAC, 0x80, 0x00, 0x00};
+        return Command(Bytes(cmd, cmd+sizeof(cmd))); }
+    case SimTarget::kHVSP: {
+        const uint8_t cmd[] = {CMD_CHIP_ERASE_HVSP, 40, 0};
+        return Command(Bytes(cmd, cmd+sizeof(cmd))); }
+    case SimTarget::kHVPP: {
+        const uint8_t cmd[] = {CMD_CHIP_ERASE_PP, 0, 15};
+        return Command(Bytes(cmd, cmd+sizeof(cmd))); }
+    default:
+        return TPIErase(XPRG_ERASE_CHIP, kTPIFlash+1);
+    }
+}
+
+bool
+SimSession::Write(bool eeprom, const Bytes & image)
+{
+    size_t pageSize = eeprom ? sPart->fEEPROMPage : sPart->fFlashPage;
+
+    for (size_t addr=0; addr<image.size(); addr+=pageSize) {
+        size_t  len     = std::min(pageSize, image.size()-addr);
+        if (sProtocol == SimTarget::kTPI) {
+            if (!TPIWrite(XPRG_MEM_TYPE_APPL, kTPIFlash+addr, &image[addr], len))
+                return false;
+            continue;
+        }
+        if (!LoadAddress(eeprom ? addr : addr/2))
+            return false;
+        Bytes   body;
+        switch (sProtocol) {
+        case SimTarget::kISP: {
+            body.push_back(eeprom ? CMD_PROGRAM_EEPROM_ISP : CMD_PROGRAM_FLASH_ISP);
+            Append16(body, len);
+            const uint8_t flash[]   = {0xC1, 10, 0x40, 0x4C, 0x20, 0xFF, 0xFF};
+            const uint8_t ee[]      = {0xC1, 10, 0xC1, 0xC2, 0xA0, 0xFF, 0xFF};
+            body.insert(body.end(), eeprom ? ee : flash, (eeprom ? ee : flash)+7);
+            break; }
+        case SimTarget::kHVSP:
+            body.push_back(eeprom ? CMD_PROGRAM_EEPROM_HVSP : CMD_PROGRAM_FLASH_HVSP);
+            Append16(body, len);
+            body.push_back(0xC1);
+            body.push_back(10);
+            break;
+        default:
+            body.push_back(eeprom ? CMD_PROGRAM_EEPROM_PP : CMD_PROGRAM_FLASH_PP);
+            Append16(body, len);
+            body.push_back(0xC1);
+            body.push_back(10);
+            break;
+        }
+        body.insert(body.end(), image.begin()+addr, image.begin()+addr+len);
+        if (!Command(body))
+            return false;
+    }
+    return true;
+}
+
+bool
+SimSession::Read(bool eeprom, Bytes & data, size_t size)
+{
+    data.clear();
+    for (size_t addr=0; addr<size; addr+=kReadBlock) {
+        size_t  len     = std::min(kReadBlock, size-addr);
+        if (sProtocol == SimTarget::kTPI) {
+            if (!TPIRead(XPRG_MEM_TYPE_APPL, kTPIFlash+addr, data, len))
+                return false;
+            continue;
+        }
+        if (!LoadAddress(eeprom ? addr : addr/2))
+            return false;
+        Bytes   body;
+        switch (sProtocol) {
+        case SimTarget::kISP:
+            body.push_back(eeprom ? CMD_READ_EEPROM_ISP : CMD_READ_FLASH_ISP);
+            Append16(body, len);
+            body.push_back(eeprom ? 0xA0 : 0x20);
+            break;
+        case SimTarget::kHVSP:
+            body.push_back(eeprom ? CMD_READ_EEPROM_HVSP : CMD_READ_FLASH_HVSP);
+            Append16(body, len);
+            break;
+        default:
+            body.push_back(eeprom ? CMD_READ_EEPROM_PP : CMD_READ_FLASH_PP);
+            Append16(body, len);
+            break;
+        }
+        Bytes reply;
+        if (!Command(body, &reply))
+            return false;
+        //
+        // The HV reads omit the trailing status byte, which avrdude ignores
+        //
+        if (reply.size() < len+2)
+            return Fail("Read of %d bytes came back short", len);
+        data.insert(data.end(), reply.begin()+2, reply.begin()+2+len);
+    }
+    return true;
+}
+
+bool
+SimSession::WriteFuses(const Bytes & fuses)
+{
+    if (sProtocol == SimTarget::kTPI) {
+        const uint8_t word[2] = {fuses[0], 0xFF};
+        return TPIErase(XPRG_ERASE_CONFIG, kTPIConfig+1)
+            && TPIWrite(XPRG_MEM_TYPE_FUSE, kTPIConfig, word, 2);
+    }
+    for (uint8_t i=0; i<fuses.size(); ++i) {
+        Bytes body;
+        switch (sProtocol) {
+        case SimTarget::kISP: {
+            const uint8_t instr[] = {0xA0, 0xA8, 0xA4};
+            const uint8_t cmd[] = {CMD_PROGRAM_FUSE_ISP, 0xAC, instr[i], 0x00, fuses[i]};
+            body.assign(cmd, cmd+sizeof(cmd));
+            break; }
+        case SimTarget::kHVSP: {
+            const uint8_t cmd[] = {CMD_PROGRAM_FUSE_HVSP, i, fuses[i], 25};
+            body.assign(cmd, cmd+sizeof(cmd));
+            break; }
+        default: {
+            const uint8_t cmd[] = {CMD_PROGRAM_FUSE_PP, i, fuses[i], 0, 25};
+            body.assign(cmd, cmd+sizeof(cmd));
+            break; }
+        }
+        if (!Command(body))
+            return false;
+        //
+        // CMD_PROGRAM_FUSE_ISP does not poll, so avrdude sleeps instead
+        //
+        if (sProtocol == SimTarget::kISP)
+            sHostTime += kFuseWriteDelay;
+    }
+    return true;
+}
+
+bool
+SimSession::ReadFuses(Bytes & fuses, size_t count)
+{
+    fuses.clear();
+    if (sProtocol == SimTarget::kTPI)
+        return TPIRead(XPRG_MEM_TYPE_FUSE, kTPIConfig, fuses, 1);
+    for (uint8_t i=0; i<count; ++i) {
+        Bytes body;
+        switch (sProtocol) {
+        case SimTarget::kISP: {
+            const uint8_t instr[][2] = {{0x50, 0x00}, {0x58, 0x08}, {0x50, 0x08}};
+            const uint8_t cmd[] = {CMD_READ_FUSE_ISP, 4, instr[i][0], instr[i][1], 0x00, 0x00};
+            body.assign(cmd, cmd+sizeof(cmd));
+            break; }
+        case SimTarget::kHVSP: {
+            const uint8_t cmd[] = {CMD_READ_FUSE_HVSP, i};
+            body.assign(cmd, cmd+sizeof(cmd));
+            break; }
+        default: {
+            const uint8_t cmd[] = {CMD_READ_FUSE_PP, i};
+            body.assign(cmd, cmd+sizeof(cmd));
+            break; }
+        }
+        Bytes reply;
+        if (!Command(body, &reply))
+            return false;
+        fuses.push_back(reply[2]);
+    }
+    return true;
+}
+
+bool
+SimSession::Leave()
+{
+    switch (sProtocol) {
+    case SimTarget::kISP: {
+        const uint8_t cmd[] = {CMD_LEAVE_PROGMODE_ISP, 1, 1};
+        return Command(Bytes(cmd, cmd+sizeof(cmd))); }
+    case SimTarget::kHVSP: {
+        const uint8_t cmd[] = {CMD_LEAVE_PROGMODE_HVSP, 0, 25};
+        return Command(Bytes(cmd, cmd+sizeof(cmd))); }
+    case SimTarget::kHVPP: {
+        const uint8_t cmd[] = {CMD_LEAVE_PROGMODE_PP, 0, 15};
+        return Command(Bytes(cmd, cmd+sizeof(cmd))); }
+    default: {
+        const uint8_t cmd[] = {CMD_XPROG, XPRG_CMD_LEAVE_PROGMODE};
+        return Command(Bytes(cmd, cmd+sizeof(cmd))); }
+    }
+}
@@ -0,0 +1,67 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SimSession.h       - Host side of a programming session, avrdude style
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// Issues the same command sequences, with the same parameters and block
+// sizes, as avrdude does for the stk500v2, stk500hvsp, stk500pp and
+// scratchmonkey (TPI) programmer types: One command in flight at a time,
+// a CMD_LOAD_ADDRESS before every page or block. The session normally runs
+// against the simulated link, but can drive a real board just the same.
+//
+
+#ifndef _SIM_SESSION_
+#define _SIM_SESSION_
+
+#include "SimTarget.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace SimSession {
+    typedef std::vector<uint8_t> Bytes;
+
+    //
+    // Host turnaround time between receiving a response and sending the
+    // next command (USB latency, avrdude's own processing)
+    //
+    void        Begin(uint64_t latencyNs);
+    uint64_t    Time();
+    const std::string & Error();
+
+    //
+    // Talk to a real programmer on a serial port instead, timed by the
+    // wall clock. Waits for the board to come out of its auto reset.
+    //
+    bool        Open(const char * port);
+    bool        IsOpen();
+
+    //
+    // Send a command and wait for its response. Fails if the response does
+    // not arrive, is garbled, or reports anything but STATUS_CMD_OK.
+    //
+    bool        Command(const Bytes & body, Bytes * response = 0);
+    //
+    // Same, but any well formed response will do, whatever its status
+    //
+    bool        Transact(const Bytes & body, Bytes & reply);
+    //
+    // Delay the next command, on top of the turnaround time
+    //
+    void        Wait(uint64_t ns);
+
+    bool        Enter(SimTarget::Protocol protocol, const SimPart * part);
+    bool        Erase();
+    bool        Write(bool eeprom, const Bytes & image);
+    bool        Read(bool eeprom, Bytes & data, size_t size);
+    bool        WriteFuses(const Bytes & fuses);
+    bool        ReadFuses(Bytes & fuses, size_t count);
+    bool        Leave();
+} // namespace SimSession
+
+#endif /* _SIM_SESSION_ */
@@ -0,0 +1,1012 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SimTarget.cpp      - Behavioral model of the AVR being programmed
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#include "SimTarget.h"
+#include "SimCore.h"
+
+#include <string.h>
+#include <math.h>
+
+//
+// The chips Tests/Makefile knows about, with the fuses it restores
+//
+static const SimPart sParts[] = {
+    // Name         Signature           Flash   Page    EEPROM  Page    Protocols                                   Fuses               Boot
+    {"attiny85",    {0x1E, 0x93, 0x0B},   8192,  64,     512,    4,      SimTarget::kISP|SimTarget::kHVSP,           {0x62, 0xD7, 0xFF},    0},
+    {"attiny84",    {0x1E, 0x93, 0x0C},   8192,  64,     512,    4,      SimTarget::kISP|SimTarget::kHVSP,           {0x62, 0xDF, 0xFF},    0},
+    {"attiny4313",  {0x1E, 0x92, 0x0D},   4096,  64,     256,    4,      SimTarget::kISP|SimTarget::kHVPP,           {0x62, 0x9F, 0xFE},    0},
+    {"attiny861",   {0x1E, 0x93, 0x0D},   8192,  64,     512,    4,      SimTarget::kISP|SimTarget::kHVPP,           {0x62, 0xDF, 0x01},    0},
+    {"attiny1634",  {0x1E, 0x94, 0x12},  16384,  32,     256,    4,      SimTarget::kISP|SimTarget::kHVPP,           {0x62, 0xDF, 0x07},    0},
+    {"atmega328",   {0x1E, 0x95, 0x14},  32768, 128,    1024,    4,      SimTarget::kISP|SimTarget::kHVPP,           {0x62, 0xD9, 0x07},  512},
+    {"atmega328p",  {0x1E, 0x95, 0x0F},  32768, 128,    1024,    4,      SimTarget::kISP|SimTarget::kHVPP,           {0x62, 0xD9, 0x07},  512},
+    {"atmega1284p", {0x1E, 0x97, 0x05}, 131072, 256,    4096,    8,      SimTarget::kISP|SimTarget::kHVPP,           {0x62, 0x99, 0xFF}, 1024},
+    {"attiny10",    {0x1E, 0x90, 0x03},   1024,  16,       0,    0,      SimTarget::kTPI,                            {0xFF, 0xFF, 0xFF},    0},
+};
+
+//
+// Worst case programming times from the data sheets
+//
+const uint64_t  kFlashWriteNs   = 4500000;
+const uint64_t  kEEPROMWriteNs  = 3600000;
+const uint64_t  kEraseNs        = 9000000;
+const uint64_t  kFuseWriteNs    = 4500000;
+const uint64_t  kTPIWordWriteNs = 2500000;
+const uint8_t   kCalibration    = 0x5A;     // Any value will do
+const double    kVCCMillivolts  = 5000.0;
+const double    kVCCRiseNs      =  100000.0;    // Decoupling cap through the supply switch
+const double    kVCCFallNs      = 2000000.0;    // Same cap through an idle chip in reset
+
+static const SimPart *          sPart;
+static SimTarget::Protocol      sProtocol;
+static bool                     sActive;
+static std::vector<uint8_t>     sFlash;
+static std::vector<uint8_t>     sEEPROM;
+static std::vector<uint8_t>     sPageBuffer;
+static std::vector<uint8_t>     sEEPROMBuffer;
+static std::vector<bool>        sEEPROMLoaded;
+static uint8_t                  sFuses[3];
+static uint8_t                  sLock;
+static uint64_t                 sBusyUntil;
+static bool                     sVCCOn          = true;
+static double                   sVCCFrom        = kVCCMillivolts;
+static uint64_t                 sVCCChanged;
+static SimTarget::Stats         sStats;
+
+const SimPart *
+SimTarget::FindPart(const char * name)
+{
+    for (size_t i=0; i<sizeof(sParts)/sizeof(sParts[0]); ++i)
+        if (!strcmp(sParts[i].fName, name))
+            return &sParts[i];
+    return 0;
+}
+
+const SimPart *
+SimTarget::Parts(size_t & numParts)
+{
+    numParts = sizeof(sParts)/sizeof(sParts[0]);
+    return sParts;
+}
+
+static void
+ClearPageBuffers()
+{
+    sPageBuffer.assign(sPart->fFlashPage, 0xFF);
+    sEEPROMBuffer.assign(sPart->fEEPROMPage, 0xFF);
+    sEEPROMLoaded.assign(sPart->fEEPROMPage, false);
+}
+
+static void ResetProtocol();
+static void ObservePin(uint8_t pin, uint8_t value);
+
+void
+SimTarget::Attach(const SimPart * part)
+{
+    sPart       = part;
+    sProtocol   = kNone;
+    sActive     = false;
+    sFlash.assign(part->fFlashSize, 0xFF);
+    sEEPROM.assign(part->fEEPROMSize, 0xFF);
+    memcpy(sFuses, part->fFuses, 3);
+    sLock       = 0xFF;
+    sBusyUntil  = 0;
+    sVCCOn      = SimPins::Level(kVCCPin);
+    sVCCFrom    = sVCCOn ? kVCCMillivolts : 0.0;
+    sVCCChanged = SimClock::Now();
+    memset(&sStats, 0, sizeof(sStats));
+    ClearPageBuffers();
+    ResetProtocol();
+    SimPins::SetObserver(ObservePin);
+}
+
+const SimPart *
+SimTarget::Part()
+{
+    return sPart;
+}
+
+void
+SimTarget::Select(Protocol protocol)
+{
+    sProtocol = (sPart->fProtocols & protocol) ? protocol : kNone;
+}
+
+bool
+SimTarget::Ready()
+{
+    return SimClock::Now() >= sBusyUntil;
+}
+
+SimTarget::Protocol
+SimTarget::Active()
+{
+    return sActive ? sProtocol : kNone;
+}
+
+uint16_t
+SimTarget::VCCMillivolts()
+{
+    double t = double(SimClock::Now()-sVCCChanged);
+    if (sVCCOn)
+        return kVCCMillivolts - (kVCCMillivolts-sVCCFrom)*exp(-t/kVCCRiseNs);
+    else
+        return sVCCFrom*exp(-t/kVCCFallNs);
+}
+
+const SimTarget::Stats &
+SimTarget::Statistics()
+{
+    return sStats;
+}
+
+const std::vector<uint8_t> &
+SimTarget::Flash()
+{
+    return sFlash;
+}
+
+const std::vector<uint8_t> &
+SimTarget::EEPROM()
+{
+    return sEEPROM;
+}
+
+uint8_t
+SimTarget::Fuse(uint8_t index)
+{
+    return sFuses[index];
+}
+
+uint8_t
+SimTarget::Lock()
+{
+    return sLock;
+}
+
+//
+// Memory operations shared by all protocols. They return false if the chip
+// was still busy and ignored the request.
+//
+static bool
+StartWrite(uint64_t duration)
+{
+    if (!SimTarget::Ready()) {
+        ++sStats.fIgnored;
+        return false;
+    }
+    ++sStats.fWrites;
+    sStats.fBusyNs += duration;
+    sBusyUntil      = SimClock::Now() + duration;
+
+    return true;
+}
+
+static void
+ChipErase()
+{
+    if (!StartWrite(kEraseNs))
+        return;
+    sFlash.assign(sFlash.size(), 0xFF);
+    sEEPROM.assign(sEEPROM.size(), 0xFF);
+    sLock = 0xFF;
+}
+
+static void
+LoadFlashWord(uint32_t wordAddr, uint8_t low, uint8_t high)
+{
+    uint16_t ix = (wordAddr*2) & (sPart->fFlashPage-1);
+    sPageBuffer[ix]   = low;
+    sPageBuffer[ix+1] = high;
+}
+
+static void
+LoadFlashByte(uint32_t wordAddr, bool high, uint8_t data)
+{
+    sPageBuffer[((wordAddr*2) & (sPart->fFlashPage-1)) + high] = data;
+}
+
+static uint32_t
+FlashPageStart(uint32_t wordAddr)
+{
+    return (wordAddr*2) & (sFlash.size()-1) & ~uint32_t(sPart->fFlashPage-1);
+}
+
+static void
+CommitFlashPage(uint32_t wordAddr)
+{
+    uint32_t start = FlashPageStart(wordAddr);
+    for (uint16_t i=0; i<sPart->fFlashPage; ++i)
+        sFlash[start+i] &= sPageBuffer[i];
+    sPageBuffer.assign(sPageBuffer.size(), 0xFF);
+}
+
+static void
+WriteFlashPage(uint32_t wordAddr)
+{
+    if (StartWrite(kFlashWriteNs))
+        CommitFlashPage(wordAddr);
+}
+
+static uint8_t
+ReadFlash(uint32_t wordAddr, bool high)
+{
+    return sFlash[(wordAddr*2+high) & (sFlash.size()-1)];
+}
+
+static void
+LoadEEPROMByte(uint16_t addr, uint8_t data)
+{
+    if (!sPart->fEEPROMPage)
+        return;
+    uint8_t ix = addr & (sPart->fEEPROMPage-1);
+    sEEPROMBuffer[ix] = data;
+    sEEPROMLoaded[ix] = true;
+}
+
+static void
+WriteEEPROMPage(uint16_t addr)
+{
+    if (!sEEPROM.size() || !StartWrite(kEEPROMWriteNs))
+        return;
+    uint16_t start = addr & (sEEPROM.size()-1) & ~(sPart->fEEPROMPage-1);
+    for (uint8_t i=0; i<sPart->fEEPROMPage; ++i)
+        if (sEEPROMLoaded[i])
+            sEEPROM[start+i] = sEEPROMBuffer[i];
+    sEEPROMLoaded.assign(sEEPROMLoaded.size(), false);
+}
+
+static void
+WriteEEPROMByte(uint16_t addr, uint8_t data)
+{
+    if (!sEEPROM.size() || !StartWrite(kEEPROMWriteNs))
+        return;
+    sEEPROM[addr & (sEEPROM.size()-1)] = data;
+}
+
+static uint8_t
+ReadEEPROM(uint16_t addr)
+{
+    return sEEPROM.size() ? sEEPROM[addr & (sEEPROM.size()-1)] : 0xFF;
+}
+
+static void
+WriteFuse(uint8_t * fuse, uint8_t value)
+{
+    if (StartWrite(kFuseWriteNs))
+        *fuse = value;
+}
+
+//
+// ISP: Instructions are 4 bytes, and the chip echoes the second byte while
+// the third one is shifted in. Before the Programming Enable instruction
+// has been recognized, nothing useful comes back.
+//
+static uint8_t  sISPFrame[4];
+static uint8_t  sISPIndex;
+static bool     sISPEnabled;
+static uint8_t  sISPExtAddr;
+
+static uint8_t
+ISPExecute(const uint8_t * in)
+{
+    uint32_t wordAddr = (uint32_t(sISPExtAddr) << 16) | (in[1] << 8) | in[2];
+    uint16_t byteAddr = (in[1] << 8) | in[2];
+    bool     ready    = SimTarget::Ready();
+
+    switch (in[0]) {
+    case 0xF0:  // Poll RDY/BSY
+        return !ready;
+    case 0x30:  // Read Signature Byte
+        return sPart->fSignature[in[2] & 3];
+    case 0x38:  // Read Calibration Byte
+        return kCalibration;
+    case 0x50:  // Read Fuse / Extended Fuse
+        return sFuses[in[1] == 0x08 ? 2 : 0];
+    case 0x58:  // Read Lock / High Fuse
+        return in[1] == 0x08 ? sFuses[1] : sLock;
+    case 0x20:  // Read Program Memory
+    case 0x28:
+        return ready ? ReadFlash(wordAddr, in[0] & 0x08) : 0xFF;
+    case 0xA0:  // Read EEPROM Memory
+        return ready ? ReadEEPROM(byteAddr) : 0xFF;
+    }
+    if (!ready) {
+        ++sStats.fIgnored;
+        return 0;
+    }
+    switch (in[0]) {
+    case 0xAC:
+        switch (in[1]) {
+        case 0x80:  // Chip Erase
+            ChipErase();
+            break;
+        case 0xA0:  // Write Fuse Bits
+            WriteFuse(&sFuses[0], in[3]);
+            break;
+        case 0xA8:  // Write Fuse High Bits
+            WriteFuse(&sFuses[1], in[3]);
+            break;
+        case 0xA4:  // Write Extended Fuse Bits
+            WriteFuse(&sFuses[2], in[3]);
+            break;
+        case 0xE0:  // Write Lock Bits
+            WriteFuse(&sLock, in[3] | 0xC0);
+            break;
+        }
+        break;
+    case 0x4D:  // Load Extended Address Byte
+        sISPExtAddr = in[2];
+        break;
+    case 0x40:  // Load Program Memory Page
+    case 0x48:
+        LoadFlashByte(wordAddr, in[0] & 0x08, in[3]);
+        break;
+    case 0x4C:  // Write Program Memory Page
+        WriteFlashPage(wordAddr);
+        break;
+    case 0xC1:  // Load EEPROM Memory Page
+        LoadEEPROMByte(byteAddr, in[3]);
+        break;
+    case 0xC2:  // Write EEPROM Memory Page
+        WriteEEPROMPage(byteAddr);
+        break;
+    case 0xC0:  // Write EEPROM Memory
+        WriteEEPROMByte(byteAddr, in[3]);
+        break;
+    }
+    return 0;
+}
+
+static uint8_t  SlaveTransfer(uint8_t out);
+
+uint8_t
+SimTarget::ISPTransfer(uint8_t out)
+{
+    if (sProtocol != kISP)
+        return 0xFF;
+    if (!sActive)
+        return SlaveTransfer(out);
+    ++sStats.fBusOps;
+
+    uint8_t in = 0;
+    sISPFrame[sISPIndex] = out;
+    switch (sISPIndex) {
+    case 1:
+        in = sISPEnabled ? sISPFrame[0] : 0;
+        break;
+    case 2:
+        if (!sISPEnabled && sISPFrame[0] == 0xAC && sISPFrame[1] == 0x53)
+            sISPEnabled = true;
+        in = sISPEnabled ? sISPFrame[1] : 0;
+        break;
+    case 3:
+        if (sISPEnabled)
+            in = ISPExecute(sISPFrame);
+        break;
+    }
+    sISPIndex = (sISPIndex+1) & 3;
+
+    return in;
+}
+
+//
+// HVSP: Each frame shifts in an instruction and a data byte, and shifts out
+// whatever the previous instruction put on the data lines.
+//
+static uint8_t  sHVSPOut;
+static uint8_t  sCommand;
+static uint8_t  sAddrLow;
+static uint8_t  sAddrHigh;
+static uint8_t  sAddrExt;
+static uint8_t  sDataLow;
+static uint8_t  sDataHigh;
+
+static uint32_t
+WordAddress()
+{
+    return (uint32_t(sAddrExt) << 16) | (sAddrHigh << 8) | sAddrLow;
+}
+
+//
+// Commands and byte selection are common to HVSP and HVPP
+//
+static void
+HVWrite(uint8_t byteSel)
+{
+    switch (sCommand) {
+    case 0x80:  // Chip Erase
+        ChipErase();
+        break;
+    case 0x10:  // Write Flash
+        WriteFlashPage(WordAddress());
+        break;
+    case 0x11:  // Write EEPROM
+        WriteEEPROMPage(WordAddress());
+        break;
+    case 0x40:  // Write Fuse Bits
+        WriteFuse(&sFuses[byteSel], sDataLow);
+        break;
+    case 0x20:  // Write Lock Bits
+        WriteFuse(&sLock, sDataLow);
+        break;
+    }
+}
+
+static void
+HVLatch()
+{
+    switch (sCommand) {
+    case 0x10:
+        LoadFlashWord(sAddrLow, sDataLow, sDataHigh);
+        break;
+    case 0x11:
+        LoadEEPROMByte((sAddrHigh << 8) | sAddrLow, sDataLow);
+        break;
+    }
+}
+
+//
+// Fuse selection: 0 low, 1 lock, 2 extended, 3 high
+//
+static uint8_t
+HVRead(bool bs1, uint8_t fuseSel)
+{
+    switch (sCommand) {
+    case 0x02:  // Read Flash
+        return ReadFlash(WordAddress(), bs1);
+    case 0x03:  // Read EEPROM
+        return ReadEEPROM((sAddrHigh << 8) | sAddrLow);
+    case 0x04: {// Read Fuse and Lock Bits
+        const uint8_t fuses[4] = {sFuses[0], sLock, sFuses[2], sFuses[1]};
+        return fuses[fuseSel & 3]; }
+    case 0x08:  // Read Signature Bytes and Calibration Byte
+        return bs1 ? kCalibration : sPart->fSignature[sAddrLow & 3];
+    }
+    return 0xFF;
+}
+
+uint8_t
+SimTarget::HVSPTransfer(uint8_t instr, uint8_t data)
+{
+    if (sProtocol != kHVSP || !sActive)
+        return 0;
+    ++sStats.fBusOps;
+
+    uint8_t out = sHVSPOut;
+    sHVSPOut    = 0;
+    switch (instr) {
+    case 0x4C:
+        sCommand  = data;
+        break;
+    case 0x0C:
+        sAddrLow  = data;
+        break;
+    case 0x1C:
+        sAddrHigh = data;
+        break;
+    case 0x2C:
+        sDataLow  = data;
+        break;
+    case 0x3C:
+        sDataHigh = data;
+        break;
+    case 0x6D:  // PAGEL, low byte
+        if (sCommand == 0x10)
+            LoadFlashByte(sAddrLow, false, sDataLow);
+        else
+            HVLatch();
+        break;
+    case 0x7D:  // PAGEL, high byte
+        LoadFlashByte(sAddrLow, true, sDataHigh);
+        break;
+    case 0x64:  // WR, low byte
+        HVWrite(0);
+        break;
+    case 0x74:  // WR, high byte
+        HVWrite(1);
+        break;
+    case 0x66:  // WR, extended byte
+        HVWrite(2);
+        break;
+    case 0x68:  // OE, low byte
+        sHVSPOut = HVRead(false, 0);
+        break;
+    case 0x78:  // OE, high byte
+        sHVSPOut = HVRead(true, 1);
+        break;
+    case 0x7A:  // OE, high fuse
+        sHVSPOut = HVRead(true, 3);
+        break;
+    case 0x6A:  // OE, extended fuse
+        sHVSPOut = HVRead(false, 2);
+        break;
+    }
+    return out;
+}
+
+//
+// HVPP
+//
+enum {
+    kPAGEL  = 0x80,
+    kXA1    = 0x40,
+    kXA0    = 0x20,
+    kBS1    = 0x10,
+    kWR     = 0x08,
+    kOE     = 0x04,
+    kBS2    = 0x01
+};
+static uint8_t  sSignals;
+static uint8_t  sDataBus;
+
+void
+SimTarget::HVPPControl(uint8_t signals)
+{
+    if (sProtocol != kHVPP || !sActive)
+        return;
+    ++sStats.fBusOps;
+
+    uint8_t prev = sSignals;
+    sSignals     = signals;
+    if ((prev & kWR) && !(signals & kWR))
+        HVWrite((signals & kBS2) ? 2 : (signals & kBS1) ? 1 : 0);
+    if (!(prev & kPAGEL) && (signals & kPAGEL))
+        HVLatch();
+}
+
+void
+SimTarget::HVPPSetData(uint8_t data)
+{
+    sDataBus = data;
+}
+
+uint8_t
+SimTarget::HVPPGetData()
+{
+    if (sProtocol != kHVPP || !sActive || (sSignals & kOE))
+        return sDataBus;
+    return HVRead(sSignals & kBS1, ((sSignals & kBS2) ? 2 : 0) | ((sSignals & kBS1) ? 1 : 0));
+}
+
+void
+SimTarget::HVPPPulseXTAL()
+{
+    if (sProtocol != kHVPP || !sActive)
+        return;
+    ++sStats.fBusOps;
+
+    bool bs1 = sSignals & kBS1;
+    switch (sSignals & (kXA1|kXA0)) {
+    case 0:     // Load Address
+        if (sSignals & kBS2)
+            sAddrExt  = sDataBus;
+        else if (bs1)
+            sAddrHigh = sDataBus;
+        else
+            sAddrLow  = sDataBus;
+        break;
+    case kXA0:  // Load Data
+        if (bs1)
+            sDataHigh = sDataBus;
+        else
+            sDataLow  = sDataBus;
+        break;
+    case kXA1:  // Load Command
+        sCommand = sDataBus;
+        break;
+    }
+}
+
+//
+// TPI
+//
+enum {
+    kTPIBase        = 0x4000,   // Flash is mapped here
+    kTPILock        = 0x3F00,
+    kTPIConfig      = 0x3F40,
+    kTPICalibration = 0x3F80,
+    kTPISignature   = 0x3FC0,
+
+    kNVMCSR         = 0x32,
+    kNVMCMD         = 0x33,
+    kNVMBusy        = 0x80,
+
+    kNVMChipErase   = 0x10,
+    kNVMSectionErase= 0x14,
+    kNVMWordWrite   = 0x1D
+};
+static const uint8_t    sTPIKey[8] = {0xFF, 0x88, 0xD8, 0xCD, 0x45, 0xAB, 0x89, 0x12};
+
+static uint8_t          sTPIPending;    // Operation waiting for its operand
+static uint8_t          sTPIKeyIndex;
+static bool             sNVMEnabled;
+static uint8_t          sGuardTime;
+static uint8_t          sNVMCommand;
+static uint16_t         sPointer;
+static uint8_t          sWordLow;
+static int              sTPIOut;
+
+static uint8_t
+TPILoad(uint16_t addr)
+{
+    if (addr >= kTPIBase && addr < kTPIBase+sFlash.size())
+        return sFlash[addr-kTPIBase];
+    else if (addr == kTPILock)
+        return sLock;
+    else if (addr == kTPIConfig)
+        return sFuses[0];
+    else if (addr == kTPICalibration)
+        return kCalibration;
+    else if (addr >= kTPISignature && addr < kTPISignature+3)
+        return sPart->fSignature[addr-kTPISignature];
+    return 0xFF;
+}
+
+static void
+TPIStore(uint16_t addr, uint8_t data)
+{
+    switch (sNVMCommand) {
+    case kNVMChipErase:
+        ChipErase();
+        break;
+    case kNVMSectionErase:
+        if (addr >= kTPIConfig && addr < kTPICalibration && StartWrite(kEraseNs))
+            sFuses[0] = 0xFF;
+        break;
+    case kNVMWordWrite:
+        if (!(addr & 1)) {
+            sWordLow = data;
+        } else if (StartWrite(kTPIWordWriteNs)) {
+            if (addr >= kTPIBase && addr < kTPIBase+sFlash.size()) {
+                sFlash[addr-kTPIBase-1] &= sWordLow;
+                sFlash[addr-kTPIBase]   &= data;
+            } else if (addr == kTPIConfig+1) {
+                sFuses[0] &= sWordLow;
+            } else if (addr == kTPILock+1) {
+                sLock     &= sWordLow;
+            }
+        }
+        break;
+    }
+}
+
+void
+SimTarget::TPIReceive(uint8_t byte)
+{
+    if (sProtocol != kTPI || !sActive)
+        return;
+    ++sStats.fBusOps;
+
+    if (sTPIKeyIndex) {
+        if (byte != sTPIKey[8-sTPIKeyIndex])
+            sTPIKeyIndex = 0;   // Wrong key, the rest are instructions again
+        else if (!--sTPIKeyIndex)
+            sNVMEnabled  = true;
+        return;
+    }
+    if (uint8_t op = sTPIPending) {
+        sTPIPending = 0;
+        if ((op & 0xF0) == 0xC0) {              // SSTCS
+            if ((op & 0x0F) == 0x02)
+                sGuardTime = byte & 7;
+        } else if ((op & 0xFE) == 0x68) {       // SSTPR
+            if (op & 1)
+                sPointer = (sPointer & 0x00FF) | (byte << 8);
+            else
+                sPointer = (sPointer & 0xFF00) | byte;
+        } else if ((op & 0x90) == 0x90) {       // SOUT
+            if ((((op >> 1) & 0x30) | (op & 0x0F)) == kNVMCMD)
+                sNVMCommand = byte;
+        } else if (sNVMEnabled) {               // SST / SST+
+            TPIStore(sPointer, byte);
+            if (op & 0x04)
+                ++sPointer;
+        }
+        return;
+    }
+    if (byte == 0xE0) {                         // SKEY
+        sTPIKeyIndex = 8;
+    } else if ((byte & 0xF0) == 0x80) {         // SLDCS
+        switch (byte & 0x0F) {
+        case 0x0F:  // TPIIR
+            sTPIOut = 0x80;
+            break;
+        case 0x00:  // TPISR
+            sTPIOut = sNVMEnabled ? 0x02 : 0x00;
+            break;
+        default:
+            sTPIOut = 0x00;
+            break;
+        }
+    } else if ((byte & 0xFB) == 0x20) {         // SLD / SLD+
+        sTPIOut = sNVMEnabled ? TPILoad(sPointer) : 0x00;
+        if (byte & 0x04)
+            ++sPointer;
+    } else if ((byte & 0x90) == 0x10) {         // SIN
+        if ((((byte >> 1) & 0x30) | (byte & 0x0F)) == kNVMCSR)
+            sTPIOut = Ready() ? 0 : kNVMBusy;
+        else
+            sTPIOut = 0;
+    } else {                                    // SSTCS / SSTPR / SOUT / SST / SST+
+        sTPIPending = byte;
+    }
+}
+
+int
+SimTarget::TPITransmit(uint16_t & idleBits)
+{
+    idleBits    = sGuardTime == 7 ? 2 : (128 >> sGuardTime) + 2;
+    int out     = sTPIOut;
+    sTPIOut     = -1;
+    if (out >= 0)
+        ++sStats.fBusOps;
+    return out;
+}
+
+//
+// Self programming: The CPU model starts at the boot reset vector and stops
+// for good as soon as it leaves the boot section or meets an instruction the
+// helper does not use. Erased flash (0xFFFF) runs through as a NOP. The
+// CPU runs at 1MHz with CKDIV8 programmed and 8MHz otherwise, and lags
+// behind: it catches up whenever the programmer talks to it or resets it.
+//
+// The SPI slave ignores /SS, as if it were tied low, and the shift register
+// is loaded when a byte completes, so write collisions go unnoticed. A byte
+// arriving before the previous one was read overwrites it. The whole boot
+// section is taken to be NRWW: SPM there halts the CPU until the operation
+// is done.
+//
+enum {
+    kDDRB   = 0x04,
+    kSPCR   = 0x2C,
+    kSPSR   = 0x2D,
+    kSPDR   = 0x2E,
+    kSPMCSR = 0x37,
+    kRAMPZ  = 0x3B
+};
+enum {
+    kSPE    = 0x40,
+    kSPIF   = 0x80,
+    kSPMEN  = 0x01,
+    kPGERS  = 0x02,
+    kPGWRT  = 0x04,
+    kRWWSRE = 0x10,
+    kRWWSB  = 0x40
+};
+
+static bool     sCPURunning;
+static uint64_t sCPUTime;
+static uint32_t sCPUCycleNs;
+static uint32_t sPC;            // Words
+static uint8_t  sReg[32];
+static bool     sZero;
+static uint8_t  sIO[64];
+static uint8_t  sSPIIn;
+static uint8_t  sSPIOut;
+static uint64_t sSPMUntil;
+
+static uint32_t
+BootStart()
+{
+    uint8_t bootSize = (sFuses[1] >> 1) & 3;     // BOOTSZ, 3 is smallest
+    return sPart->fFlashSize - (uint32_t(sPart->fBootSize) << (3-bootSize));
+}
+
+static void
+StartCPU()
+{
+    if (!sPart->fBootSize || (sFuses[1] & 1) || !sVCCOn)   // BOOTRST unprogrammed
+        return;
+    sCPURunning = true;
+    sCPUTime    = SimClock::Now();
+    sCPUCycleNs = (sFuses[0] & 0x80) ? 125 : 1000;
+    sPC         = BootStart() / 2;
+    sZero       = false;
+    sSPIIn      = 0;
+    sSPIOut     = 0;
+    sSPMUntil   = 0;
+    memset(sReg, 0, sizeof(sReg));
+    memset(sIO, 0, sizeof(sIO));
+}
+
+static uint8_t
+ReadIO(uint8_t addr)
+{
+    switch (addr) {
+    case kSPDR:
+        sIO[kSPSR] &= ~kSPIF;
+        return sSPIIn;
+    case kSPMCSR:
+        return (sIO[kSPMCSR] & kRWWSB) | (sCPUTime < sSPMUntil ? kSPMEN : 0);
+    default:
+        return sIO[addr];
+    }
+}
+
+static void
+WriteIO(uint8_t addr, uint8_t value)
+{
+    switch (addr) {
+    case kSPSR:
+        break;
+    case kSPDR:
+        sSPIOut = value;
+        break;
+    case kSPMCSR:
+        sIO[kSPMCSR] = (sIO[kSPMCSR] & kRWWSB) | (value & 0x3F);
+        break;
+    default:
+        sIO[addr] = value;
+        break;
+    }
+}
+
+static void
+SPM()
+{
+    const uint8_t   op      = sIO[kSPMCSR] & 0x1F;
+    const uint32_t  z       = (uint32_t(sIO[kRAMPZ]) << 16) | (sReg[31] << 8) | sReg[30];
+    const uint32_t  start   = FlashPageStart(z >> 1);
+
+    sIO[kSPMCSR] &= kRWWSB;
+    if (sCPUTime < sSPMUntil) {
+        ++sStats.fIgnored;
+        return;
+    }
+    switch (op) {
+    case kSPMEN:
+        LoadFlashWord(z >> 1, sReg[0], sReg[1]);
+        return;
+    case kPGERS|kSPMEN:
+        memset(&sFlash[start], 0xFF, sPart->fFlashPage);
+        break;
+    case kPGWRT|kSPMEN:
+        CommitFlashPage(z >> 1);
+        break;
+    case kRWWSRE|kSPMEN:
+        sIO[kSPMCSR] &= ~kRWWSB;
+        return;
+    default:
+        return;
+    }
+    ++sStats.fWrites;
+    sStats.fBusyNs += kFlashWriteNs;
+    sSPMUntil       = sCPUTime + kFlashWriteNs;
+    if (sSPMUntil > sBusyUntil)
+        sBusyUntil  = sSPMUntil;
+    if (start >= BootStart())
+        sCPUTime    = sSPMUntil;
+    else
+        sIO[kSPMCSR] |= kRWWSB;
+}
+
+static void
+StepCPU()
+{
+    const uint32_t  addr    = sPC*2;
+    if (addr < BootStart() || addr >= sFlash.size()) {
+        sCPURunning = false;
+        return;
+    }
+    const uint16_t  op      = sFlash[addr] | (sFlash[addr+1] << 8);
+    const uint8_t   rd      = (op >> 4) & 0x1F;
+    const uint8_t   rdi     = 16 + ((op >> 4) & 0x0F);
+    const uint8_t   k       = ((op >> 4) & 0xF0) | (op & 0x0F);
+    const uint8_t   io      = ((op >> 5) & 0x30) | (op & 0x0F);
+    uint8_t         cycles  = 1;
+
+    ++sPC;
+    if (op == 0x0000 || op == 0xFFFF) {                 // NOP, erased
+    } else if ((op & 0xF000) == 0xE000) {               // LDI
+        sReg[rdi] = k;
+    } else if ((op & 0xF000) == 0x3000) {               // CPI
+        sZero = sReg[rdi] == k;
+    } else if ((op & 0xF800) == 0xB000) {               // IN
+        sReg[rd] = ReadIO(io);
+    } else if ((op & 0xF800) == 0xB800) {               // OUT
+        WriteIO(io, sReg[rd]);
+    } else if ((op & 0xFC08) == 0xFC00) {               // SBRC, SBRS
+        if (((sReg[rd] >> (op & 7)) & 1) == ((op >> 9) & 1)) {
+            ++sPC;
+            ++cycles;
+        }
+    } else if ((op & 0xF000) == 0xC000) {               // RJMP
+        sPC    += int16_t(op << 4) >> 4;
+        cycles  = 2;
+    } else if ((op & 0xF807) == 0xF001) {               // BREQ, BRNE
+        if (sZero != ((op >> 10) & 1)) {
+            sPC    += int8_t(op >> 2) >> 1;
+            cycles  = 2;
+        }
+    } else if ((op & 0xFF00) == 0x9600) {               // ADIW
+        const uint8_t   d   = 24 + ((op >> 3) & 6);
+        const uint16_t  sum = (sReg[d] | (sReg[d+1] << 8)) + (((op >> 2) & 0x30) | (op & 0x0F));
+        sReg[d]     = sum & 0xFF;
+        sReg[d+1]   = sum >> 8;
+        sZero       = !sum;
+        cycles      = 2;
+    } else if ((op & 0xFE0F) == 0x940A) {               // DEC
+        sZero       = !--sReg[rd];
+    } else if (op == 0x95E8) {                          // SPM
+        SPM();
+        cycles      = 4;
+    } else {
+        sCPURunning = false;
+        return;
+    }
+    sPC        &= (sFlash.size()/2)-1;
+    sCPUTime   += cycles*sCPUCycleNs;
+}
+
+static void
+RunCPU()
+{
+    const uint64_t now = SimClock::Now();
+    while (sCPURunning && sCPUTime < now)
+        StepCPU();
+}
+
+static uint8_t
+SlaveTransfer(uint8_t out)
+{
+    if (!sCPURunning)
+        return 0xFF;
+    ++sStats.fBusOps;
+    RunCPU();
+    if (!(sIO[kSPCR] & kSPE))
+        return 0xFF;
+    uint8_t in      = sSPIOut;
+    sSPIIn          = out;
+    sSPIOut         = out;
+    sIO[kSPSR]     |= kSPIF;
+
+    return in;
+}
+
+//
+// RESET low (or 12V applied) restarts the programming interface
+//
+static void
+ResetProtocol()
+{
+    sISPIndex       = 0;
+    sISPEnabled     = false;
+    sISPExtAddr     = 0;
+    sHVSPOut        = 0;
+    sCommand        = 0;
+    sAddrLow        = sAddrHigh = sAddrExt = 0;
+    sSignals        = 0xFF;
+    sTPIPending     = 0;
+    sTPIKeyIndex    = 0;
+    sNVMEnabled     = false;
+    sGuardTime      = 0;
+    sNVMCommand     = 0;
+    sTPIOut         = -1;
+}
+
+static void
+ObservePin(uint8_t pin, uint8_t value)
+{
+    if (pin == SimTarget::kVCCPin) {
+        sVCCFrom    = SimTarget::VCCMillivolts();
+        sVCCOn      = value;
+        sVCCChanged = SimClock::Now();
+        return;
+    }
+    if (pin != SimTarget::kResetPin)
+        return;
+    if (!value)
+        RunCPU();
+    sCPURunning = false;
+    sActive     = !value;
+    ResetProtocol();
+    if (value)
+        StartCPU();
+}
@@ -0,0 +1,104 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SimTarget.h        - Behavioral model of the AVR being programmed
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// One chip is attached at a time. It decodes the ISP instructions, the HVSP
+// instruction / data pairs, the HVPP control signals and the TPI byte stream
+// the way the data sheets describe them, with memories starting out erased.
+// Writes take the data sheet's worst case time, during which the chip
+// reports busy and ignores further writes. Flash pages are ANDed into flash,
+// so forgetting to erase shows up as a verify error, just like on silicon.
+//
+// With BOOTRST programmed, releasing RESET runs the boot section on a small
+// model of the CPU, just enough for the helper smoprog loads there (see
+// SMoHelper.h), which then talks to the programmer as an SPI slave.
+//
+// HVPP signals are decoded for the ATmega control stack avrdude uploads:
+//   bit 7 PAGEL, 6 XA1, 5 XA0, 4 BS1, 3 /WR, 2 /OE, 0 BS2
+// The simulated 20 pin ATtinys are wired the same way.
+//
+
+#ifndef _SIM_TARGET_
+#define _SIM_TARGET_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+struct SimPart {
+    const char *    fName;
+    uint8_t         fSignature[3];
+    uint32_t        fFlashSize;
+    uint16_t        fFlashPage;     // Bytes
+    uint16_t        fEEPROMSize;
+    uint8_t         fEEPROMPage;
+    uint8_t         fProtocols;
+    uint8_t         fFuses[3];      // Low, high, extended as shipped
+    uint16_t        fBootSize;      // Smallest boot section in bytes, 0 if none
+};
+
+namespace SimTarget {
+    enum Protocol {
+        kNone   = 0,
+        kISP    = 1,
+        kHVSP   = 2,
+        kHVPP   = 4,
+        kTPI    = 8
+    };
+    enum {
+        kResetPin   = 10,   // Active low for ISP, 12V applied for HV
+        kVCCPin     = 11    // Target supply for HV protocols
+    };
+    struct Stats {
+        uint32_t    fBusOps;        // ISP / TPI bytes, HVSP frames, HVPP strobes
+        uint32_t    fWrites;        // Page, byte, word and fuse writes, erases
+        uint32_t    fIgnored;       // Instructions sent while busy
+        uint64_t    fBusyNs;
+    };
+
+    const SimPart * FindPart(const char * name);
+    const SimPart * Parts(size_t & numParts);
+
+    //
+    // Fresh chip: Memories erased, fuses as shipped
+    //
+    void            Attach(const SimPart * part);
+    const SimPart * Part();
+    void            Select(Protocol protocol);
+    bool            Ready();
+    //
+    // Protocol the target is in programming mode for, if any
+    //
+    Protocol        Active();
+    const Stats &   Statistics();
+    //
+    // Target supply rail, charging and discharging exponentially whenever
+    // kVCCPin changes, as seen through a sense input (see SMoHWIF_HV.h)
+    //
+    uint16_t        VCCMillivolts();
+
+    const std::vector<uint8_t> &    Flash();
+    const std::vector<uint8_t> &    EEPROM();
+    uint8_t         Fuse(uint8_t index);
+    uint8_t         Lock();
+
+    uint8_t         ISPTransfer(uint8_t out);
+    uint8_t         HVSPTransfer(uint8_t instr, uint8_t data);
+    void            HVPPControl(uint8_t signals);
+    void            HVPPSetData(uint8_t data);
+    uint8_t         HVPPGetData();
+    void            HVPPPulseXTAL();
+    void            TPIReceive(uint8_t byte);
+    //
+    // Next byte the target sends, or -1 if it has nothing to say. Also
+    // returns the number of idle bits before the start bit.
+    //
+    int             TPITransmit(uint16_t & idleBits);
+} // namespace SimTarget
+
+#endif /* _SIM_TARGET_ */
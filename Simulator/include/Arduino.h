@@ -0,0 +1,134 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: Arduino.h          - Just enough of the Arduino core to build the sketch natively
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// Everything here runs on the simulated clock in SimCore.h: Pin accesses,
+// delays and serial traffic take as long as they would on a 16MHz Uno, but
+// return immediately in real time.
+//
+
+#ifndef _SIM_ARDUINO_
+#define _SIM_ARDUINO_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+typedef uint8_t byte;
+typedef bool    boolean;
+
+#define HIGH            1
+#define LOW             0
+#define INPUT           0
+#define OUTPUT          1
+#define INPUT_PULLUP    2
+
+#define DEC             10
+#define HEX             16
+#define OCT             8
+#define BIN             2
+
+#ifndef F_CPU
+#define F_CPU           16000000L
+#endif
+
+#define NUM_DIGITAL_PINS    20
+#define NUM_ANALOG_INPUTS   6
+
+const uint8_t SS    = 10;
+const uint8_t MOSI  = 11;
+const uint8_t MISO  = 12;
+const uint8_t SCK   = 13;
+
+const uint8_t A0    = 14;
+const uint8_t A1    = 15;
+const uint8_t A2    = 16;
+const uint8_t A3    = 17;
+const uint8_t A4    = 18;
+const uint8_t A5    = 19;
+
+void            pinMode(uint8_t pin, uint8_t mode);
+void            digitalWrite(uint8_t pin, uint8_t value);
+int             digitalRead(uint8_t pin);
+unsigned long   millis();
+unsigned long   micros();
+void            delay(unsigned long ms);
+void            delayMicroseconds(unsigned int us);
+
+//
+// avr-gcc builtin behind SMoDelayNs(), takes whole cycles of F_CPU
+//
+void            SimDelayCycles(unsigned long cycles);
+#define __builtin_avr_delay_cycles(cycles)  SimDelayCycles(cycles)
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t  write(uint8_t c) = 0;
+    virtual size_t  write(const uint8_t * buffer, size_t size);
+    size_t          write(const char * str) { return write((const uint8_t *)str, strlen(str)); }
+
+    size_t  print(const char * str)                 { return write(str); }
+    size_t  print(char c)                           { return write(uint8_t(c)); }
+    size_t  print(unsigned char n, int base = DEC)  { return print((unsigned long)n, base); }
+    size_t  print(int n, int base = DEC)            { return print((long)n, base); }
+    size_t  print(unsigned int n, int base = DEC)   { return print((unsigned long)n, base); }
+    size_t  print(long n, int base = DEC);
+    size_t  print(unsigned long n, int base = DEC);
+    size_t  print(double n, int digits = 2);
+    size_t  println()                               { return write("\r\n"); }
+    template <typename T> size_t println(T value)   { return print(value) + println(); }
+    template <typename T> size_t println(T value, int base) { return print(value, base) + println(); }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+//
+// Serial is the link to the simulated host, Serial1 goes to stderr
+//
+class HardwareSerial : public Stream {
+public:
+    HardwareSerial(int index) : fIndex(index), fBaud(0) {}
+
+    void            begin(unsigned long baud);
+    void            end();
+    virtual int     available();
+    virtual int     read();
+    virtual int     peek();
+    virtual size_t  write(uint8_t c);
+    virtual size_t  write(const uint8_t * buffer, size_t size);
+    using Print::write;
+    void            flush();
+    operator bool() { return true; }
+
+    unsigned long   Baud() const { return fBaud; }
+private:
+    int             fIndex;
+    unsigned long   fBaud;
+};
+
+#define SERIAL_RX_BUFFER_SIZE   64
+#define SERIAL_TX_BUFFER_SIZE   64
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+#define F(str)  (str)
+
+#endif /* _SIM_ARDUINO_ */
@@ -0,0 +1,43 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SPI.h              - Hardware SPI for the native build
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// The host layout talks to the target models directly, but the real ISP
+// template still names the SPI object.
+//
+
+#ifndef _SIM_SPI_
+#define _SIM_SPI_
+
+#include "Arduino.h"
+
+#define SPI_MODE0           0x00
+#define MSBFIRST            1
+#define LSBFIRST            0
+
+#define SPI_CLOCK_DIV4      0x00
+#define SPI_CLOCK_DIV16     0x01
+#define SPI_CLOCK_DIV64     0x02
+#define SPI_CLOCK_DIV128    0x03
+#define SPI_CLOCK_DIV2      0x04
+#define SPI_CLOCK_DIV8      0x05
+#define SPI_CLOCK_DIV32     0x06
+
+class SPIClass {
+public:
+    static void     begin() {}
+    static void     end() {}
+    static void     setDataMode(uint8_t) {}
+    static void     setBitOrder(uint8_t) {}
+    static void     setClockDivider(uint8_t) {}
+    static uint8_t  transfer(uint8_t) { return 0xFF; }
+};
+
+extern SPIClass SPI;
+
+#endif /* _SIM_SPI_ */
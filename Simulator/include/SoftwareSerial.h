@@ -0,0 +1,32 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: SoftwareSerial.h   - Bit banged serial port for the native build
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// Only there so SMoHWIF_Debug_Soft compiles; the host layout debugs to Serial1.
+//
+
+#ifndef _SIM_SOFTWARE_SERIAL_
+#define _SIM_SOFTWARE_SERIAL_
+
+#include "Arduino.h"
+
+class SoftwareSerial : public Stream {
+public:
+    SoftwareSerial(int, int) {}
+
+    void            begin(long) {}
+    void            end() {}
+    bool            isListening() { return false; }
+    virtual int     available() { return 0; }
+    virtual int     read() { return -1; }
+    virtual int     peek() { return -1; }
+    virtual size_t  write(uint8_t) { return 1; }
+    using Print::write;
+};
+
+#endif /* _SIM_SOFTWARE_SERIAL_ */
@@ -0,0 +1,43 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: avr/eeprom.h       - Programmer EEPROM for the native build
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// Erased at startup, like a fresh Uno. Addresses are pointers into it,
+// counted from 0, as with avr-libc.
+//
+
+#ifndef _SIM_AVR_EEPROM_
+#define _SIM_AVR_EEPROM_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define E2END   0x3FF
+
+extern uint8_t  SimEEPROM[E2END+1];
+
+static inline void
+eeprom_read_block(void * dst, const void * src, size_t n)
+{
+    memcpy(dst, &SimEEPROM[(uintptr_t)src], n);
+}
+
+static inline void
+eeprom_update_block(const void * src, void * dst, size_t n)
+{
+    memcpy(&SimEEPROM[(uintptr_t)dst], src, n);
+}
+
+static inline void
+eeprom_update_byte(uint8_t * addr, uint8_t value)
+{
+    SimEEPROM[(uintptr_t)addr] = value;
+}
+
+#endif /* _SIM_AVR_EEPROM_ */
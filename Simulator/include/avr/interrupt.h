@@ -0,0 +1,21 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: avr/interrupt.h    - Interrupt control for the native build
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// There are no interrupts on the simulated clock, so there is nothing to mask.
+//
+
+#ifndef _SIM_AVR_INTERRUPT_
+#define _SIM_AVR_INTERRUPT_
+
+inline void cli() {}
+inline void sei() {}
+
+#define ISR(vector) extern "C" void vector()
+
+#endif /* _SIM_AVR_INTERRUPT_ */
@@ -0,0 +1,56 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: avr/io.h           - Register file for the native build
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// The HWIF templates for real boards poke at I/O registers even when they
+// are not instantiated, so the names have to exist. They all map into a
+// plain array that nothing else looks at.
+//
+
+#ifndef _SIM_AVR_IO_
+#define _SIM_AVR_IO_
+
+#include <stdint.h>
+
+extern volatile uint8_t SimRegisters[0x200];
+
+#define _SFR_IO8(x)     SimRegisters[(x)+0x20]
+#define _SFR_MEM8(x)    SimRegisters[(x)]
+#define _SFR_MEM16(x)   (*(volatile uint16_t *)&SimRegisters[(x)])
+
+#define _BV(bit)        (1 << (bit))
+
+#define SREG            _SFR_IO8(0x3F)
+
+#define ACSR            _SFR_IO8(0x30)
+#define ACBG            6
+#define ACO             5
+#define ACD             7
+#define ADC             _SFR_MEM16(0x78)
+#define ADCSRA          _SFR_MEM8(0x7A)
+#define ADEN            7
+#define ADSC            6
+#define ADPS2           2
+#define ADPS1           1
+#define ADPS0           0
+#define ADCSRB          _SFR_MEM8(0x7B)
+#define ACME            6
+#define ADMUX           _SFR_MEM8(0x7C)
+#define REFS1           7
+#define REFS0           6
+
+#define TIMSK1          _SFR_MEM8(0x6F)
+#define TCCR1A          _SFR_MEM8(0x80)
+#define COM1A0          6
+#define TCCR1B          _SFR_MEM8(0x81)
+#define WGM12           3
+#define CS11            1
+#define TCNT1           _SFR_MEM16(0x84)
+#define OCR1A           _SFR_MEM16(0x88)
+
+#endif /* _SIM_AVR_IO_ */
@@ -0,0 +1,26 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: avr/pgmspace.h     - Program memory access for the native build
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#ifndef _SIM_AVR_PGMSPACE_
+#define _SIM_AVR_PGMSPACE_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s)                 (s)
+#define pgm_read_byte(addr)     (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)     (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr)    (*(const uint32_t *)(addr))
+#define memcpy_P                memcpy
+#define strcpy_P                strcpy
+#define strlen_P                strlen
+
+#endif /* _SIM_AVR_PGMSPACE_ */
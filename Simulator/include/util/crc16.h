@@ -0,0 +1,28 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: util/crc16.h       - avr-libc CRC helpers for the native build
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#ifndef _SIM_UTIL_CRC16_
+#define _SIM_UTIL_CRC16_
+
+#include <stdint.h>
+
+//
+// Same algorithm as the avr-libc inline assembly version
+//
+static inline uint16_t
+_crc_ccitt_update(uint16_t crc, uint8_t data)
+{
+    data ^= crc & 0xFF;
+    data ^= data << 4;
+
+    return ((uint16_t(data) << 8) | (crc >> 8)) ^ uint8_t(data >> 4) ^ (uint16_t(data) << 3);
+}
+
+#endif /* _SIM_UTIL_CRC16_ */
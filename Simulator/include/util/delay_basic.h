@@ -0,0 +1,27 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: util/delay_basic.h - avr-libc busy loops for the native build
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+
+#ifndef _SIM_UTIL_DELAY_BASIC_
+#define _SIM_UTIL_DELAY_BASIC_
+
+#include <stdint.h>
+
+void    SimDelayCycles(unsigned long cycles);
+
+//
+// 3 cycles per turn, 0 turns 256 times
+//
+static inline void
+_delay_loop_1(uint8_t count)
+{
+    SimDelayCycles(3*(count ? count : 256));
+}
+
+#endif /* _SIM_UTIL_DELAY_BASIC_ */
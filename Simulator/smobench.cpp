@@ -0,0 +1,457 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: smobench.cpp       - Throughput benchmark against simulated targets
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// Runs the same matrix as Tests/Makefile: For every part and protocol, enter
+// programming mode, erase, write and read back flash and EEPROM, write and
+// read back the fuses, restore them, and leave. Against the simulated
+// targets, all times are simulated, so the results are deterministic and
+// can be compared against a baseline file with a tight tolerance.
+//
+// With -P, the same sequence runs against a real board on a serial port,
+// timed by the wall clock. Only the chip actually attached can be tested,
+// so select it with -p and -c, and label the results with -B.
+//
+
+#include "SimCore.h"
+#include "SimSession.h"
+#include "SimTarget.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+
+using SimSession::Bytes;
+
+struct BenchCase {
+    const char *        fPart;
+    SimTarget::Protocol fProtocol;
+    uint32_t            fFlash;     // Image sizes
+    uint16_t            fEEPROM;
+    uint8_t             fNumFuses;
+    uint8_t             fFuses[3];
+};
+
+static const BenchCase kMatrix[] = {
+    {"attiny85",    SimTarget::kISP,      8192,  512, 3, {0x72, 0xD6, 0xFE}},
+    {"attiny84",    SimTarget::kISP,      8192,  512, 3, {0x72, 0xD6, 0xFE}},
+    {"attiny4313",  SimTarget::kISP,      4096,  256, 3, {0x72, 0xDF, 0xFF}},
+    {"attiny861",   SimTarget::kISP,      8192,  512, 3, {0x63, 0xDE, 0x00}},
+    {"attiny1634",  SimTarget::kISP,     16384,  256, 3, {0x72, 0xDE, 0x1F}},
+    {"atmega328p",  SimTarget::kISP,     28672, 1024, 3, {0x72, 0xD8, 0x06}},
+    {"atmega1284p", SimTarget::kISP,    122880, 4096, 3, {0x72, 0x89, 0xFD}},
+    {"attiny85",    SimTarget::kHVSP,     8192,  512, 3, {0x72, 0xD6, 0xFE}},
+    {"attiny84",    SimTarget::kHVSP,     8192,  512, 3, {0x72, 0xD6, 0xFE}},
+    {"attiny4313",  SimTarget::kHVPP,     4096,  256, 3, {0x72, 0xDF, 0xFF}},
+    {"attiny861",   SimTarget::kHVPP,     8192,  512, 3, {0x63, 0xDE, 0x00}},
+    {"attiny1634",  SimTarget::kHVPP,    16384,  256, 3, {0x72, 0xDE, 0x1F}},
+    {"atmega328p",  SimTarget::kHVPP,    28672, 1024, 3, {0x72, 0xD8, 0x06}},
+    {"atmega1284p", SimTarget::kHVPP,   122880, 4096, 3, {0x72, 0x89, 0xFD}},
+    {"attiny10",    SimTarget::kTPI,      1024,    0, 1, {0xFB}},
+};
+
+enum {
+    kSetup, kErase, kFlashW, kFlashR, kEEPROMW, kEEPROMR, kFuses, kTotal, kNumPhases
+};
+
+static const char * kPhaseName[kNumPhases] = {
+    "Setup", "Erase", "Flash W", "R", "EEPROM W", "R", "Fuses", "Total"
+};
+
+static const char * kPhaseKey[kNumPhases] = {
+    "setup", "erase", "flashW", "flashR", "eepromW", "eepromR", "fuses", "total"
+};
+
+static const char *
+ProtocolName(SimTarget::Protocol protocol)
+{
+    switch (protocol) {
+    case SimTarget::kISP:   return "isp";
+    case SimTarget::kHVSP:  return "hvsp";
+    case SimTarget::kHVPP:  return "hvpp";
+    default:                return "tpi";
+    }
+}
+
+//
+// Deterministic pseudo random image, different for every part
+//
+static Bytes
+Image(const char * seed, size_t size)
+{
+    uint32_t state = 2166136261u;
+    while (*seed)
+        state = (state ^ *seed++) * 16777619u;
+    Bytes image(size);
+    for (size_t i=0; i<size; ++i) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        image[i] = state >> 24;
+    }
+    return image;
+}
+
+//
+// Intel hex images as written by Tools/hexer, gaps filled with 0xFF
+//
+static bool
+ReadHex(const char * path, Bytes & image)
+{
+    FILE * f = fopen(path, "r");
+    if (!f)
+        return false;
+    image.clear();
+    uint32_t    base = 0;
+    char        line[128];
+    while (fgets(line, sizeof(line), f)) {
+        unsigned len, addr, type;
+        if (line[0] != ':' || sscanf(line+1, "%2x%4x%2x", &len, &addr, &type) != 3)
+            continue;
+        uint8_t data[32];
+        for (unsigned i=0; i<len && i<sizeof(data); ++i) {
+            unsigned byte;
+            sscanf(line+9+2*i, "%2x", &byte);
+            data[i] = byte;
+        }
+        switch (type) {
+        case 0:
+            if (image.size() < base+addr+len)
+                image.resize(base+addr+len, 0xFF);
+            memcpy(&image[base+addr], data, len);
+            break;
+        case 2:
+            base = ((data[0] << 8) | data[1]) << 4;
+            break;
+        case 4:
+            base = ((data[0] << 8) | data[1]) << 16;
+            break;
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+static bool     sVerbose;
+static uint64_t sLatency;
+
+static bool
+Check(bool ok, const BenchCase & bench, const char * what)
+{
+    if (!ok)
+        fprintf(stderr, "%s %s: %s %s\n", bench.fPart, ProtocolName(bench.fProtocol),
+                what, SimSession::Error().c_str());
+    return ok;
+}
+
+static bool
+Verify(const BenchCase & bench, const char * what, const Bytes & expected,
+       const uint8_t * actual, size_t size)
+{
+    if (expected.size() > size)
+        size = 0;
+    for (size_t i=0; i<expected.size(); ++i)
+        if (!size || expected[i] != actual[i]) {
+            fprintf(stderr, "%s %s: %s mismatch at 0x%04zx\n", bench.fPart,
+                    ProtocolName(bench.fProtocol), what, i);
+            return false;
+        }
+    return true;
+}
+
+static bool
+Run(const BenchCase & bench, const Bytes & flash, const Bytes & eeprom,
+    const Bytes & fuses, double * seconds)
+{
+    const SimPart * part = SimTarget::FindPart(bench.fPart);
+    bool            real = SimSession::IsOpen();
+    if (!real)
+        SimTarget::Attach(part);
+    SimSession::Begin(sLatency);
+
+    Bytes       data;
+    Bytes       oldFuses;
+    uint32_t    overruns= SimLink::Overruns();
+    uint64_t    start   = SimSession::Time();
+    uint64_t    mark    = start;
+
+#define PHASE(p)    do { uint64_t now = SimSession::Time(); \
+                         seconds[p] = (now-mark)*1e-9; mark = now; } while (0)
+
+    if (!Check(SimSession::Enter(bench.fProtocol, part), bench, "Enter"))
+        return false;
+    PHASE(kSetup);
+    if (!Check(SimSession::Erase(), bench, "Erase"))
+        return false;
+    PHASE(kErase);
+    if (!Check(SimSession::Write(false, flash), bench, "Flash write"))
+        return false;
+    PHASE(kFlashW);
+    if (!Check(SimSession::Read(false, data, flash.size()), bench, "Flash read")
+     || !Verify(bench, "Flash readback", flash, &data[0], data.size())
+    )
+        return false;
+    PHASE(kFlashR);
+    if (eeprom.size()) {
+        if (!Check(SimSession::Write(true, eeprom), bench, "EEPROM write"))
+            return false;
+        PHASE(kEEPROMW);
+        if (!Check(SimSession::Read(true, data, eeprom.size()), bench, "EEPROM read")
+         || !Verify(bench, "EEPROM readback", eeprom, &data[0], data.size())
+        )
+            return false;
+        PHASE(kEEPROMR);
+    } else {
+        seconds[kEEPROMW] = seconds[kEEPROMR] = 0.0;
+    }
+    //
+    // Like Tools/RunTest, put the original fuses back afterwards
+    //
+    if (!Check(SimSession::ReadFuses(oldFuses, fuses.size()), bench, "Fuse read")
+     || !Check(SimSession::WriteFuses(fuses), bench, "Fuse write")
+     || !Check(SimSession::ReadFuses(data, fuses.size()), bench, "Fuse read")
+     || !Verify(bench, "Fuse readback", fuses, &data[0], data.size())
+     || !Check(SimSession::WriteFuses(oldFuses), bench, "Fuse restore")
+     || !Check(SimSession::Leave(), bench, "Leave")
+    )
+        return false;
+    PHASE(kFuses);
+    seconds[kTotal] = (SimSession::Time()-start)*1e-9;
+
+    if (real)
+        return true;
+    //
+    // Readback could in theory agree with a broken model, so check the
+    // target's memories as well
+    //
+    if (!Verify(bench, "Flash contents", flash, &SimTarget::Flash()[0], SimTarget::Flash().size())
+     || (eeprom.size() && !Verify(bench, "EEPROM contents", eeprom, &SimTarget::EEPROM()[0], SimTarget::EEPROM().size()))
+    )
+        return false;
+    for (size_t i=0; i<oldFuses.size(); ++i)
+        if (SimTarget::Fuse(i) != oldFuses[i]) {
+            fprintf(stderr, "%s %s: Fuse %zu is %02X\n", bench.fPart,
+                    ProtocolName(bench.fProtocol), i, SimTarget::Fuse(i));
+            return false;
+        }
+    if (SimLink::Overruns() != overruns) {
+        fprintf(stderr, "%s %s: %u bytes lost to serial overruns\n", bench.fPart,
+                ProtocolName(bench.fProtocol), SimLink::Overruns()-overruns);
+        return false;
+    }
+    if (sVerbose) {
+        const SimTarget::Stats & stats = SimTarget::Statistics();
+        fprintf(stderr, "%s %s: %u bus operations, %u writes, %u ignored, %.3fs busy\n",
+                bench.fPart, ProtocolName(bench.fProtocol), stats.fBusOps,
+                stats.fWrites, stats.fIgnored, stats.fBusyNs*1e-9);
+    }
+    return true;
+}
+
+typedef std::map<std::string, double> Baseline;
+
+static std::string
+Key(const BenchCase & bench, const char * board, int phase)
+{
+    return std::string(bench.fPart)+" "+ProtocolName(bench.fProtocol)+" "+board+" "+kPhaseKey[phase];
+}
+
+//
+// Results and baselines share a format: One line per part, protocol and
+// board, with the phase times in seconds in the same order as the report.
+//
+static bool
+ReadBaseline(const char * path, Baseline & baseline)
+{
+    FILE * f = fopen(path, "r");
+    if (!f)
+        return false;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        char    part[32], protocol[8], board[32];
+        double  t[kNumPhases];
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%31s %7s %31s %lf %lf %lf %lf %lf %lf %lf %lf", part, protocol, board,
+                   &t[0], &t[1], &t[2], &t[3], &t[4], &t[5], &t[6], &t[7]) != 3+kNumPhases)
+            continue;
+        for (int p=0; p<kNumPhases; ++p)
+            baseline[std::string(part)+" "+protocol+" "+board+" "+kPhaseKey[p]] = t[p];
+    }
+    fclose(f);
+    return true;
+}
+
+static FILE *
+WriteResultsHeader(const char * path)
+{
+    FILE * f = fopen(path, "w");
+    if (!f)
+        return 0;
+    fprintf(f, "# part protocol board");
+    for (int p=0; p<kNumPhases; ++p)
+        fprintf(f, " %s", kPhaseKey[p]);
+    fprintf(f, "\n");
+    return f;
+}
+
+static Bytes
+ParseFuses(const char * spec)
+{
+    Bytes fuses;
+    while (*spec) {
+        char * end;
+        fuses.push_back(strtoul(spec, &end, 16));
+        spec = *end ? end+1 : end;
+    }
+    return fuses;
+}
+
+static void
+Usage()
+{
+    fprintf(stderr,
+            "Usage: smobench [-v] [-p part] [-c protocol] [-l latency_us]\n"
+            "                [-P port] [-B board] [-i flash.hex] [-e eeprom.hex] [-f fuses]\n"
+            "                [-o results] [-b baseline [-t tolerance_percent] [-u]]\n");
+    exit(2);
+}
+
+int
+main(int argc, char * argv[])
+{
+    const char *    partFilter      = 0;
+    const char *    protocolFilter  = 0;
+    const char *    baselinePath    = 0;
+    const char *    resultsPath     = 0;
+    const char *    port            = 0;
+    const char *    board           = 0;
+    const char *    flashPath       = 0;
+    const char *    eepromPath      = 0;
+    const char *    fuseSpec        = 0;
+    bool            update          = false;
+    double          tolerance       = 2.0;
+    double          latency         = 0.0;
+
+    int ch;
+    while ((ch = getopt(argc, argv, "B:b:c:e:f:i:l:o:P:p:t:uv")) != -1)
+        switch (ch) {
+        case 'B':   board           = optarg;           break;
+        case 'b':   baselinePath    = optarg;           break;
+        case 'c':   protocolFilter  = optarg;           break;
+        case 'e':   eepromPath      = optarg;           break;
+        case 'f':   fuseSpec        = optarg;           break;
+        case 'i':   flashPath       = optarg;           break;
+        case 'l':   latency         = atof(optarg);     break;
+        case 'o':   resultsPath     = optarg;           break;
+        case 'P':   port            = optarg;           break;
+        case 'p':   partFilter      = optarg;           break;
+        case 't':   tolerance       = atof(optarg);     break;
+        case 'u':   update          = true;             break;
+        case 'v':   sVerbose        = true;             break;
+        default:    Usage();
+        }
+    if (update && !baselinePath)
+        Usage();
+    if (update)
+        resultsPath = baselinePath;
+    if (!board)
+        board = port ? "board" : "sim";
+
+    Bytes flashImage, eepromImage;
+    if (flashPath && !ReadHex(flashPath, flashImage)) {
+        fprintf(stderr, "smobench: Can't read %s\n", flashPath);
+        return 2;
+    }
+    if (eepromPath && !ReadHex(eepromPath, eepromImage)) {
+        fprintf(stderr, "smobench: Can't read %s\n", eepromPath);
+        return 2;
+    }
+    Baseline    baseline;
+    if (baselinePath && !update && !ReadBaseline(baselinePath, baseline)) {
+        fprintf(stderr, "smobench: Can't read baseline %s\n", baselinePath);
+        return 2;
+    }
+    FILE *      results = 0;
+    if (resultsPath && !(results = WriteResultsHeader(resultsPath))) {
+        fprintf(stderr, "smobench: Can't write %s\n", resultsPath);
+        return 2;
+    }
+
+    if (port) {
+        if (!SimSession::Open(port)) {
+            fprintf(stderr, "smobench: No programmer on %s: %s\n", port, SimSession::Error().c_str());
+            return 2;
+        }
+    } else {
+        setup();
+    }
+    sLatency = uint64_t(latency*1000.0);
+
+    printf("%-12s %-5s", "Part", "");
+    for (int p=0; p<kNumPhases; ++p)
+        printf(" %9s", kPhaseName[p]);
+    printf("\n");
+
+    int failures    = 0;
+    int regressions = 0;
+    for (size_t i=0; i<sizeof(kMatrix)/sizeof(kMatrix[0]); ++i) {
+        const BenchCase & bench = kMatrix[i];
+        if (partFilter && !strstr(bench.fPart, partFilter))
+            continue;
+        if (protocolFilter && strcmp(ProtocolName(bench.fProtocol), protocolFilter))
+            continue;
+        Bytes flash  = flashPath  ? flashImage  : Image(bench.fPart, bench.fFlash);
+        Bytes eeprom = eepromPath ? eepromImage : Image(bench.fPart+1, bench.fEEPROM);
+        Bytes fuses  = fuseSpec   ? ParseFuses(fuseSpec) : Bytes(bench.fFuses, bench.fFuses+bench.fNumFuses);
+        if (!bench.fEEPROM)
+            eeprom.clear();
+        double seconds[kNumPhases];
+        if (!Run(bench, flash, eeprom, fuses, seconds)) {
+            printf("%-12s %-5s FAILED\n", bench.fPart, ProtocolName(bench.fProtocol));
+            ++failures;
+            continue;
+        }
+        printf("%-12s %-5s", bench.fPart, ProtocolName(bench.fProtocol));
+        for (int p=0; p<kNumPhases; ++p)
+            printf(" %8.3fs", seconds[p]);
+        if (results) {
+            fprintf(results, "%s %s %s", bench.fPart, ProtocolName(bench.fProtocol), board);
+            for (int p=0; p<kNumPhases; ++p)
+                fprintf(results, " %.4f", seconds[p]);
+            fprintf(results, "\n");
+        }
+        if (baselinePath && !update) {
+            for (int p=0; p<kNumPhases; ++p) {
+                Baseline::iterator b = baseline.find(Key(bench, board, p));
+                if (b == baseline.end())
+                    continue;
+                //
+                // Ignore jitter on phases too short to matter
+                //
+                if (seconds[p] > b->second*(1.0+tolerance/100.0) && seconds[p]-b->second > 0.001) {
+                    printf("\n  %s %.1f%% slower than baseline %.3fs", kPhaseKey[p],
+                           (seconds[p]/b->second-1.0)*100.0, b->second);
+                    ++regressions;
+                }
+            }
+        }
+        printf("\n");
+    }
+    if (results)
+        fclose(results);
+    if (failures || regressions) {
+        fprintf(stderr, "\n*** smobench: %d failed, %d regressed ***\n\n", failures, regressions);
+        return 1;
+    }
+    return 0;
+}
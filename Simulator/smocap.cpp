@@ -0,0 +1,542 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: smocap.cpp         - Capture, analyze and replay STK500v2 sessions
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+//   smocap record -P /dev/ttyACM0 -L /tmp/smo -o session.cap
+//      Sits between avrdude (pointed at /tmp/smo) and the programmer,
+//      logging every chunk of bytes with the time it passed through.
+//   smocap analyze session.cap
+//      Splits each command into host think time (from the previous response
+//      to the command), wire time (both frames at the baud rate), and the
+//      rest, which is USB latency plus firmware execution. The fastest
+//      command of the session gives a floor for the USB round trip; what
+//      exceeds it is charged to the firmware.
+//   smocap replay -p attiny85 session.cap
+//      Sends the same commands, with the same think times, to the native
+//      build of the sketch and a simulated chip, and analyzes that.
+//
+// Capture files are text: A header line, then one line per chunk with the
+// time in seconds, '>' for host to programmer or '<' for the other way,
+// and the bytes in hex.
+//
+
+#include "SimCore.h"
+#include "SimHost.h"
+#include "SimSession.h"
+#include "SimTarget.h"
+#include "stk_proto.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+using SimSession::Bytes;
+
+struct Chunk {
+    uint64_t    fTime;
+    bool        fToHost;
+    Bytes       fData;
+};
+
+struct Frame {
+    uint64_t    fStart;     // Time of the chunk with the first byte
+    uint64_t    fEnd;       // Time of the chunk with the last byte
+    uint8_t     fSequence;
+    Bytes       fBody;
+};
+
+struct Exchange {
+    Frame       fCommand;
+    Frame       fResponse;
+    bool        fAnswered;
+};
+
+static const struct { uint8_t fCmd; const char * fName; } kCommands[] = {
+    {CMD_SIGN_ON,                   "SIGN_ON"},
+    {CMD_SET_PARAMETER,             "SET_PARAMETER"},
+    {CMD_GET_PARAMETER,             "GET_PARAMETER"},
+    {CMD_LOAD_ADDRESS,              "LOAD_ADDRESS"},
+    {CMD_ENTER_PROGMODE_ISP,        "ENTER_PROGMODE_ISP"},
+    {CMD_LEAVE_PROGMODE_ISP,        "LEAVE_PROGMODE_ISP"},
+    {CMD_CHIP_ERASE_ISP,            "CHIP_ERASE_ISP"},
+    {CMD_PROGRAM_FLASH_ISP,         "PROGRAM_FLASH_ISP"},
+    {CMD_READ_FLASH_ISP,            "READ_FLASH_ISP"},
+    {CMD_PROGRAM_EEPROM_ISP,        "PROGRAM_EEPROM_ISP"},
+    {CMD_READ_EEPROM_ISP,           "READ_EEPROM_ISP"},
+    {CMD_PROGRAM_FUSE_ISP,          "PROGRAM_FUSE_ISP"},
+    {CMD_READ_FUSE_ISP,             "READ_FUSE_ISP"},
+    {CMD_PROGRAM_LOCK_ISP,          "PROGRAM_LOCK_ISP"},
+    {CMD_READ_LOCK_ISP,             "READ_LOCK_ISP"},
+    {CMD_READ_SIGNATURE_ISP,        "READ_SIGNATURE_ISP"},
+    {CMD_READ_OSCCAL_ISP,           "READ_OSCCAL_ISP"},
+    {CMD_SPI_MULTI,                 "SPI_MULTI"},
+    {CMD_ENTER_PROGMODE_PP,         "ENTER_PROGMODE_PP"},
+    {CMD_LEAVE_PROGMODE_PP,         "LEAVE_PROGMODE_PP"},
+    {CMD_CHIP_ERASE_PP,             "CHIP_ERASE_PP"},
+    {CMD_PROGRAM_FLASH_PP,          "PROGRAM_FLASH_PP"},
+    {CMD_READ_FLASH_PP,             "READ_FLASH_PP"},
+    {CMD_PROGRAM_EEPROM_PP,         "PROGRAM_EEPROM_PP"},
+    {CMD_READ_EEPROM_PP,            "READ_EEPROM_PP"},
+    {CMD_PROGRAM_FUSE_PP,           "PROGRAM_FUSE_PP"},
+    {CMD_READ_FUSE_PP,              "READ_FUSE_PP"},
+    {CMD_PROGRAM_LOCK_PP,           "PROGRAM_LOCK_PP"},
+    {CMD_READ_LOCK_PP,              "READ_LOCK_PP"},
+    {CMD_READ_SIGNATURE_PP,         "READ_SIGNATURE_PP"},
+    {CMD_READ_OSCCAL_PP,            "READ_OSCCAL_PP"},
+    {CMD_SET_CONTROL_STACK,         "SET_CONTROL_STACK"},
+    {CMD_ENTER_PROGMODE_HVSP,       "ENTER_PROGMODE_HVSP"},
+    {CMD_LEAVE_PROGMODE_HVSP,       "LEAVE_PROGMODE_HVSP"},
+    {CMD_CHIP_ERASE_HVSP,           "CHIP_ERASE_HVSP"},
+    {CMD_PROGRAM_FLASH_HVSP,        "PROGRAM_FLASH_HVSP"},
+    {CMD_READ_FLASH_HVSP,           "READ_FLASH_HVSP"},
+    {CMD_PROGRAM_EEPROM_HVSP,       "PROGRAM_EEPROM_HVSP"},
+    {CMD_READ_EEPROM_HVSP,          "READ_EEPROM_HVSP"},
+    {CMD_PROGRAM_FUSE_HVSP,         "PROGRAM_FUSE_HVSP"},
+    {CMD_READ_FUSE_HVSP,            "READ_FUSE_HVSP"},
+    {CMD_PROGRAM_LOCK_HVSP,         "PROGRAM_LOCK_HVSP"},
+    {CMD_READ_LOCK_HVSP,            "READ_LOCK_HVSP"},
+    {CMD_READ_SIGNATURE_HVSP,       "READ_SIGNATURE_HVSP"},
+    {CMD_READ_OSCCAL_HVSP,          "READ_OSCCAL_HVSP"},
+    {CMD_XPROG,                     "XPROG"},
+    {CMD_XPROG_SETMODE,             "XPROG_SETMODE"},
+    {CMD_SCRATCHMONKEY_REGION_START,"SMO_REGION_START"},
+    {CMD_SCRATCHMONKEY_REGION_DATA, "SMO_REGION_DATA"},
+    {CMD_SCRATCHMONKEY_PAGE_HASH,   "SMO_PAGE_HASH"},
+    {CMD_SCRATCHMONKEY_STORE,       "SMO_STORE"},
+    {CMD_SCRATCHMONKEY_PATCH,       "SMO_PATCH"},
+    {CMD_SCRATCHMONKEY_SCRIPT,      "SMO_SCRIPT"},
+    {CMD_SCRATCHMONKEY_STATS,       "SMO_STATS"},
+    {CMD_SCRATCHMONKEY_TRACE,       "SMO_TRACE"},
+    {CMD_SCRATCHMONKEY_LINK,        "SMO_LINK"},
+};
+
+static std::string
+CommandName(uint8_t cmd)
+{
+    for (size_t i=0; i<sizeof(kCommands)/sizeof(kCommands[0]); ++i)
+        if (kCommands[i].fCmd == cmd)
+            return kCommands[i].fName;
+    char name[16];
+    snprintf(name, sizeof(name), "CMD_%02X", cmd);
+    return name;
+}
+
+//
+// Capture files
+//
+static void
+WriteChunk(FILE * f, uint64_t time, bool toHost, const uint8_t * data, size_t size)
+{
+    fprintf(f, "%.6f %c", time*1e-9, toHost ? '<' : '>');
+    for (size_t i=0; i<size; ++i)
+        fprintf(f, " %02x", data[i]);
+    fprintf(f, "\n");
+}
+
+static Bytes
+Framed(uint8_t sequence, const Bytes & body)
+{
+    Bytes frame;
+    frame.push_back(MESSAGE_START);
+    frame.push_back(sequence);
+    frame.push_back(body.size() >> 8);
+    frame.push_back(body.size() & 0xFF);
+    frame.push_back(TOKEN);
+    frame.insert(frame.end(), body.begin(), body.end());
+    uint8_t sum = 0;
+    for (size_t i=0; i<frame.size(); ++i)
+        sum ^= frame[i];
+    frame.push_back(sum);
+    return frame;
+}
+
+static bool
+ReadCapture(const char * path, std::vector<Chunk> & chunks)
+{
+    FILE * f = fopen(path, "r");
+    if (!f)
+        return false;
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+        double  time;
+        char    dir;
+        int     used;
+        if (line[0] == '#' || sscanf(line, "%lf %c%n", &time, &dir, &used) != 2)
+            continue;
+        Chunk chunk;
+        chunk.fTime     = uint64_t(time*1e9 + 0.5);
+        chunk.fToHost   = dir == '<';
+        for (char * p = line+used; ; ) {
+            char *   end;
+            unsigned long byte = strtoul(p, &end, 16);
+            if (end == p)
+                break;
+            chunk.fData.push_back(byte);
+            p = end;
+        }
+        chunks.push_back(chunk);
+    }
+    fclose(f);
+    return true;
+}
+
+//
+// Frame parser, same state machine as SMoCommand::GetNextCommand. Garbage
+// between frames and frames with bad checksums are skipped.
+//
+class FrameParser {
+public:
+    FrameParser() : fState(0) {}
+
+    bool Feed(uint8_t byte, uint64_t time, Frame & frame) {
+        switch (fState) {
+        case 0:
+            if (byte != MESSAGE_START)
+                return false;
+            fFrame.fStart   = time;
+            fSum            = byte;
+            fState          = 1;
+            return false;
+        case 1:
+            fFrame.fSequence= byte;
+            fState          = 2;
+            break;
+        case 2:
+            fSize           = byte << 8;
+            fState          = 3;
+            break;
+        case 3:
+            fSize          |= byte;
+            fState          = 4;
+            break;
+        case 4:
+            fState          = byte == TOKEN ? (fSize ? 5 : 6) : 0;
+            fFrame.fBody.clear();
+            break;
+        case 5:
+            fFrame.fBody.push_back(byte);
+            if (fFrame.fBody.size() == fSize)
+                fState      = 6;
+            break;
+        case 6:
+            fState          = 0;
+            fFrame.fEnd     = time;
+            if ((fSum ^ byte) != 0)
+                return false;
+            frame = fFrame;
+            return true;
+        }
+        fSum ^= byte;
+        return false;
+    }
+private:
+    int         fState;
+    uint16_t    fSize;
+    uint8_t     fSum;
+    Frame       fFrame;
+};
+
+static void
+Pair(const std::vector<Chunk> & chunks, std::vector<Exchange> & exchanges)
+{
+    FrameParser toProgrammer, toHost;
+    for (size_t c=0; c<chunks.size(); ++c) {
+        const Chunk & chunk = chunks[c];
+        for (size_t i=0; i<chunk.fData.size(); ++i) {
+            Frame frame;
+            if (!chunk.fToHost) {
+                if (toProgrammer.Feed(chunk.fData[i], chunk.fTime, frame)) {
+                    Exchange x;
+                    x.fCommand  = frame;
+                    x.fAnswered = false;
+                    exchanges.push_back(x);
+                }
+            } else if (toHost.Feed(chunk.fData[i], chunk.fTime, frame)) {
+                for (size_t x=exchanges.size(); x-- > 0; )
+                    if (!exchanges[x].fAnswered
+                     && exchanges[x].fCommand.fSequence == frame.fSequence
+                    ) {
+                        exchanges[x].fResponse = frame;
+                        exchanges[x].fAnswered = true;
+                        break;
+                    }
+            }
+        }
+    }
+}
+
+//
+// Analysis
+//
+struct Breakdown {
+    uint32_t    fCount;
+    uint64_t    fThink;
+    uint64_t    fWire;
+    uint64_t    fDevice;
+};
+
+static uint64_t
+WireTime(const Exchange & x, uint32_t baud)
+{
+    size_t bytes = x.fCommand.fBody.size() + 6 + (x.fAnswered ? x.fResponse.fBody.size() + 6 : 0);
+    return bytes * 10000000000ULL / baud;
+}
+
+static void
+Analyze(const std::vector<Exchange> & exchanges, uint32_t baud, bool verbose)
+{
+    std::map<std::string, Breakdown>  byCommand;
+    Breakdown       total   = {0, 0, 0, 0};
+    uint64_t        floor   = ~0ULL;
+    uint64_t        prevEnd = exchanges.empty() ? 0 : exchanges[0].fCommand.fStart;
+    std::vector<uint64_t> device(exchanges.size());
+
+    for (size_t i=0; i<exchanges.size(); ++i) {
+        const Exchange & x = exchanges[i];
+        if (!x.fAnswered)
+            continue;
+        uint64_t wire   = WireTime(x, baud);
+        uint64_t span   = x.fResponse.fEnd - x.fCommand.fStart;
+        device[i]       = span > wire ? span - wire : 0;
+        floor           = std::min(floor, device[i]);
+    }
+    if (verbose)
+        printf("%5s %-22s %6s %6s %9s %9s %9s\n", "#", "Command", "Out", "In", "Think", "Wire", "Device");
+    for (size_t i=0; i<exchanges.size(); ++i) {
+        const Exchange & x = exchanges[i];
+        std::string name = CommandName(x.fCommand.fBody.empty() ? 0 : x.fCommand.fBody[0]);
+        if (!x.fAnswered) {
+            if (verbose)
+                printf("%5zu %-22s %6zu    --- no response\n", i, name.c_str(), x.fCommand.fBody.size());
+            continue;
+        }
+        uint64_t think  = x.fCommand.fStart > prevEnd ? x.fCommand.fStart - prevEnd : 0;
+        uint64_t wire   = WireTime(x, baud);
+        prevEnd         = x.fResponse.fEnd;
+        if (verbose)
+            printf("%5zu %-22s %6zu %6zu %8.2fms %8.2fms %8.2fms\n", i, name.c_str(),
+                   x.fCommand.fBody.size(), x.fResponse.fBody.size(),
+                   think*1e-6, wire*1e-6, device[i]*1e-6);
+        Breakdown & b = byCommand[name];
+        ++b.fCount;         ++total.fCount;
+        b.fThink += think;  total.fThink += think;
+        b.fWire  += wire;   total.fWire  += wire;
+        b.fDevice+= device[i]; total.fDevice+= device[i];
+    }
+    if (!total.fCount) {
+        printf("No complete exchanges\n");
+        return;
+    }
+    printf("\n%-22s %6s %10s %10s %10s\n", "Command", "Count", "Think", "Wire", "Device");
+    for (std::map<std::string, Breakdown>::iterator b = byCommand.begin(); b != byCommand.end(); ++b)
+        printf("%-22s %6u %9.3fs %9.3fs %9.3fs\n", b->first.c_str(), b->second.fCount,
+               b->second.fThink*1e-9, b->second.fWire*1e-9, b->second.fDevice*1e-9);
+    uint64_t sum    = total.fThink + total.fWire + total.fDevice;
+    uint64_t usb    = floor * total.fCount;
+    uint64_t fw     = total.fDevice - usb;
+    printf("%-22s %6u %9.3fs %9.3fs %9.3fs\n\n", "Total", total.fCount,
+           total.fThink*1e-9, total.fWire*1e-9, total.fDevice*1e-9);
+    printf("Host think time      %9.3fs %5.1f%%\n", total.fThink*1e-9, 100.0*total.fThink/sum);
+    printf("Wire time            %9.3fs %5.1f%%\n", total.fWire*1e-9,  100.0*total.fWire/sum);
+    printf("USB latency (est.)   %9.3fs %5.1f%%  (%.2fms per round trip)\n",
+           usb*1e-9, 100.0*usb/sum, floor*1e-6);
+    printf("Firmware (est.)      %9.3fs %5.1f%%\n", fw*1e-9, 100.0*fw/sum);
+}
+
+//
+// Record
+//
+static volatile sig_atomic_t sDone;
+
+static void
+Quit(int)
+{
+    sDone = 1;
+}
+
+static int
+Record(const char * port, const char * link, const char * output)
+{
+    int programmer = SimHost::OpenSerial(port);
+    if (programmer < 0) {
+        perror(port);
+        return 1;
+    }
+    FILE * cap = output ? fopen(output, "w") : stdout;
+    if (!cap) {
+        perror(output);
+        return 1;
+    }
+    int slave;
+    int host = SimHost::OpenPTY(slave);
+    if (link) {
+        unlink(link);
+        if (symlink(SimHost::PTYName(host), link) < 0) {
+            perror("smocap: symlink");
+            return 1;
+        }
+    }
+    fprintf(stderr, "smocap: %s on %s\n", port, link ? link : SimHost::PTYName(host));
+    fprintf(cap, "# smocap %s\n", port);
+
+    signal(SIGINT,  Quit);
+    signal(SIGTERM, Quit);
+    signal(SIGHUP,  Quit);
+
+    uint64_t epoch = SimHost::WallClock();
+    while (!sDone) {
+        struct pollfd pfd[2] = {{host, POLLIN, 0}, {programmer, POLLIN, 0}};
+        if (poll(pfd, 2, 100) <= 0)
+            continue;
+        uint8_t buf[512];
+        for (int i=0; i<2; ++i) {
+            if (!(pfd[i].revents & POLLIN))
+                continue;
+            ssize_t len = read(pfd[i].fd, buf, sizeof(buf));
+            if (len <= 0)
+                continue;
+            WriteChunk(cap, SimHost::WallClock()-epoch, i==1, buf, len);
+            if (write(pfd[1-i].fd, buf, len) < 0 && errno != EAGAIN)
+                sDone = 1;
+        }
+        fflush(cap);
+    }
+    if (link)
+        unlink(link);
+    if (cap != stdout)
+        fclose(cap);
+    return 0;
+}
+
+//
+// Replay
+//
+static int
+Replay(const std::vector<Exchange> & captured, const char * partName, uint32_t baud,
+       const char * output, bool verbose)
+{
+    const SimPart * part = SimTarget::FindPart(partName);
+    if (!part) {
+        fprintf(stderr, "smocap: Unknown part %s\n", partName);
+        return 2;
+    }
+    SimTarget::Attach(part);
+    setup();
+    SimSession::Begin(0);
+
+    //
+    // Reconstruct a capture from the simulated exchanges, so the analysis
+    // below is the same as for the real thing.
+    //
+    std::vector<Exchange>   replayed;
+    uint64_t                prevEnd = captured.empty() ? 0 : captured[0].fCommand.fStart;
+    uint64_t                epoch   = SimSession::Time();
+    FILE *                  cap     = output ? fopen(output, "w") : 0;
+    if (cap)
+        fprintf(cap, "# smocap replay %s\n", partName);
+    for (size_t i=0; i<captured.size(); ++i) {
+        const Exchange & c = captured[i];
+        if (c.fCommand.fStart > prevEnd)
+            SimSession::Wait(c.fCommand.fStart - prevEnd);
+        if (c.fAnswered)
+            prevEnd = c.fResponse.fEnd;
+
+        Exchange x;
+        x.fCommand          = c.fCommand;
+        x.fCommand.fStart   = SimSession::Time() - epoch;
+        x.fAnswered         = SimSession::Transact(c.fCommand.fBody, x.fResponse.fBody);
+        x.fCommand.fEnd     = x.fCommand.fStart + (c.fCommand.fBody.size()+6)*SimLink::ByteTime();
+        x.fResponse.fEnd    = SimSession::Time() - epoch;
+        x.fResponse.fStart  = x.fResponse.fEnd - (x.fResponse.fBody.size()+6)*SimLink::ByteTime();
+        if (!x.fAnswered) {
+            fprintf(stderr, "smocap: Replay stopped at command %zu: %s\n", i, SimSession::Error().c_str());
+            break;
+        }
+        if (c.fAnswered && verbose && x.fResponse.fBody != c.fResponse.fBody)
+            printf("Command %zu (%s): response differs from capture\n", i,
+                   CommandName(c.fCommand.fBody[0]).c_str());
+        if (cap) {
+            Bytes command  = Framed(c.fCommand.fSequence, c.fCommand.fBody);
+            Bytes response = Framed(c.fCommand.fSequence, x.fResponse.fBody);
+            WriteChunk(cap, x.fCommand.fStart, false, &command[0], command.size());
+            WriteChunk(cap, x.fResponse.fEnd, true, &response[0], response.size());
+        }
+        replayed.push_back(x);
+    }
+    if (cap)
+        fclose(cap);
+    Analyze(replayed, baud, verbose);
+    return 0;
+}
+
+static void
+Usage()
+{
+    fprintf(stderr,
+            "Usage: smocap record -P port [-L link] [-o capture]\n"
+            "       smocap analyze [-b baud] [-v] capture\n"
+            "       smocap replay [-p part] [-b baud] [-v] capture\n");
+    exit(2);
+}
+
+int
+main(int argc, char * argv[])
+{
+    if (argc < 2)
+        Usage();
+    const char *    mode    = argv[1];
+    const char *    port    = 0;
+    const char *    link    = 0;
+    const char *    output  = 0;
+    const char *    part    = "attiny85";
+    uint32_t        baud    = 115200;
+    bool            verbose = false;
+
+    --argc; ++argv;
+    int ch;
+    while ((ch = getopt(argc, argv, "b:L:o:P:p:v")) != -1)
+        switch (ch) {
+        case 'b':   baud    = atoi(optarg); break;
+        case 'L':   link    = optarg;       break;
+        case 'o':   output  = optarg;       break;
+        case 'P':   port    = optarg;       break;
+        case 'p':   part    = optarg;       break;
+        case 'v':   verbose = true;         break;
+        default:    Usage();
+        }
+    argc -= optind;
+    argv += optind;
+
+    if (!strcmp(mode, "record")) {
+        if (!port)
+            Usage();
+        return Record(port, link, output);
+    }
+    if (argc != 1 || (strcmp(mode, "analyze") && strcmp(mode, "replay")))
+        Usage();
+
+    std::vector<Chunk>      chunks;
+    std::vector<Exchange>   exchanges;
+    if (!ReadCapture(argv[0], chunks)) {
+        perror(argv[0]);
+        return 1;
+    }
+    Pair(chunks, exchanges);
+    if (!strcmp(mode, "analyze")) {
+        Analyze(exchanges, baud, verbose);
+        return 0;
+    }
+    return Replay(exchanges, part, baud, output, verbose);
+}
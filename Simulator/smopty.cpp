@@ -0,0 +1,175 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: nil -*-
+//
+// ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+//
+// File: smopty.cpp         - Virtual ScratchMonkey on a pseudo terminal
+//
+// Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+// All rights reserved.
+//
+// Runs the native build of the sketch in real time behind a pseudo terminal,
+// with a simulated chip attached, so avrdude, Tools/RunTest and the
+// Tests/Makefile matrix can talk to it like to a real programmer:
+//
+//   Simulator/smopty -p attiny85 -L /tmp/smo &
+//   SERIALPORT=/tmp/smo make -C Tests attiny85.hvsp
+//
+// The simulated clock is locked to the wall clock. Bytes travel over the
+// simulated serial line at the baud rate the sketch set, and every USB
+// transfer is delayed by a fixed latency in each direction, so avrdude
+// sees roughly the response times of a real board.
+//
+// The image store starts out erased, or with the contents of the file given
+// with -s, which are written back on exit. SIGUSR1 presses the START button.
+//
+// On exit, smopty prints what went on at the target, and whether the sketch
+// left it in programming mode.
+//
+
+#include "SimCore.h"
+#include "SimHost.h"
+#include "SimTarget.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <deque>
+
+struct TimedByte {
+    uint64_t    fTime;
+    uint8_t     fByte;
+};
+
+static volatile sig_atomic_t    sDone;
+static volatile sig_atomic_t    sStart;
+static const char *             sLink;
+
+static void
+Quit(int)
+{
+    sDone = 1;
+}
+
+static void
+PressStart(int)
+{
+    sStart = 1;
+}
+
+static void
+Usage()
+{
+    fprintf(stderr, "Usage: smopty [-p part] [-l latency_us] [-L link] [-s store]\n");
+    exit(2);
+}
+
+int
+main(int argc, char * argv[])
+{
+    const char *    partName    = "attiny85";
+    const char *    storePath   = NULL;
+    double          latency     = 1000.0;
+
+    int ch;
+    while ((ch = getopt(argc, argv, "L:l:p:s:")) != -1)
+        switch (ch) {
+        case 'L':   sLink       = optarg;           break;
+        case 'l':   latency     = atof(optarg);     break;
+        case 'p':   partName    = optarg;           break;
+        case 's':   storePath   = optarg;           break;
+        default:    Usage();
+        }
+    const SimPart * part = SimTarget::FindPart(partName);
+    if (!part) {
+        size_t          numParts;
+        const SimPart * parts = SimTarget::Parts(numParts);
+        fprintf(stderr, "smopty: Unknown part %s, try one of", partName);
+        for (size_t i=0; i<numParts; ++i)
+            fprintf(stderr, " %s", parts[i].fName);
+        fprintf(stderr, "\n");
+        return 2;
+    }
+    const uint64_t  usbLatency  = uint64_t(latency*1000.0);
+
+    int slave;
+    int master = SimHost::OpenPTY(slave);
+    if (sLink) {
+        unlink(sLink);
+        if (symlink(SimHost::PTYName(master), sLink) < 0) {
+            perror("smopty: symlink");
+            return 1;
+        }
+    }
+    printf("smopty: %s on %s\n", part->fName, sLink ? sLink : SimHost::PTYName(master));
+    fflush(stdout);
+
+    signal(SIGINT,  Quit);
+    signal(SIGTERM, Quit);
+    signal(SIGHUP,  Quit);
+    signal(SIGUSR1, PressStart);
+    if (storePath)
+        SimStore::Load(storePath);
+
+    SimTarget::Attach(part);
+    setup();
+    SimLink::Reset();
+
+    const uint64_t          epoch = SimHost::WallClock() - SimClock::Now();
+    std::deque<TimedByte>   output;
+    while (!sDone) {
+        uint64_t    now = SimHost::WallClock() - epoch;
+        uint8_t     buf[256];
+        ssize_t     len;
+        while ((len = read(master, buf, sizeof(buf))) > 0)
+            SimLink::Send(buf, len, now+usbLatency);
+        if (sStart) {
+            sStart = 0;
+            SimStore::PressStart();
+        }
+
+        //
+        // Let the sketch catch up with the wall clock. It may get ahead of
+        // it while it waits for a chip, in which case we wait for it.
+        //
+        uint8_t byte;
+        while (SimLink::Receive(byte, now))
+            output.push_back(TimedByte{SimLink::LastReceived()+usbLatency, byte});
+
+        len = 0;
+        while (!output.empty() && output.front().fTime <= now && len < (ssize_t)sizeof(buf)) {
+            buf[len++] = output.front().fByte;
+            output.pop_front();
+        }
+        if (len > 0 && write(master, buf, len) < 0 && errno != EAGAIN)
+            break;
+
+        uint64_t wake = now+1000000;
+        if (!output.empty())
+            wake = std::min(wake, output.front().fTime);
+        wake = std::max(wake, SimClock::Now());
+        struct pollfd pfd = {master, POLLIN, 0};
+        int64_t wait = int64_t(wake) - int64_t(SimHost::WallClock()-epoch);
+        if (wait > 0) {
+            struct timespec ts = {time_t(wait / 1000000000), long(wait % 1000000000)};
+            ppoll(&pfd, 1, &ts, NULL);
+        }
+    }
+    if (sLink)
+        unlink(sLink);
+    if (storePath && !SimStore::Save(storePath))
+        perror("smopty: store");
+    close(slave);
+    close(master);
+
+    const SimTarget::Stats & stats = SimTarget::Statistics();
+    fprintf(stderr, "smopty: %u bus operations, %u writes, %u ignored, %u bytes overrun%s\n",
+            stats.fBusOps, stats.fWrites, stats.fIgnored, SimLink::Overruns(),
+            SimTarget::Active() ? ", target left in programming mode" : "");
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+#
+# SimTest.rb - Common ground for the tests "make check" runs: Every test
+#              gets a fresh virtual ScratchMonkey (Simulator/smopty) with a
+#              chip attached, and a SMoHost client signed on to it.
+#
+# The virtual programmer runs in real time, so tests should stick to small
+# images. smopty's statistics line, printed when it quits, is available to
+# tests that want to check what went on at the target.
+#
+
+$LOAD_PATH.unshift(File.join(File.dirname(File.expand_path(__FILE__)), '../Tools'))
+require 'SMoHost'
+require 'minitest/autorun'
+require 'fileutils'
+require 'tmpdir'
+
+module SimTest
+  SIMULATOR = File.join(File.dirname(File.expand_path(__FILE__)), '../Simulator')
+  TOOLS     = File.join(File.dirname(File.expand_path(__FILE__)), '../Tools')
+
+  class Case < Minitest::Test
+    attr_reader :client, :link
+
+    #
+    # Start smopty, or the smopty-VARIANT build of Simulator/Makefile. A test
+    # may stop and start again, keeping its scratch directory.
+    #
+    def start(part, variant=nil, args=[])
+      @dir  ||= Dir.mktmpdir('smotest')
+      @link   = File.join(@dir, 'link')
+      @log    = File.join(@dir, 'log')
+      smopty  = File.join(SIMULATOR, variant ? "smopty-#{variant}" : 'smopty')
+      @pid    = spawn(smopty, '-p', part, '-l', '0', '-L', @link, *args, out: File::NULL, err: @log)
+      sleep 0.01 until File.exist?(@link)
+      @port   = SMoHost::Port.new(@link)
+      @client = SMoHost::Client.new(@port)
+      @client.sign_on
+    end
+
+    #
+    # Quit smopty, returning what it printed on the way out
+    #
+    def stop
+      return @summary unless @pid
+      @port.close
+      Process.kill('TERM', @pid)
+      Process.wait(@pid)
+      @pid     = nil
+      @summary = File.read(@log)
+    end
+
+    def teardown
+      stop
+      FileUtils.rm_rf(@dir) if @dir
+    end
+
+    def smoprog(*args)
+      output = IO.popen([RbConfig.ruby, File.join(TOOLS, 'smoprog'), '-P', @link, *args], err: [:child, :out], &:read)
+      [$?.success?, output]
+    end
+
+    #
+    # Random bytes as an Intel HEX file
+    #
+    def hex_file(name, address, data)
+      path = File.join(@dir, name)
+      File.open(path, 'w') do |out|
+        (0...data.bytesize).step(16) do |offset|
+          line = data.byteslice(offset, 16).bytes
+          a    = address + offset
+          if offset.zero? || (a & 0xFFFF) < 16
+            ext = [2, 0, 0, 4, a >> 24, (a >> 16) & 0xFF]
+            out.puts ':' + (ext + [(-ext.sum) & 0xFF]).map {|b| format('%02X', b)}.join
+          end
+          rec = [line.length, (a >> 8) & 0xFF, a & 0xFF, 0] + line
+          out.puts ':' + (rec + [(-rec.sum) & 0xFF]).map {|b| format('%02X', b)}.join
+        end
+        out.puts ':00000001FF'
+      end
+      path
+    end
+
+    def random_bytes(size, seed)
+      Random.new(seed).bytes(size)
+    end
+  end
+end
@@ -0,0 +1,128 @@
+#
+# helper_test.rb - Two stage programming through a helper in the target's
+#                  boot section (SMoHelper.h)
+#
+
+require_relative 'SimTest'
+
+class HelperTest < SimTest::Case
+  def setup
+    start('atmega328p', 'helper')
+    @data = random_bytes(4096, 9)
+  end
+
+  def flash(address=0, len=@data.bytesize)
+    isp = SMoHost::ISP.new(client)
+    isp.enter
+    data = isp.read(:flash, address, len)
+    isp.leave
+    data
+  end
+
+  def test_smoprog
+    hex = hex_file('flash.hex', 0, @data)
+    ok, output = smoprog('-H', '-f', hex, '--verify', '-v')
+    assert ok, output
+    assert_match(/pages written through the helper/, output)
+    assert_match(/flash verified/, output)
+    assert_equal @data, flash
+    assert_equal "\xFF".b * 512, flash(32768-512, 512)
+  end
+
+  def test_no_inline_verify
+    isp = SMoHost::ISP.new(client)
+    isp.enter
+    assert client.verify_inline(true)
+    refute client.helper_start
+    client.verify_inline(false)
+    helper = SMoHost::Helper.for(client, isp)
+    isp.erase
+    image  = SMoHost::Image.new
+    image.add(0, @data)
+    assert helper.program(image.finish.pages(helper.page_size), false)
+    assert_equal @data, isp.read(:flash, 0, @data.bytesize)
+  end
+end
+
+#
+# Helper#program against a stand-in for each part, no simulator needed
+#
+class HelperPartsTest < Minitest::Test
+  class FakeISP
+    attr_reader :signature, :writes
+
+    def initialize(signature, fuses)
+      @signature, @fuses, @writes = signature, fuses, []
+    end
+
+    def read_fuse(fuse)
+      @fuses.fetch(fuse)
+    end
+
+    def write_fuse(fuse, value)
+      @writes << [fuse, value]
+      @fuses[fuse] = value
+    end
+
+    def program(memory, pages, page_size)
+    end
+
+    def enter
+    end
+  end
+
+  class FakeClient
+    def helper_start
+      true
+    end
+
+    def helper_finish(address)
+    end
+  end
+
+  FUSES = { low: 0x62, high: 0xD9, ext: 0xF9 }
+
+  #
+  # Every form the helper uses, with the words avr-objdump shows for it
+  #
+  ENCODINGS = [
+    [[:ldi,  17, :miso],  0xE110],     # ldi  r17, 0x10
+    [[:ldi,  18, 0xA5],   0xEA25],     # ldi  r18, 0xA5
+    [[:cpi,  20, 0x4C],   0x344C],     # cpi  r20, 0x4C
+    [[:out,  0x04, 17],   0xB914],     # out  0x04, r17
+    [[:out,  0x3B, 19],   0xBF3B],     # out  0x3b, r19
+    [[:in,   16, 0x37],   0xB707],     # in   r16, 0x37
+    [[:in,   0, 0x2E],    0xB40E],     # in   r0, 0x2e
+    [[:sbrs, 16, 7],      0xFF07],     # sbrs r16, 7
+    [[:sbrc, 16, 0],      0xFD00],     # sbrc r16, 0
+    [[:adiw, 30, 2],      0x9632],     # adiw r30, 0x02
+    [[:dec,  19],         0x953A],     # dec  r19
+    [[:spm],              0x95E8],     # spm
+    :back,
+    [[:rjmp, -3],         0xCFFD],     # rjmp .-6
+    [[:breq, :back],      0xF3F1],     # breq .-4
+    [[:brne, :back],      0xF7E9],     # brne .-6
+    [[:rjmp, :back],      0xCFFC],     # rjmp .-8
+    [[:breq, :ahead],     0xF021],     # breq .+8
+    [[:recv, 20],         [0xB50D, 0xFF07, 0xCFFD, 0xB54E]],
+    :ahead
+  ]
+
+  def test_encodings
+    source   = ENCODINGS.map {|insn, _| insn}
+    expected = ENCODINGS.flat_map {|insn, words| insn.is_a?(Symbol) ? [] : Array(words)}
+    assert_equal expected.map {|word| format('%04X', word)},
+                 SMoHost::Helper.assemble(4, source).unpack('v*').map {|word| format('%04X', word)}
+  end
+
+  def test_boot_fuse
+    SMoHost::Helper::PARTS.each do |signature, (name, *, fuse)|
+      isp    = FakeISP.new(signature, FUSES.dup)
+      helper = SMoHost::Helper.for(FakeClient.new, isp)
+      assert helper.program([[0, "\x00".b * helper.page_size]], false), name
+      expected = name.start_with?('ATmega168') ? :ext : :high
+      assert_equal expected, fuse, name
+      assert_equal [[fuse, (FUSES[fuse] & ~0x07) | 0x06], [fuse, FUSES[fuse]]], isp.writes, name
+    end
+  end
+end
@@ -0,0 +1,126 @@
+#
+# host_test.rb - Tools/SMoHost.rb and smoprog end to end against smopty
+#
+
+require_relative 'SimTest'
+
+class HostTest < SimTest::Case
+  def setup
+    start('atmega328p')
+    @isp = SMoHost::ISP.new(client)
+    @isp.enter
+  end
+
+  def test_signature_and_fuses
+    assert_equal [0x1E, 0x95, 0x0F], @isp.signature
+    assert_equal 0x62, @isp.read_fuse(:low)
+    @isp.write_fuse(:ext, 0x05)
+    assert_equal 0x05, @isp.read_fuse(:ext)
+    @isp.verify_fuse(:ext, 0x05)
+    assert_raises(SMoHost::Error) { @isp.verify_fuse(:ext, 0x07) }
+  end
+
+  def test_program_read_verify
+    data  = random_bytes(2048, 1)
+    image = SMoHost::Image.new
+    image.add(0x100, data)
+    @isp.erase
+    @isp.program(:flash, image.finish.pages(128), 128)
+    assert_equal data, @isp.read(:flash, 0x100, data.bytesize)
+    assert_equal ("\xFF" * 0x100).b, @isp.read(:flash, 0, 0x100)
+    @isp.verify(:flash, 0x100, data)
+    bad = data.dup
+    bad.setbyte(1000, bad.getbyte(1000) ^ 1)
+    error = assert_raises(SMoHost::Error) { @isp.verify(:flash, 0x100, bad) }
+    assert_match(/mismatch/, error.message)
+  end
+
+  def test_eeprom
+    data  = random_bytes(64, 2)
+    image = SMoHost::Image.new
+    image.add(32, data)
+    @isp.program(:eeprom, image.finish.pages(4, true), 4)
+    assert_equal data, @isp.read(:eeprom, 32, data.bytesize)
+  end
+
+  def test_changed_pages
+    image = SMoHost::Image.new
+    image.add(0, random_bytes(1024, 3))
+    pages = image.finish.pages(128, true)
+    @isp.erase
+    @isp.program(:flash, pages, 128)
+    assert_empty @isp.changed_pages(:flash, pages, 128)
+    image.patch(300, "\x00".b)
+    changed = @isp.changed_pages(:flash, image.pages(128, true), 128)
+    assert_equal [256], changed.map(&:first)
+  end
+
+  def test_region_limits
+    response = client.command([SMoHost::CMD_SCRATCHMONKEY_REGION_START, 0, 0, 0, 0, 0, 128, 0, 0, 1, 0,
+                               SMoHost::CMD_PROGRAM_FLASH_ISP] + SMoHost::ISP::FLASH_PARAMS)
+    client.check(response, "Starting region")
+    window, max_data = response.unpack('@2nn')
+    assert_equal SMoHost::DEFAULT_WINDOW, window
+    assert max_data.even?, "Frames of #{max_data} bytes split words"
+    response = client.command([SMoHost::CMD_SCRATCHMONKEY_REGION_DATA] + [0] * 3)
+    assert_equal SMoHost::STATUS_CMD_FAILED, response.getbyte(1)
+  end
+
+  def test_odd_flash_lengths
+    data = random_bytes(5, 6)
+    @isp.erase
+    client.command([SMoHost::CMD_LOAD_ADDRESS, 0, 0, 0, 0])
+    params   = SMoHost::ISP::FLASH_PARAMS
+    response = client.command([SMoHost::CMD_PROGRAM_FLASH_ISP, 0, 5, params[0] | 0x80, *params[1..-1]] + data.bytes.first(5))
+    client.check(response, "Programming odd length")
+    client.command([SMoHost::CMD_LOAD_ADDRESS, 0, 0, 0, 0])
+    response = client.command([SMoHost::CMD_READ_FLASH_ISP, 0, 5, 0x20])
+    assert_equal 5+3, response.bytesize
+    assert_equal data, client.check(response, "Reading odd length").byteslice(2, 5)
+  end
+
+  def test_sign_on_resets_page_size
+    client.set_param(SMoHost::PARAM2_SCRATCHMONKEY_PAGE_SIZE, 64)
+    assert_equal 64, client.get_param(SMoHost::PARAM2_SCRATCHMONKEY_PAGE_SIZE)
+    client.sign_on
+    assert_equal 0, client.get_param(SMoHost::PARAM2_SCRATCHMONKEY_PAGE_SIZE)
+  end
+
+  def test_sign_on_clears_patches
+    client.set_patches([[0, 0x10, 'SMo'.b]])
+    client.sign_on
+    data  = random_bytes(128, 5)
+    image = SMoHost::Image.new
+    image.add(0, data)
+    @isp.enter
+    @isp.erase
+    @isp.program(:flash, image.finish.pages(128), 128)
+    assert_equal data, @isp.read(:flash, 0, data.bytesize)
+  end
+
+  def test_timing_floor
+    defaults = client.timing[:knobs]
+    client.set_timing([0] * defaults.length)
+    minimums = client.timing[:knobs]
+    assert_equal [1, 2, 2], minimums
+    minimums.zip(defaults) {|minimum, default| assert_operator minimum, :<, default}
+    client.set_timing([255] * defaults.length)
+    assert_equal [15] * defaults.length, client.timing[:knobs]
+  end
+
+  def test_smoprog
+    @isp.leave
+    data  = random_bytes(1024, 4)
+    flash = hex_file('flash.hex', 0, data)
+    ok, output = smoprog('-e', '-f', flash, '--verify', '-v')
+    assert ok, output
+    assert_match(/flash verified/, output)
+    data.setbyte(700, data.getbyte(700) & 0xF0)
+    flash = hex_file('delta.hex', 0, data)
+    ok, output = smoprog('-d', '-f', flash, '--verify', '-v')
+    assert ok, output
+    assert_match(/1 changed pages written/, output)
+    @isp.enter
+    assert_equal data, @isp.read(:flash, 0, data.bytesize)
+  end
+end
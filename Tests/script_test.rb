@@ -0,0 +1,134 @@
+#
+# script_test.rb - Properties of CMD_SCRATCHMONKEY_SCRIPT (SMoScript.h),
+#                  checked against random scripts
+#
+
+require_relative 'SimTest'
+
+class ScriptTest < SimTest::Case
+  SCRIPTS  = 100
+  OPERANDS = [0, 2, 4, 2, 1, 2, 2, 1, 1, 3, 1, 2, 1, 0]
+
+  def setup
+    start('atmega328p')
+    @isp = SMoHost::ISP.new(client)
+    @isp.enter
+    @data = random_bytes(256, 7)
+    image = SMoHost::Image.new
+    image.add(0, @data)
+    @isp.erase
+    @isp.program(:flash, image.finish.pages(128), 128)
+  end
+
+  def run_script(code)
+    response = client.command([SMoHost::CMD_SCRATCHMONKEY_SCRIPT].pack('C') + code)
+    [response.getbyte(1), response.unpack('@2n')[0], response.byteslice(4..-1)]
+  end
+
+  def command(body, count)
+    [SMoHost::Script::OPCODES[:command], count, body.length].pack('CCC') + body.pack('C*')
+  end
+
+  #
+  # Commands run from scripts, including some that scripts must refuse
+  #
+  def random_command(rng, kinds=12)
+    case rng.rand(kinds)
+    when 0 then [SMoHost::CMD_SIGN_ON]
+    when 1 then [SMoHost::CMD_GET_PARAMETER, SMoHost::PARAM_SCK_DURATION]
+    when 2 then [SMoHost::CMD_READ_SIGNATURE_ISP, 4, 0x30, 0x00, rng.rand(3), 0x00]
+    when 3 then [SMoHost::CMD_READ_FUSE_ISP, 4] + SMoHost::ISP::FUSE_READ.values.sample(random: rng)
+    when 4 then [SMoHost::CMD_LOAD_ADDRESS, 0, 0, 0, rng.rand(64)]
+    when 5 then [SMoHost::CMD_READ_FLASH_ISP, 0, rng.rand(1..128), 0x20]
+    when 6 then [SMoHost::CMD_SCRATCHMONKEY_LINK, SMoHost::SCRATCHMONKEY_LINK_SOURCE, rng.rand(256)]
+    when 7 then [SMoHost::CMD_SCRATCHMONKEY_DEVICE, SMoHost::SCRATCHMONKEY_DEVICE_CONTROL_STACK]
+    when 8 then [SMoHost::CMD_SCRATCHMONKEY_STATS, SMoHost::SCRATCHMONKEY_STATS_COMMANDS]
+    when 9 then [SMoHost::CMD_SCRATCHMONKEY_SCRIPT, SMoHost::Script::OPCODES[:append]]
+    when 10 then [0x70 + rng.rand(0x20)]
+    else Array.new(rng.rand(1..8)) { rng.rand(256) }
+    end
+  end
+
+  #
+  # A random script, and the offsets at which instructions start
+  #
+  def random_script(rng)
+    code    = String.new(encoding: Encoding::BINARY)
+    offsets = []
+    rng.rand(1..12).times do
+      offsets << code.bytesize
+      op = rng.rand(16) == 0 ? rng.rand(0x0E..0xFF) : rng.rand(1..0x0D)
+      code << case op
+              when 0x01 then command(random_command(rng), rng.rand(8))
+              when 0x02 then [op, 0x30, 0x00, rng.rand(3), 0x00].pack('C*')
+              when 0x09 then [op, rng.rand(256), rng.rand(256), rng.rand(3)].pack('C*')
+              when 0x0A then [op, rng.rand(3)].pack('C*')
+              else ([op] + Array.new(OPERANDS[op] || rng.rand(4)) { rng.rand(256) }).pack('C*')
+              end
+    end
+    code = code.byteslice(0, rng.rand(code.bytesize)) if rng.rand(8) == 0
+    [code, offsets]
+  end
+
+  def test_random_scripts_stay_in_sync
+    rng = Random.new(33)
+    SCRIPTS.times do |i|
+      code, offsets = random_script(rng)
+      status, offset, results = run_script(code)
+      if status == SMoHost::STATUS_CMD_OK
+        assert_equal code.bytesize, offset, "Script #{i} stopped early"
+      else
+        assert_includes offsets, offset, "Script #{i} failed between instructions"
+      end
+      assert_operator results.bytesize, :<=, 64, "Script #{i} returned too many results"
+      assert_kind_of Integer, client.get_param(SMoHost::PARAM_SCK_DURATION)
+      @isp.enter
+    end
+    assert_equal [0x1E, 0x95, 0x0F], @isp.signature
+    assert_equal @data, @isp.read(:flash, 0, @data.bytesize)
+  end
+
+  def test_results_match_commands
+    rng = Random.new(34)
+    20.times do
+      bodies = Array.new(rng.rand(1..6)) { random_command(rng, 6) }
+      code     = String.new(encoding: Encoding::BINARY)
+      expected = String.new(encoding: Encoding::BINARY)
+      client.command([SMoHost::CMD_LOAD_ADDRESS, 0, 0, 0, 0])
+      bodies.each do |body|
+        response = client.command(body)
+        count    = [response.bytesize-2, 64-expected.bytesize].min
+        expected << response.byteslice(2, count)
+        code << command(body, count)
+      end
+      client.command([SMoHost::CMD_LOAD_ADDRESS, 0, 0, 0, 0])
+      status, offset, results = run_script(code)
+      assert_equal [SMoHost::STATUS_CMD_OK, code.bytesize], [status, offset]
+      assert_equal expected, results
+      @isp.enter
+    end
+  end
+
+  def test_refused_commands
+    [[SMoHost::CMD_SCRATCHMONKEY_LINK, SMoHost::SCRATCHMONKEY_LINK_SOURCE, 200],
+     [SMoHost::CMD_SCRATCHMONKEY_LINK, SMoHost::SCRATCHMONKEY_LINK_ECHO] + [0] * 20,
+     [SMoHost::CMD_SCRATCHMONKEY_DEVICE, SMoHost::SCRATCHMONKEY_DEVICE_CONTROL_STACK],
+     [SMoHost::CMD_SCRATCHMONKEY_STATS, SMoHost::SCRATCHMONKEY_STATS_COMMANDS],
+     [SMoHost::CMD_SCRATCHMONKEY_TRACE, SMoHost::SCRATCHMONKEY_TRACE_READ],
+     [SMoHost::CMD_SCRATCHMONKEY_STORE, SMoHost::SCRATCHMONKEY_STORE_RUN],
+     [SMoHost::CMD_SCRATCHMONKEY_SCRIPT],
+     [0x7F],
+     [SMoHost::CMD_READ_FLASH_ISP, 1, 0x10, 0x20]
+    ].each do |body|
+      code = command([SMoHost::CMD_GET_PARAMETER, SMoHost::PARAM_SCK_DURATION], 1) + command(body, 0)
+      status, offset, results = run_script(code)
+      assert_equal [SMoHost::STATUS_CMD_FAILED, code.bytesize-body.length-3], [status, offset], body.inspect
+      assert_equal 1, results.bytesize
+    end
+  end
+
+  def test_count_beyond_response
+    status, offset, results = run_script(command([SMoHost::CMD_GET_PARAMETER, SMoHost::PARAM_SCK_DURATION], 8))
+    assert_equal [SMoHost::STATUS_CMD_FAILED, 0, ''.b], [status, offset, results]
+  end
+end
@@ -0,0 +1,59 @@
+#
+# session_test.rb - Sticky sessions (SMoSession.h) on a programmer whose HVPP
+#                   wiring shares the serial pins, like the Uno's
+#
+
+require_relative 'SimTest'
+
+class SessionTest < SimTest::Case
+  CMD_ENTER_PROGMODE_PP   = 0x20
+  CMD_LEAVE_PROGMODE_PP   = 0x21
+  CMD_READ_SIGNATURE_PP   = 0x2B
+  CMD_SET_CONTROL_STACK   = 0x2D
+  #
+  # avrdude's control stack for ATmega HVPP
+  #
+  CONTROL_STACK           = [0x0E, 0x1E, 0x0F, 0x1F, 0x2E, 0x3E, 0x2F, 0x3F,
+                             0x4E, 0x5E, 0x4F, 0x5F, 0x6E, 0x7E, 0x6F, 0x7F,
+                             0x66, 0x76, 0x67, 0x77, 0x6A, 0x7A, 0x6B, 0x7B,
+                             0xBE, 0xFD, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00]
+  HELD                    = /target left in programming mode/
+
+  def setup
+    start('atmega328p', 'session')
+  end
+
+  def test_isp_held
+    isp = SMoHost::ISP.new(client)
+    isp.enter
+    isp.leave
+    assert_match HELD, stop
+  end
+
+  def test_sck_change_ends_session
+    isp = SMoHost::ISP.new(client)
+    isp.enter
+    isp.leave
+    sck = client.get_param(SMoHost::PARAM_SCK_DURATION)
+    client.set_param(SMoHost::PARAM_SCK_DURATION, sck)
+    client.set_param(SMoHost::PARAM_SCK_DURATION, sck+1)
+    refute_match HELD, stop
+  end
+
+  def test_fuse_write_not_held
+    isp = SMoHost::ISP.new(client)
+    isp.enter
+    isp.write_fuse(:low, isp.read_fuse(:low))
+    isp.leave
+    refute_match HELD, stop
+  end
+
+  def test_hvpp_not_held
+    client.check(client.command([CMD_SET_CONTROL_STACK] + CONTROL_STACK), "Setting control stack")
+    client.check(client.command([CMD_ENTER_PROGMODE_PP, 100, 0, 5, 1, 15, 1, 0]), "Entering programming mode")
+    signature = (0..2).map {|i| client.check(client.command([CMD_READ_SIGNATURE_PP, i]), "Reading signature").getbyte(2)}
+    assert_equal [0x1E, 0x95, 0x0F], signature
+    client.check(client.command([CMD_LEAVE_PROGMODE_PP, 0, 15]), "Leaving programming mode")
+    refute_match HELD, stop
+  end
+end
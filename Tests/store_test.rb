@@ -0,0 +1,105 @@
+#
+# store_test.rb - Standalone programming from the image store (SMoStore.h)
+#
+
+require_relative 'SimTest'
+
+class StoreTest < SimTest::Case
+  def setup
+    start('atmega328p')
+    @data = random_bytes(512, 5)
+  end
+
+  #
+  # Record erasing, programming and verifying @data at 0, or whatever the
+  # block does instead of the verify
+  #
+  def record(verify=@data)
+    recorder = SMoHost::Recorder.new(client.max_body)
+    isp      = SMoHost::ISP.new(recorder)
+    image    = SMoHost::Image.new
+    image.add(0, @data)
+    isp.enter
+    isp.erase
+    isp.program(:flash, image.finish.pages(128), 128)
+    isp.verify(:flash, 0, verify)
+    isp.leave
+    recorder.upload(client)
+    recorder.records
+  end
+
+  def run_store
+    response = client.command([SMoHost::CMD_SCRATCHMONKEY_STORE, SMoHost::SCRATCHMONKEY_STORE_RUN])
+    [response.getbyte(1), response.unpack('@2n')[0]]
+  end
+
+  def flash(len=@data.bytesize)
+    isp = SMoHost::ISP.new(client)
+    isp.enter
+    data = isp.read(:flash, 0, len)
+    isp.leave
+    data
+  end
+
+  def test_record_and_replay
+    record
+    assert_equal [SMoHost::STATUS_CMD_OK, 0xFFFF], run_store
+    assert_equal @data, flash
+  end
+
+  def test_start_button
+    record
+    Process.kill('USR1', @pid)
+    sleep 1.5
+    client.sign_on
+    assert_equal @data, flash
+  end
+
+  def test_smoprog
+    hex = hex_file('flash.hex', 0, @data)
+    ok, output = smoprog('--store', '-f', hex, '--verify', '-v')
+    assert ok, output
+    ok, output = smoprog('--run-store', '-v')
+    assert ok, output
+    assert_match(/Replay succeeded/, output)
+    assert_equal @data, flash
+  end
+
+  def test_compare_failure
+    bad = @data.dup
+    bad.setbyte(300, bad.getbyte(300) ^ 0x80)
+    records = record(bad)
+    reads   = records.each_index.reject {|i| records[i][1].empty?}
+    assert_equal [SMoHost::STATUS_CMD_FAILED, reads[300 / 256]], run_store
+  end
+
+  def test_empty_store
+    assert_equal [SMoHost::STATUS_CMD_FAILED, 0], run_store
+  end
+
+  def test_patch_during_replay
+    client.set_patches([[SMoHost::SCRATCHMONKEY_PATCH_COUNTER, 0x10, [0x34, 0x12].pack('C*')],
+                        [0, 0x20, 'SMo'.b]])
+    record
+    2.times do |unit|
+      assert_equal [SMoHost::STATUS_CMD_OK, 0xFFFF], run_store
+      data = flash
+      assert_equal [0x34+unit, 0x12].pack('C*'), data.byteslice(0x10, 2)
+      assert_equal 'SMo', data.byteslice(0x20, 3)
+      assert_equal @data.byteslice(0x40, 0x100), data.byteslice(0x40, 0x100)
+    end
+  end
+
+  def test_counters_survive_power_cycle
+    store = File.join(@dir, 'store')
+    stop
+    start('atmega328p', nil, ['-s', store])
+    client.set_patches([[SMoHost::SCRATCHMONKEY_PATCH_COUNTER, 0x10, [0xFF, 0x00].pack('C*')]])
+    record
+    assert_equal [SMoHost::STATUS_CMD_OK, 0xFFFF], run_store
+    stop
+    start('atmega328p', nil, ['-s', store])
+    assert_equal [SMoHost::STATUS_CMD_OK, 0xFFFF], run_store
+    assert_equal [0x00, 0x01].pack('C*'), flash.byteslice(0x10, 2)
+  end
+end
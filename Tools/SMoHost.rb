@@ -0,0 +1,1160 @@
+# -*- mode: ruby; tab-width: 2; indent-tabs-mode: nil -*-
+#
+# ScratchMonkey 2.0        - STK500v2/STK600ish compatible programming sketch for Arduino
+#
+# File: SMoHost.rb         - Host side of the ScratchMonkey STK500v2 dialect
+#
+# Copyright (c) 2013-2016 Matthias Neeracher <microtherion@gmail.com>
+# All rights reserved.
+#
+# Unlike avrdude, this knows about ScratchMonkey extensions: It keeps
+# several commands in flight (matching responses by sequence number),
+# streams whole regions with CMD_SCRATCHMONKEY_REGION_*, and uses large
+# frames where the board supports them.
+#
+
+module SMoHost
+  MESSAGE_START                   = 0x1B
+  TOKEN                           = 0x0E
+
+  CMD_SIGN_ON                     = 0x01
+  CMD_SET_PARAMETER               = 0x02
+  CMD_GET_PARAMETER               = 0x03
+  CMD_LOAD_ADDRESS                = 0x06
+  CMD_ENTER_PROGMODE_ISP          = 0x10
+  CMD_LEAVE_PROGMODE_ISP          = 0x11
+  CMD_CHIP_ERASE_ISP              = 0x12
+  CMD_PROGRAM_FLASH_ISP           = 0x13
+  CMD_READ_FLASH_ISP              = 0x14
+  CMD_PROGRAM_EEPROM_ISP          = 0x15
+  CMD_READ_EEPROM_ISP             = 0x16
+  CMD_PROGRAM_FUSE_ISP            = 0x17
+  CMD_READ_FUSE_ISP               = 0x18
+  CMD_PROGRAM_LOCK_ISP            = 0x19
+  CMD_READ_LOCK_ISP               = 0x1A
+  CMD_READ_SIGNATURE_ISP          = 0x1B
+  CMD_SPI_MULTI                   = 0x1D
+  CMD_XPROG                       = 0x50
+  CMD_SCRATCHMONKEY_REGION_START  = 0xA0
+  CMD_SCRATCHMONKEY_REGION_DATA   = 0xA1
+  CMD_SCRATCHMONKEY_PAGE_HASH     = 0xA2
+  CMD_SCRATCHMONKEY_STORE         = 0xA3
+
+  SCRATCHMONKEY_STORE_BEGIN       = 0x01
+  SCRATCHMONKEY_STORE_RECORD      = 0x02
+  SCRATCHMONKEY_STORE_END         = 0x03
+  SCRATCHMONKEY_STORE_RUN         = 0x04
+  CMD_SCRATCHMONKEY_PATCH         = 0xA4
+
+  SCRATCHMONKEY_PATCH_CLEAR       = 0x01
+  SCRATCHMONKEY_PATCH_ADD         = 0x02
+  SCRATCHMONKEY_PATCH_NEXT        = 0x03
+  SCRATCHMONKEY_PATCH_EEPROM      = 0x01
+  SCRATCHMONKEY_PATCH_COUNTER     = 0x02
+  SCRATCHMONKEY_PATCH_BIG_ENDIAN  = 0x04
+  CMD_SCRATCHMONKEY_SCRIPT        = 0xA5
+  CMD_SCRATCHMONKEY_STATS         = 0xA6
+
+  SCRATCHMONKEY_STATS_CLEAR       = 0x01
+  SCRATCHMONKEY_STATS_SUMMARY     = 0x02
+  SCRATCHMONKEY_STATS_COMMANDS    = 0x03
+  CMD_SCRATCHMONKEY_TRACE         = 0xA7
+
+  SCRATCHMONKEY_TRACE_CLEAR       = 0x01
+  SCRATCHMONKEY_TRACE_READ        = 0x02
+  CMD_SCRATCHMONKEY_LINK          = 0xA8
+
+  SCRATCHMONKEY_LINK_SINK         = 0x01
+  SCRATCHMONKEY_LINK_SOURCE       = 0x02
+  SCRATCHMONKEY_LINK_ECHO         = 0x03
+  CMD_SCRATCHMONKEY_TIMING        = 0xA9
+
+  SCRATCHMONKEY_TIMING_GET        = 0x01
+  SCRATCHMONKEY_TIMING_SET        = 0x02
+  SCRATCHMONKEY_TIMING_SHMOO      = 0x03
+  SCRATCHMONKEY_TIMING_STORE      = 0x04
+  SCRATCHMONKEY_TIMING_CLEAR      = 0x05
+  TIMING_KNOBS                    = %w[hvsp hvpp tpi]
+  CMD_SCRATCHMONKEY_CAPTURE       = 0xAA
+
+  SCRATCHMONKEY_CAPTURE_RUN       = 0x01
+  SCRATCHMONKEY_CAPTURE_READ      = 0x02
+  CMD_SCRATCHMONKEY_DEVICE        = 0xAB
+
+  SCRATCHMONKEY_DEVICE_INFO       = 0x01
+  SCRATCHMONKEY_DEVICE_CONTROL_STACK = 0x02
+  CMD_SCRATCHMONKEY_HELPER        = 0xAC
+
+  SCRATCHMONKEY_HELPER_START      = 0x01
+  SCRATCHMONKEY_HELPER_FINISH     = 0x02
+
+  STATUS_CMD_OK                   = 0x00
+  STATUS_CMD_FAILED               = 0xC0
+  STATUS_CMD_UNKNOWN              = 0xC9
+
+  PARAM_SCK_DURATION              = 0x98
+  PARAM_SCRATCHMONKEY_STATUS_LEDS = 0x2A
+  PARAM_SCRATCHMONKEY_STICKY      = 0x2B
+  PARAM_SCRATCHMONKEY_VERIFY      = 0x2C
+  PARAM2_SCRATCHMONKEY_MAX_BODY   = 0xD0
+  PARAM2_SCRATCHMONKEY_PAGE_SIZE  = 0xD1
+
+  SIGN_ON_ID                      = "SCRATCHMONKEY"
+  STK500_MAX_BODY                 = 275
+  #
+  # Serial receive buffer of the smaller boards, which holds one byte less
+  # than its size. The firmware reports the real value when a region starts.
+  #
+  DEFAULT_WINDOW                  = 63
+
+  class Error < StandardError; end
+
+  #
+  # Generic entry parameters, as avrdude uses them for most parts, and a probe
+  # reading the first flash bytes from the loaded address, for tools that
+  # exercise a protocol without caring about the part. TPI flash is mapped
+  # at 0x4000, and the response has an extra byte in front of the data.
+  #
+  HVPP_CONTROL_STACK = [
+    0x0E, 0x1E, 0x0F, 0x1F, 0x2E, 0x3E, 0x2F, 0x3F,
+    0x4E, 0x5E, 0x4F, 0x5F, 0x6E, 0x7E, 0x6F, 0x7F,
+    0x66, 0x76, 0x67, 0x77, 0x6A, 0x7A, 0x6B, 0x7B,
+    0xBE, 0xFD, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00
+  ]
+  PROTOCOLS = {
+    'isp'  => { enter: [[0x10, 200, 100, 25, 32, 0, 0x53, 3, 0xAC, 0x53, 0x00, 0x00]],
+                leave: [0x11, 1, 1],
+                probe: [0x14, 0, 32, 0x20], count: 32 },
+    'hvsp' => { enter: [[0x30, 100, 0, 6, 1, 1, 25, 1, 0]],
+                leave: [0x31, 0, 0],
+                probe: [0x34, 0, 32], count: 32 },
+    'hvpp' => { enter: [[0x2D, *HVPP_CONTROL_STACK], [0x20, 100, 0, 5, 1, 15, 1, 0]],
+                leave: [0x21, 15, 15],
+                probe: [0x24, 0, 32], count: 32 },
+    'tpi'  => { enter: [[0x51, 2], [0x50, 0x01]],
+                leave: [0x50, 0x02],
+                probe: [0x50, 0x05, 1, 0, 0, 0x40, 0, 0, 16], count: 17 }
+  }
+
+  #
+  # CRC-CCITT as computed by avr-libc's _crc_ccitt_update
+  #
+  def self.crc_ccitt(data, crc=0xFFFF)
+    data.each_byte do |b|
+      crc ^= b
+      8.times { crc = (crc & 1) != 0 ? (crc >> 1) ^ 0x8408 : crc >> 1 }
+    end
+    crc
+  end
+
+  #
+  # Serial port (or pty) carrying STK500v2 frames
+  #
+  class Port
+    attr_reader :io
+
+    def initialize(path, baud=115200)
+      @io = File.open(path, File::RDWR | File::NOCTTY)
+      @io.sync = true
+      #
+      # -hupcl keeps DTR asserted when we close the port, so the next session
+      # does not reset the board. Opening the port may still reset it once,
+      # which SMoHost::Client#sign_on rides out.
+      #
+      stty = RUBY_PLATFORM =~ /darwin|bsd/ ? '-f' : '-F'
+      system("stty #{stty} '#{path}' #{baud} raw -echo -hupcl clocal 2>/dev/null") ||
+        system("stty #{stty} '#{path}' raw -echo 2>/dev/null")
+      @rx = String.new(encoding: Encoding::BINARY)
+    end
+
+    def write(frame)
+      @io.write(frame)
+    end
+
+    #
+    # Return next frame as [seq, body], or nil on timeout
+    #
+    def read_frame(timeout)
+      deadline = Time.now + timeout
+      loop do
+        while (start = @rx.index(MESSAGE_START.chr))
+          @rx.slice!(0, start)
+          break if @rx.bytesize < 5
+          if @rx.getbyte(4) != TOKEN
+            @rx.slice!(0, 1)
+            next
+          end
+          size = (@rx.getbyte(2) << 8) | @rx.getbyte(3)
+          break if @rx.bytesize < 6+size
+          frame = @rx.slice!(0, 6+size)
+          if frame.bytes.inject(0) {|sum,b| sum ^ b} != 0
+            raise Error, "Checksum error in response"
+          end
+          return [frame.getbyte(1), frame.byteslice(5, size)]
+        end
+        remaining = deadline - Time.now
+        return nil if remaining <= 0
+        if wait_readable(remaining)
+          @rx << @io.readpartial(4096)
+        end
+      end
+    end
+
+    def drain
+      @rx.clear
+      while wait_readable(0.05)
+        @io.readpartial(4096)
+      end
+    rescue EOFError
+    end
+
+    #
+    # All waiting for the programmer goes through here, so a subclass can run
+    # other programmers in the meantime (see Tools/smofarm)
+    #
+    def wait_readable(timeout)
+      IO.select([@io], nil, nil, timeout)
+    end
+
+    def close
+      @io.close
+    end
+  end
+
+  #
+  # Command layer. Commands may be pipelined: The firmware processes them
+  # strictly in order, and accepts further frames as long as those other than
+  # the one it is working on fit into its serial receive buffer (the window).
+  #
+  class Client
+    attr_reader   :max_body
+    attr_accessor :window, :timeout
+
+    def initialize(port, window: DEFAULT_WINDOW, timeout: 5.0)
+      @port     = port
+      @window   = window
+      @timeout  = timeout
+      @seq      = 0
+      @pending  = []      # [seq, frame size, callback]
+      @max_body = STK500_MAX_BODY
+    end
+
+    def self.frame(seq, body)
+      frame = [MESSAGE_START, seq, body.bytesize >> 8, body.bytesize & 0xFF, TOKEN].pack('C*') + body.b
+      frame + [frame.bytes.inject(0) {|sum,b| sum ^ b}].pack('C')
+    end
+
+    #
+    # Queue a command, calling the block with its response body once it
+    # arrives. Blocks as needed to stay within the window.
+    #
+    def submit(body, &callback)
+      body  = body.pack('C*') if body.is_a?(Array)
+      seq   = @seq
+      @seq  = (@seq + 1) & 0xFF
+      frame = Client.frame(seq, body)
+      until @pending.empty? || in_flight + frame.bytesize <= @window
+        collect_one
+      end
+      @port.write(frame)
+      @pending << [seq, frame.bytesize, callback]
+      seq
+    end
+
+    #
+    # Wait for all outstanding responses
+    #
+    def flush
+      collect_one until @pending.empty?
+    end
+
+    #
+    # Synchronous command
+    #
+    def command(body)
+      response = nil
+      submit(body) {|r| response = r}
+      flush
+      response
+    end
+
+    #
+    # Queue a command and compare its response data (from byte 2 on)
+    #
+    def expect(body, expected, what)
+      submit(body) do |r|
+        actual = check(r, what).byteslice(2, expected.bytesize)
+        if actual != expected
+          offset = (0...expected.bytesize).find {|i| actual.getbyte(i) != expected.getbyte(i)} || actual.bytesize
+          raise Error, format("%s: mismatch at offset %d", what, offset)
+        end
+      end
+    end
+
+    def check(response, what)
+      status = response.getbyte(response.getbyte(0) == CMD_XPROG ? 2 : 1)
+      raise Error, format("%s failed with status %02X", what, status) if status != STATUS_CMD_OK
+      response
+    end
+
+    #
+    # Sign on, riding out a board reset caused by opening the port. Also gets
+    # back in step after an error, forgetting any responses still expected.
+    #
+    def sign_on(attempts=12)
+      @pending.clear
+      attempts.times do
+        @port.drain
+        @port.write(Client.frame(@seq, [CMD_SIGN_ON].pack('C')))
+        if (frame = @port.read_frame(0.25)) && frame[1].getbyte(0) == CMD_SIGN_ON
+          @seq = (frame[0] + 1) & 0xFF
+          id   = frame[1].byteslice(3, frame[1].getbyte(2))
+          raise Error, "Not a ScratchMonkey: #{id}" unless id == SIGN_ON_ID
+          response = command([CMD_GET_PARAMETER, PARAM2_SCRATCHMONKEY_MAX_BODY])
+          @max_body = (response.getbyte(2) << 8) | response.getbyte(3) if response.getbyte(1) == STATUS_CMD_OK
+          return id
+        end
+      end
+      raise Error, "No response from programmer"
+    end
+
+    def set_param(param, value)
+      body = param >= 0xC0 ? [CMD_SET_PARAMETER, param, value >> 8, value & 0xFF] : [CMD_SET_PARAMETER, param, value]
+      check(command(body), "Setting parameter #{param}")
+    end
+
+    #
+    # Have the programmer read back every page as it writes it (see
+    # SMoVerify.h). Returns false if the firmware can't. Signing on turns
+    # this off again.
+    #
+    def verify_inline(on)
+      set_param(PARAM_SCRATCHMONKEY_VERIFY, on ? 1 : 0)
+      true
+    rescue Error
+      false
+    end
+
+    def get_param(param)
+      response = check(command([CMD_GET_PARAMETER, param]), "Getting parameter #{param}")
+      param >= 0xC0 ? (response.getbyte(2) << 8) | response.getbyte(3) : response.getbyte(2)
+    end
+
+    #
+    # Per device patches, applied by the programmer as it writes (see
+    # SMoPatch.h). patches are [flags, byte address, data]
+    #
+    def set_patches(patches)
+      check(command([CMD_SCRATCHMONKEY_PATCH, SCRATCHMONKEY_PATCH_CLEAR]), "Clearing patches")
+      patches.each do |flags, address, data|
+        check(command([CMD_SCRATCHMONKEY_PATCH, SCRATCHMONKEY_PATCH_ADD, flags, address].pack('CCCN') + data),
+              "Adding patch")
+      end
+    end
+
+    #
+    # Performance counters (see SMoStats.h). Times are converted to seconds.
+    # Returns nil if the firmware was built without SMO_STATS.
+    #
+    def clear_stats
+      command([CMD_SCRATCHMONKEY_STATS, SCRATCHMONKEY_STATS_CLEAR]).getbyte(1) == STATUS_CMD_OK
+    end
+
+    def stats
+      response = command([CMD_SCRATCHMONKEY_STATS, SCRATCHMONKEY_STATS_SUMMARY])
+      return nil unless response.getbyte(1) == STATUS_CMD_OK
+      tick_ns, idle, polls, poll_ticks, isp, hvsp, hvpp, tpi, count = response.unpack('@2nN7C')
+      tick     = tick_ns * 1e-9
+      commands = []
+      while commands.length < count
+        response = check(command([CMD_SCRATCHMONKEY_STATS, SCRATCHMONKEY_STATS_COMMANDS, commands.length]),
+                         "Reading statistics")
+        entries  = response.byteslice(3..-1)
+        break if entries.empty?
+        (0...entries.bytesize).step(29) do |offset|
+          code, calls, total, max, *histogram = entries.byteslice(offset, 29).unpack('CN3n8')
+          commands << { command: code, count: calls, total: total*tick, max: max*tick,
+                        histogram: histogram }
+        end
+      end
+      { tick: tick, idle: idle*tick, polls: polls, poll_time: poll_ticks*tick,
+        bytes: { isp: isp, hvsp: hvsp, hvpp: hvpp, tpi: tpi }, commands: commands }
+    end
+
+    #
+    # Event trace (see SMoTrace.h). Returns the tick length in seconds and the
+    # records [event, arg, a, b, time in ticks], or nil if the firmware was
+    # built without SMO_TRACE.
+    #
+    def clear_trace
+      command([CMD_SCRATCHMONKEY_TRACE, SCRATCHMONKEY_TRACE_CLEAR]).getbyte(1) == STATUS_CMD_OK
+    end
+
+    def trace
+      records = []
+      tick    = nil
+      seq     = 0
+      loop do
+        response = command([CMD_SCRATCHMONKEY_TRACE, SCRATCHMONKEY_TRACE_READ, seq >> 8, seq & 0xFF])
+        return nil unless response.getbyte(1) == STATUS_CMD_OK
+        tick_ns, logged, first = response.unpack('@2n3')
+        tick   ||= tick_ns * 1e-9
+        data     = response.byteslice(8..-1)
+        (0...data.bytesize).step(10) {|offset| records << data.byteslice(offset, 10).unpack('CCnnN')}
+        seq      = (first + data.bytesize / 10) & 0xFFFF
+        break if seq == logged || data.empty?
+      end
+      [tick, records]
+    end
+
+    #
+    # Link self test (see SMoLink.h). Each returns the response body, which
+    # has a status other than STATUS_CMD_OK if the firmware was built
+    # without SMO_LINK_TEST.
+    #
+    def link_sink(data)
+      command([CMD_SCRATCHMONKEY_LINK, SCRATCHMONKEY_LINK_SINK].pack('CC') + data)
+    end
+
+    def link_source(count)
+      command([CMD_SCRATCHMONKEY_LINK, SCRATCHMONKEY_LINK_SOURCE, count].pack('CCn'))
+    end
+
+    def link_echo(data)
+      command([CMD_SCRATCHMONKEY_LINK, SCRATCHMONKEY_LINK_ECHO].pack('CC') + data)
+    end
+
+    #
+    # Bit timing knobs (see SMoTiming.h). timing returns nil if the
+    # firmware was built without SMO_TIMING.
+    #
+    def timing
+      response = command([CMD_SCRATCHMONKEY_TIMING, SCRATCHMONKEY_TIMING_GET])
+      return nil unless response.getbyte(1) == STATUS_CMD_OK
+      *knobs, mhz, stored = response.unpack("@2C#{TIMING_KNOBS.length}CC")
+      { knobs: knobs, mhz: mhz, stored: stored != 0 }
+    end
+
+    def set_timing(knobs)
+      check(command([CMD_SCRATCHMONKEY_TIMING, SCRATCHMONKEY_TIMING_SET, *knobs]), "Setting timing")
+    end
+
+    #
+    # Sweep knob, running probe (an STK command body) repeats times per
+    # setting and comparing count bytes of its response. Returns the pass
+    # map, the setting chosen, and whether any setting was safe.
+    #
+    def shmoo(knob, repeats, margin, count, probe)
+      probe    = probe.pack('C*') if probe.is_a?(Array)
+      response = command([CMD_SCRATCHMONKEY_TIMING, SCRATCHMONKEY_TIMING_SHMOO,
+                          knob, repeats, margin, count, probe.bytesize].pack('C*') + probe)
+      passed, setting = response.unpack('@2nC')
+      [passed || 0, setting, response.getbyte(1) == STATUS_CMD_OK]
+    end
+
+    def store_timing
+      check(command([CMD_SCRATCHMONKEY_TIMING, SCRATCHMONKEY_TIMING_STORE]), "Storing timing")
+    end
+
+    def clear_timing
+      check(command([CMD_SCRATCHMONKEY_TIMING, SCRATCHMONKEY_TIMING_CLEAR]), "Clearing timing")
+    end
+
+    #
+    # Pin capture (see SMoCapture.h). Runs probe (an STK command body) while
+    # sampling ports every interval ticks. Returns the status of the probe,
+    # the layout and number of analog inputs, the tick length in seconds, and
+    # the samples, one array of port values each, or nil if the firmware was
+    # built without SMO_CAPTURE or has no sampler.
+    #
+    def capture(interval, ports, probe)
+      probe    = probe.pack('C*') if probe.is_a?(Array)
+      response = command([CMD_SCRATCHMONKEY_CAPTURE, SCRATCHMONKEY_CAPTURE_RUN, interval,
+                          ports.length, *(ports + [0, 0]).first(3), probe.bytesize].pack('C*') + probe)
+      return nil unless response.getbyte(1) == STATUS_CMD_OK
+      status, layout, analog, tick_ns, count = response.unpack('@2CCCnn')
+      data = String.new(encoding: Encoding::BINARY)
+      while data.bytesize < count * ports.length
+        first = data.bytesize / ports.length
+        chunk = check(command([CMD_SCRATCHMONKEY_CAPTURE, SCRATCHMONKEY_CAPTURE_READ, first >> 8, first & 0xFF]),
+                      "Reading samples").byteslice(4..-1)
+        break if chunk.empty?
+        data << chunk
+      end
+      [status, layout, analog, tick_ns * 1e-9, data.unpack('C*').each_slice(ports.length).to_a]
+    end
+
+    #
+    # What the programmer's device table says about the target last put in
+    # programming mode (see SMoDevice.h), or nil if the part is not in the
+    # table or the firmware was built without SMO_DEVICES. Times are in ms.
+    #
+    def device
+      response = command([CMD_SCRATCHMONKEY_DEVICE, SCRATCHMONKEY_DEVICE_INFO])
+      return nil unless response.getbyte(1) == STATUS_CMD_OK
+      signature, modes, flash, flash_page, eeprom, eeprom_page, flash_write, eeprom_write, erase, stack =
+        response.unpack('@2a3CNnnCCCCC')
+      { signature: signature.unpack('C*'), modes: modes, flash: flash, flash_page: flash_page,
+        eeprom: eeprom, eeprom_page: eeprom_page, flash_write: flash_write, eeprom_write: eeprom_write,
+        erase: erase, stack: stack != 0 }
+    end
+
+    def device_control_stack
+      check(command([CMD_SCRATCHMONKEY_DEVICE, SCRATCHMONKEY_DEVICE_CONTROL_STACK]),
+            "Reading control stack").unpack('@2C32')
+    end
+
+    #
+    # Two stage programming (see SMoHelper.h). helper_start returns false if
+    # the helper did not answer or the firmware was built without SMO_HELPER.
+    # helper_finish erases the helper page at address, or keeps it if nil.
+    #
+    def helper_start
+      command([CMD_SCRATCHMONKEY_HELPER, SCRATCHMONKEY_HELPER_START]).getbyte(1) == STATUS_CMD_OK
+    end
+
+    def helper_finish(address)
+      check(command([CMD_SCRATCHMONKEY_HELPER, SCRATCHMONKEY_HELPER_FINISH].pack('CC') + [address || 0xFFFFFFFF].pack('N')),
+            "Finishing helper")
+    end
+
+    def load_address(address)
+      submit([CMD_LOAD_ADDRESS, address >> 24, (address >> 16) & 0xFF, (address >> 8) & 0xFF, address & 0xFF]) do |r|
+        check(r, "Loading address")
+      end
+    end
+
+    private
+
+    def in_flight
+      @pending.drop(1).inject(0) {|sum,p| sum + p[1]}
+    end
+
+    def collect_one
+      frame = @port.read_frame(@timeout) or raise Error, "Timeout waiting for response"
+      seq, _, callback = @pending.shift
+      raise Error, "Response #{frame[0]} out of sequence, expected #{seq}" if frame[0] != seq
+      callback.call(frame[1]) if callback
+    end
+  end
+
+  #
+  # Stand-in for Client that records commands for standalone replay instead
+  # of sending them (see SMoStore.h). Responses are faked: Region streaming
+  # is reported as unsupported, so programming is recorded page by page.
+  #
+  class Recorder < Client
+    attr_reader :records  # [[body, expected]]
+
+    def initialize(max_body)
+      super(nil)
+      @max_body = max_body
+      @records  = []
+    end
+
+    def submit(body, &callback)
+      body = body.pack('C*') if body.is_a?(Array)
+      if body.getbyte(0) == CMD_SCRATCHMONKEY_REGION_START
+        status = STATUS_CMD_UNKNOWN
+      else
+        status = STATUS_CMD_OK
+        @records << [body.b, ''.b]
+      end
+      callback.call([body.getbyte(0), status].pack('C*') + ("\0" * 6).b) if callback
+      @records.length - 1
+    end
+
+    def expect(body, expected, what)
+      submit(body)
+      @records[-1][1] = expected.b
+    end
+
+    def flush
+    end
+
+    #
+    # Upload recording through a real client
+    #
+    def upload(client)
+      client.check(client.command([CMD_SCRATCHMONKEY_STORE, SCRATCHMONKEY_STORE_BEGIN]), "Starting recording")
+      @records.each do |body, expected|
+        record = [CMD_SCRATCHMONKEY_STORE, SCRATCHMONKEY_STORE_RECORD, body.bytesize].pack('CCn') + body + expected
+        raise Error, "Record of #{record.bytesize} bytes too large for programmer" if record.bytesize > client.max_body
+        client.submit(record) {|r| client.check(r, "Recording")}
+      end
+      client.flush
+      client.check(client.command([CMD_SCRATCHMONKEY_STORE, SCRATCHMONKEY_STORE_END]), "Finishing recording")
+    end
+  end
+
+  #
+  # Memory image: sparse map from byte address to data
+  #
+  class Image
+    attr_reader :chunks   # [[address, data]] sorted, non-overlapping
+
+    def initialize
+      @chunks = []
+    end
+
+    def add(address, data)
+      @chunks << [address, data.b]
+    end
+
+    def empty?
+      @chunks.empty?
+    end
+
+    #
+    # Overwrite bytes, as the programmer does for patches
+    #
+    def patch(address, data)
+      data.each_byte.with_index do |byte, i|
+        chunk = @chunks.find {|a,d| a <= address+i && address+i < a+d.bytesize}
+        if chunk
+          chunk[1].setbyte(address+i-chunk[0], byte)
+        else
+          @chunks << [address+i, byte.chr.b]
+        end
+      end
+      finish
+    end
+
+    def finish
+      @chunks.sort_by! {|c| c[0]}
+      merged = []
+      @chunks.each do |address, data|
+        if !merged.empty? && merged[-1][0] + merged[-1][1].bytesize == address
+          merged[-1][1] << data
+        else
+          merged << [address, data.dup]
+        end
+      end
+      @chunks = merged
+      self
+    end
+
+    #
+    # Split into pages, padded with 0xFF. Unless keep_blank is set, pages
+    # consisting only of 0xFF are dropped: They read back that way after a
+    # chip erase anyway.
+    #
+    def pages(page_size, keep_blank=false)
+      pages = {}
+      @chunks.each do |address, data|
+        offset = 0
+        while offset < data.bytesize
+          page  = (address + offset) / page_size * page_size
+          start = address + offset - page
+          len   = [page_size - start, data.bytesize - offset].min
+          pages[page] ||= ("\xFF" * page_size).b
+          pages[page][start, len] = data.byteslice(offset, len)
+          offset += len
+        end
+      end
+      pages.delete_if {|_,d| d.count("\xFF".b) == page_size} unless keep_blank
+      pages.sort.to_a
+    end
+
+    def self.load(path, mem=:flash)
+      data = File.binread(path)
+      data.start_with?("\x7FELF".b) ? load_elf(data, mem) : load_hex(data)
+    end
+
+    def self.load_hex(text)
+      image = Image.new
+      base  = 0
+      text.each_line do |line|
+        line = line.strip
+        next if line.empty?
+        raise Error, "Bad Intel HEX line: #{line}" unless line =~ /^:((?:[0-9A-Fa-f]{2})+)$/
+        bytes = [$1].pack('H*').bytes
+        raise Error, "Checksum error in Intel HEX line: #{line}" if bytes.sum & 0xFF != 0
+        len, hi, lo, type = bytes[0..3]
+        payload = bytes[4, len]
+        case type
+        when 0x00
+          image.add(base + ((hi << 8) | lo), payload.pack('C*'))
+        when 0x01
+          break
+        when 0x02
+          base = ((payload[0] << 8) | payload[1]) << 4
+        when 0x04
+          base = ((payload[0] << 8) | payload[1]) << 16
+        end
+      end
+      image.finish
+    end
+
+    #
+    # avr-gcc ELF files: flash is at 0, EEPROM at 0x810000 in the LMA space
+    #
+    ELF_SECTIONS = { flash: 0...0x800000, eeprom: 0x810000...0x820000 }
+
+    def self.load_elf(data, mem)
+      raise Error, "Only 32 bit little endian ELF files supported" unless data.getbyte(4) == 1 && data.getbyte(5) == 1
+      phoff, = data.unpack('@28V')
+      phentsize, phnum = data.unpack('@42vv')
+      range = ELF_SECTIONS[mem]
+      image = Image.new
+      phnum.times do |i|
+        type, offset, _, paddr, filesz = data.unpack("@#{phoff+i*phentsize}V5")
+        next unless type == 1 && filesz > 0 && range.include?(paddr)
+        image.add(paddr - range.first, data.byteslice(offset, filesz))
+      end
+      image.finish
+    end
+  end
+
+  #
+  # Builder for CMD_SCRATCHMONKEY_SCRIPT, see SMoScript.h
+  #
+  class Script
+    OPCODES = { command: 0x01, spi: 0x02, hvsp: 0x03, hvpp_command: 0x04, hvpp_address: 0x05,
+                hvpp_data: 0x06, hvpp_commit: 0x07, hvpp_read: 0x08, poll: 0x09, delay: 0x0A,
+                compare: 0x0B, abort_unless: 0x0C, append: 0x0D }
+
+    attr_reader :results
+
+    def initialize
+      @code     = String.new(encoding: Encoding::BINARY)
+      @results  = 0
+    end
+
+    def command(body, count=0)
+      body = body.pack('C*') if body.is_a?(Array)
+      @results += count
+      @code << [OPCODES[:command], count, body.bytesize].pack('CCC') << body
+      self
+    end
+
+    def append
+      @results += 1
+      emit(:append)
+    end
+
+    def method_missing(op, *operands)
+      return super unless OPCODES[op]
+      emit(op, *operands)
+    end
+
+    def respond_to_missing?(op, all=false)
+      OPCODES.include?(op) || super
+    end
+
+    #
+    # Returns the results, or nil if the firmware does not know scripts
+    #
+    def run(client, what)
+      response = client.command([CMD_SCRATCHMONKEY_SCRIPT].pack('C') + @code)
+      return nil if response.getbyte(1) == STATUS_CMD_UNKNOWN
+      if response.getbyte(1) != STATUS_CMD_OK
+        raise Error, format("%s failed at script offset %d with status %02X", what, response.unpack('@2n')[0], response.getbyte(1))
+      end
+      response.byteslice(4, @results).unpack('C*')
+    end
+
+    private
+
+    def emit(op, *operands)
+      @code << [OPCODES[op], *operands].pack('C*')
+      self
+    end
+  end
+
+  #
+  # ISP programming session. Memory parameters follow avrdude.conf; the
+  # defaults fit all paged AVRs.
+  #
+  class ISP
+    FLASH_PARAMS  = [0xC1, 10, 0x40, 0x4C, 0x20, 0xFF, 0xFF]
+    EEPROM_PARAMS = [0xC1, 10, 0xC1, 0xC2, 0xA0, 0xFF, 0xFF]
+    WRITE_TIMEOUT = 20      # ms
+    FUSE_WRITE    = { low: [0xAC, 0xA0, 0x00], high: [0xAC, 0xA8, 0x00], ext: [0xAC, 0xA4, 0x00], lock: [0xAC, 0xE0, 0x00] }
+    FUSE_READ     = { low: [0x50, 0x00, 0x00, 0x00], high: [0x58, 0x08, 0x00, 0x00],
+                      ext: [0x50, 0x08, 0x00, 0x00], lock: [0x58, 0x00, 0x00, 0x00] }
+
+    def initialize(client)
+      @client = client
+    end
+
+    def enter
+      @client.check(@client.command([CMD_ENTER_PROGMODE_ISP, 200, 100, 25, 32, 0, 0x53, 3, 0xAC, 0x53, 0x00, 0x00]),
+                    "Entering programming mode")
+    end
+
+    def leave
+      @client.check(@client.command([CMD_LEAVE_PROGMODE_ISP, 1, 1]), "Leaving programming mode")
+    end
+
+    def erase
+      @client.check(@client.command([CMD_CHIP_ERASE_ISP, 45, 1, 0xAC, 0x80, 0x00, 0x00]), "Erasing chip")
+    end
+
+    def signature
+      script = Script.new
+      (0..2).each {|i| script.spi(0x30, 0x00, i, 0x00).append}
+      result = script.run(@client, "Reading signature")
+      return result if result
+      (0..2).map do |i|
+        @client.check(@client.command([CMD_READ_SIGNATURE_ISP, 4, 0x30, 0x00, i, 0x00]), "Reading signature").getbyte(2)
+      end
+    end
+
+    def write_fuse(fuse, value)
+      command = fuse == :lock ? CMD_PROGRAM_LOCK_ISP : CMD_PROGRAM_FUSE_ISP
+      @client.check(@client.command([command, *FUSE_WRITE[fuse], value]), "Writing #{fuse} fuse")
+      wait_ready("Writing #{fuse} fuse")
+    end
+
+    #
+    # Fuse writes don't poll, and the chip ignores reads and writes until
+    # they're done, so poll RDY/BSY here
+    #
+    def wait_ready(what)
+      return if Script.new.spi(0xF0, 0x00, 0x00, 0x00).poll(0x01, 0x00, WRITE_TIMEOUT).run(@client, what)
+      deadline = Time.now + WRITE_TIMEOUT / 1000.0
+      until @client.check(@client.command([CMD_SPI_MULTI, 4, 1, 3, 0xF0, 0x00, 0x00, 0x00]), what).getbyte(2)[0] == 0
+        raise Error, "#{what} timed out" if Time.now > deadline
+      end
+    end
+
+    def read_fuse(fuse)
+      command = fuse == :lock ? CMD_READ_LOCK_ISP : CMD_READ_FUSE_ISP
+      @client.check(@client.command([command, 4, *FUSE_READ[fuse]]), "Reading #{fuse} fuse").getbyte(2)
+    end
+
+    def verify_fuse(fuse, value)
+      command = fuse == :lock ? CMD_READ_LOCK_ISP : CMD_READ_FUSE_ISP
+      @client.expect([command, 4, *FUSE_READ[fuse]].pack('C*'), [value, STATUS_CMD_OK].pack('CC'), "Verifying #{fuse} fuse")
+      @client.flush
+    end
+
+    #
+    # Write pages, streamed as regions of consecutive pages
+    #
+    def program(mem, pages, page_size)
+      command = mem == :flash ? CMD_PROGRAM_FLASH_ISP : CMD_PROGRAM_EEPROM_ISP
+      params  = mem == :flash ? FLASH_PARAMS : EEPROM_PARAMS
+      runs(pages, page_size).each do |address, data|
+        region(command, params, address, page_size, data, mem == :flash)
+      end
+    end
+
+    #
+    # Read len bytes starting at byte address, keeping reads in flight
+    #
+    def read(mem, address, len)
+      command   = mem == :flash ? CMD_READ_FLASH_ISP : CMD_READ_EEPROM_ISP
+      read_cmd  = mem == :flash ? 0x20 : 0xA0
+      block     = [(@client.max_body - 3) & ~0xFF, 256].max
+      result    = String.new(encoding: Encoding::BINARY)
+      load_address(address, mem == :flash)
+      while len > 0
+        n = [block, len].min
+        @client.submit([command, n >> 8, n & 0xFF, read_cmd]) do |r|
+          result << @client.check(r, "Reading #{mem}").byteslice(2, n)
+        end
+        len -= n
+      end
+      @client.flush
+      result
+    end
+
+    #
+    # Return the CRC of each of the pages starting at the given byte addresses
+    #
+    def page_hashes(mem, addresses, page_size)
+      command = mem == :flash ? CMD_READ_FLASH_ISP : CMD_READ_EEPROM_ISP
+      limit   = (@client.max_body - 2) / 2
+      hashes  = {}
+      runs    = []
+      addresses.sort.each do |address|
+        if !runs.empty? && runs[-1][0] + runs[-1][1]*page_size == address && runs[-1][1] < limit
+          runs[-1][1] += 1
+        else
+          runs << [address, 1]
+        end
+      end
+      runs.each do |address, count|
+        start = mem == :flash ? address >> 1 : address
+        start |= 0x80000000 if mem == :flash && start >= 0x10000
+        @client.submit([CMD_SCRATCHMONKEY_PAGE_HASH,
+                        start >> 24, (start >> 16) & 0xFF, (start >> 8) & 0xFF, start & 0xFF,
+                        page_size >> 8, page_size & 0xFF, count >> 8, count & 0xFF, command]) do |r|
+          @client.check(r, "Hashing #{mem}").unpack("@2n#{count}").each_with_index do |crc, i|
+            hashes[address + i*page_size] = crc
+          end
+        end
+      end
+      @client.flush
+      hashes
+    end
+
+    #
+    # Pages whose target contents differ from the image
+    #
+    def changed_pages(mem, pages, page_size)
+      hashes = page_hashes(mem, pages.map(&:first), page_size)
+      pages.reject {|address, data| hashes[address] == SMoHost.crc_ccitt(data)}
+    end
+
+    #
+    # Compare memory against data, with reads kept in flight
+    #
+    def verify(mem, address, data)
+      command   = mem == :flash ? CMD_READ_FLASH_ISP : CMD_READ_EEPROM_ISP
+      read_cmd  = mem == :flash ? 0x20 : 0xA0
+      block     = [(@client.max_body - 3) & ~0xFF, 256].max
+      load_address(address, mem == :flash)
+      (0...data.bytesize).step(block) do |offset|
+        n = [block, data.bytesize - offset].min
+        @client.expect([command, n >> 8, n & 0xFF, read_cmd].pack('C*'),
+                       data.byteslice(offset, n) + [STATUS_CMD_OK].pack('C'),
+                       format("Verifying %s at %06X", mem, address + offset))
+      end
+      @client.flush
+    end
+
+    private
+
+    def load_address(address, word)
+      address >>= 1 if word
+      address  |= 0x80000000 if word && address >= 0x10000
+      @client.load_address(address)
+    end
+
+    def runs(pages, page_size)
+      runs = []
+      pages.each do |address, data|
+        if !runs.empty? && runs[-1][0] + runs[-1][1].bytesize == address
+          runs[-1][1] << data
+        else
+          runs << [address, data.dup]
+        end
+      end
+      runs
+    end
+
+    def region(command, params, address, page_size, data, word)
+      start = word ? address >> 1 : address
+      start |= 0x80000000 if word && start >= 0x10000
+      len   = data.bytesize
+      response = @client.command([CMD_SCRATCHMONKEY_REGION_START,
+                                  start >> 24, (start >> 16) & 0xFF, (start >> 8) & 0xFF, start & 0xFF,
+                                  page_size >> 8, page_size & 0xFF,
+                                  len >> 24, (len >> 16) & 0xFF, (len >> 8) & 0xFF, len & 0xFF,
+                                  command] + params)
+      if response.getbyte(1) == STATUS_CMD_UNKNOWN
+        return classic(command, params, address, page_size, data, word)
+      end
+      @client.check(response, "Starting region")
+      window, max_data = response.unpack('@2nn')
+      saved, @client.window = @client.window, window
+      begin
+        offset = 0
+        while offset < len
+          n = [max_data, len - offset].min
+          @client.submit([CMD_SCRATCHMONKEY_REGION_DATA].pack('C') + data.byteslice(offset, n)) do |r|
+            if r.getbyte(1) != STATUS_CMD_OK
+              raise Error, format("Programming failed at %06X with status %02X", r.unpack('@2N')[0], r.getbyte(1))
+            end
+          end
+          offset += n
+        end
+        @client.flush
+      ensure
+        @client.window = saved
+      end
+    end
+
+    #
+    # Firmware without region support: one page per frame
+    #
+    def classic(command, params, address, page_size, data, word)
+      (0...data.bytesize).step(page_size) do |offset|
+        load_address(address + offset, word)
+        page = data.byteslice(offset, page_size)
+        @client.submit([command, page.bytesize >> 8, page.bytesize & 0xFF, params[0] | 0x80, *params[1..-1]].pack('C*') + page) do |r|
+          if r.getbyte(1) != STATUS_CMD_OK && r.bytesize >= 8
+            mismatches, first = r.unpack('@2nN')
+            raise Error, format("Verifying %06X failed, %d bytes differ", first, mismatches) if mismatches > 0
+          end
+          @client.check(r, "Programming")
+        end
+      end
+      @client.flush
+    end
+  end
+
+  #
+  # Two stage programming (see SMoHelper.h): ISP loads the helper into the
+  # smallest boot section and programs BOOTRST, the helper writes the flash
+  # pages the programmer streams to it, and ISP takes over again for the
+  # rest. The helper is assembled here, so no AVR toolchain is needed, and
+  # fitted to the part's MISO pin.
+  #
+  class Helper
+    #
+    # ATmegas with SPI and SPM registers where the helper expects them: Flash
+    # size, page size, smallest boot section, MISO bit in PORTB, and the fuse
+    # with BOOTSZ1:0 and BOOTRST in bits 2:0
+    #
+    PARTS = {
+      [0x1E, 0x94, 0x06] => ['ATmega168',    16384, 128,  256, 4, :ext],
+      [0x1E, 0x94, 0x0B] => ['ATmega168P',   16384, 128,  256, 4, :ext],
+      [0x1E, 0x95, 0x14] => ['ATmega328',    32768, 128,  512, 4, :high],
+      [0x1E, 0x95, 0x0F] => ['ATmega328P',   32768, 128,  512, 4, :high],
+      [0x1E, 0x95, 0x87] => ['ATmega32U4',   32768, 128,  512, 3, :high],
+      [0x1E, 0x96, 0x09] => ['ATmega644',    65536, 256, 1024, 6, :high],
+      [0x1E, 0x96, 0x0A] => ['ATmega644P',   65536, 256, 1024, 6, :high],
+      [0x1E, 0x97, 0x06] => ['ATmega1284',  131072, 256, 1024, 6, :high],
+      [0x1E, 0x97, 0x05] => ['ATmega1284P', 131072, 256, 1024, 6, :high],
+      [0x1E, 0x97, 0x03] => ['ATmega1280',  131072, 256, 1024, 3, :high],
+      [0x1E, 0x98, 0x01] => ['ATmega2560',  262144, 256, 1024, 3, :high]
+    }
+
+    LOAD    = 0x4C
+    WRITE   = 0x57
+    ERASE   = 0x45
+    READY   = 0xA5
+    DDRB    = 0x04
+    SPCR    = 0x2C
+    SPSR    = 0x2D
+    SPDR    = 0x2E
+    SPMCSR  = 0x37
+    RAMPZ   = 0x3B
+
+    #
+    # r0:r1 data, r16 scratch, r17 MISO, r18 READY, r19 count or RAMPZ,
+    # r20 command, Z address. [:recv, r] waits for the next byte into r.
+    #
+    SOURCE = [
+      [:ldi,  17, :miso],
+      [:out,  DDRB, 17],            # MISO output, the rest inputs
+      [:ldi,  16, 0x40],
+      [:out,  SPCR, 16],            # SPI on, slave, mode 0
+      [:ldi,  18, READY],
+      :idle,
+      [:out,  SPDR, 18],
+      [:recv, 20],
+      [:cpi,  20, LOAD],
+      [:breq, :args],
+      [:cpi,  20, WRITE],
+      [:breq, :args],
+      [:cpi,  20, ERASE],
+      [:brne, :idle],               # Polls and anything unknown
+      :args,
+      [:recv, 30],
+      [:recv, 31],
+      [:recv, 19],
+      [:cpi,  20, LOAD],
+      [:brne, :page],
+      :load,
+      [:recv, 0],
+      [:recv, 1],
+      [:ldi,  16, 0x01],            # SPMEN: Fill page buffer
+      [:out,  SPMCSR, 16],
+      [:spm],
+      [:adiw, 30, 2],
+      [:dec,  19],
+      [:brne, :load],
+      [:rjmp, :idle],
+      :page,
+      [:out,  RAMPZ, 19],
+      [:ldi,  16, 0x05],            # PGWRT|SPMEN
+      [:cpi,  20, ERASE],
+      [:brne, :busy],
+      [:ldi,  16, 0x03],            # PGERS|SPMEN
+      :busy,
+      [:ldi,  21, 0x00],
+      [:out,  SPDR, 21],
+      [:out,  SPMCSR, 16],
+      [:spm],
+      :wait,
+      [:in,   16, SPMCSR],
+      [:sbrc, 16, 0],
+      [:rjmp, :wait],
+      [:ldi,  16, 0x11],            # RWWSRE|SPMEN: Reenable RWW section
+      [:out,  SPMCSR, 16],
+      [:spm],
+      [:rjmp, :idle]
+    ]
+
+    attr_reader :name, :page_size
+
+    #
+    # Helper for the part in ISP programming mode, nil if it's not supported
+    #
+    def self.for(client, isp)
+      part = PARTS[isp.signature]
+      part && new(client, isp, part)
+    end
+
+    def initialize(client, isp, part)
+      @client = client
+      @isp    = isp
+      @name, @flash, @page_size, @boot_size, @miso, @fuse = part
+    end
+
+    #
+    # Program flash pages (as from Image#pages) into the erased chip, and
+    # leave the target in ISP programming mode with the boot fuse restored.
+    # Pages sharing the helper's page are written over ISP at the end, so
+    # they can't be if the helper is kept. Returns false if the helper did
+    # not answer, with the chip erased again and nothing written.
+    #
+    def program(pages, keep)
+      base      = @flash - @boot_size
+      code      = Helper.assemble(@miso)
+      own, rest = pages.partition {|address, _| address >= base && address < base + @page_size}
+      raise Error, format("Image overlaps the helper at %06X", base) if keep && !own.empty?
+      boot      = @isp.read_fuse(@fuse)
+      @isp.write_fuse(@fuse, (boot & ~0x07) | 0x06)        # BOOTRST, smallest boot section
+      @isp.program(:flash, [[base, code + "\xFF".b * (@page_size - code.bytesize)]], @page_size)
+      started   = false
+      begin
+        started = @client.helper_start
+        @isp.program(:flash, rest, @page_size) if started
+      ensure
+        @client.helper_finish(started && !keep ? base : nil)
+        @isp.enter
+        @isp.write_fuse(@fuse, boot)
+      end
+      if started
+        @isp.program(:flash, own, @page_size)
+      else
+        @isp.erase
+      end
+      started
+    end
+
+    def self.assemble(miso, source=SOURCE)
+      code = source.flat_map do |insn|
+        next [insn] unless insn.is_a?(Array) && insn[0] == :recv
+        [[:in, 16, SPSR], [:sbrs, 16, 7], [:rjmp, -3], [:in, insn[1], SPDR]]
+      end
+      labels = {}
+      insns  = []
+      code.each {|insn| insn.is_a?(Symbol) ? labels[insn] = insns.length : insns << insn}
+      insns.each_with_index.map do |(op, a, b), pc|
+        b   = 1 << miso if b == :miso
+        rel = ->(target) { (target.is_a?(Symbol) ? labels[target] - pc - 1 : target) }
+        case op
+        when :ldi  then 0xE000 | ((b & 0xF0) << 4) | ((a - 16) << 4) | (b & 0x0F)
+        when :cpi  then 0x3000 | ((b & 0xF0) << 4) | ((a - 16) << 4) | (b & 0x0F)
+        when :in   then 0xB000 | ((b & 0x30) << 5) | (a << 4) | (b & 0x0F)
+        when :out  then 0xB800 | ((a & 0x30) << 5) | (b << 4) | (a & 0x0F)
+        when :sbrs then 0xFE00 | (a << 4) | b
+        when :sbrc then 0xFC00 | (a << 4) | b
+        when :rjmp then 0xC000 | (rel[a] & 0xFFF)
+        when :breq then 0xF001 | ((rel[a] & 0x7F) << 3)
+        when :brne then 0xF401 | ((rel[a] & 0x7F) << 3)
+        when :adiw then 0x9600 | ((b & 0x30) << 2) | (((a - 24) / 2) << 4) | (b & 0x0F)
+        when :dec  then 0x940A | (a << 4)
+        when :spm  then 0x95E8
+        end
+      end.pack('v*')
+    end
+  end
+end